@@ -0,0 +1,360 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ans.h"
+#include "cpu.h"
+
+void ans_normalize_frequencies(const uint32_t *histogram, uint16_t *frequencies)
+{
+
+  const int total_frequency = 1 << ANS_PROBABILITY_BITS;
+
+  uint64_t total = 0;
+
+  int i;
+  for (i = 0; i < BYTE_MAX+1; ++i) total += histogram[i];
+
+  int sum = 0;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+  {
+    frequencies[i] = histogram[i] ? MAX(1, (int)(((uint64_t)histogram[i]*total_frequency)/total)) : 0;
+    sum += frequencies[i];
+  }
+
+  /* Rounding errors are corrected at the most frequent symbol */
+  int max_symbol;
+  while (sum != total_frequency)
+  {
+
+    max_symbol = 0;
+    for (i = 1; i < BYTE_MAX+1; ++i)
+      if (frequencies[i] > frequencies[max_symbol]) max_symbol = i;
+
+    if (sum < total_frequency)
+    {
+      frequencies[max_symbol] += total_frequency-sum;
+      sum = total_frequency;
+    }
+    else
+    {
+      --frequencies[max_symbol];
+      --sum;
+    }
+
+  }
+
+}
+
+/* Frequencies below 128 take one byte, larger ones two with the high bit set.
+ * A 0 byte is followed by the length of the zero run minus one. Returns the
+ * number of bytes written. */
+int ans_write_frequencies(const uint16_t *frequencies, byte *cd)
+{
+
+  int cd_index = 0;
+
+  int i = 0, run;
+  while (i < BYTE_MAX+1)
+  {
+
+    if (frequencies[i] >= 128)
+    {
+      cd[cd_index++] = 0x80 | (frequencies[i] >> 8);
+      cd[cd_index++] = frequencies[i] & 0xFF;
+      ++i;
+      continue;
+    }
+
+    if (frequencies[i])
+    {
+      cd[cd_index++] = frequencies[i++];
+      continue;
+    }
+
+    run = 0;
+    while ((i < BYTE_MAX+1) && (!frequencies[i]) && (run < BYTE_MAX+1)) { ++run; ++i; }
+
+    cd[cd_index++] = 0;
+    cd[cd_index++] = run-1;
+
+  }
+
+  return cd_index;
+
+}
+
+int ans_read_frequencies(const byte *cd, const int size, uint16_t *frequencies)
+{
+
+  int cd_index = 0;
+
+  int i = 0, run;
+  byte b;
+  while (i < BYTE_MAX+1)
+  {
+
+    /* A byte and the one behind it */
+    if (cd_index+1 >= size) return -1;
+
+    b = cd[cd_index++];
+
+    if (b & 0x80)
+    {
+      frequencies[i++] = ((b & 0x7F) << 8) | cd[cd_index++];
+      continue;
+    }
+
+    if (b)
+    {
+      frequencies[i++] = b;
+      continue;
+    }
+
+    run = cd[cd_index++]+1;
+    while ((run > 0) && (i < BYTE_MAX+1)) { frequencies[i++] = 0; --run; }
+
+  }
+
+  return cd_index;
+
+}
+
+int ansEncodeBound(const int size)
+{
+
+  /* Size, symbol count, frequencies, states and at most one word per symbol */
+  return sizeof(uint32_t) + 1 + 2*(BYTE_MAX+1) + ANS_STATE_COUNT*sizeof(uint32_t) + size*sizeof(uint16_t);
+
+}
+
+void ansEncode(void *data, const int size, void *coded_data, int *coded_size, void *parameters)
+{
+
+  byte *d = data;
+
+  byte *cd = coded_data;
+  int coded_data_index = 0;
+
+  uint32_t tmp = (uint32_t)size;
+  memcpy(cd, &tmp, sizeof(uint32_t));
+  coded_data_index += sizeof(uint32_t);
+
+  if (size == 0)
+  {
+    *coded_size = coded_data_index;
+    return;
+  }
+
+  const ANSParameters *ans_parameters = parameters;
+
+  uint32_t counted_histogram[BYTE_MAX+1];
+  const uint32_t *histogram = counted_histogram;
+  if (ans_parameters && ans_parameters->histogram)
+    histogram = ans_parameters->histogram;
+  else
+    kernels.histogram(d, size, counted_histogram);
+
+  int symbol_count = 0;
+  int i;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+    if (histogram[i]) ++symbol_count;
+
+  cd[coded_data_index++] = (byte)(symbol_count-1);
+
+  if (symbol_count == 1)
+  {
+    cd[coded_data_index++] = d[0];
+    *coded_size = coded_data_index;
+    return;
+  }
+
+  uint16_t frequencies[BYTE_MAX+1];
+  ans_normalize_frequencies(histogram, frequencies);
+
+  coded_data_index += ans_write_frequencies(frequencies, &cd[coded_data_index]);
+
+  uint32_t cumulative[BYTE_MAX+1];
+  cumulative[0] = 0;
+  for (i = 1; i < BYTE_MAX+1; ++i) cumulative[i] = cumulative[i-1]+frequencies[i-1];
+
+  /* The decoder reads the words in reverse order, they are produced back to
+   * front at the end of the ansEncodeBound() bytes and moved behind the
+   * header afterwards. A state renormalizes with at most one word per symbol. */
+  byte *words = &cd[ansEncodeBound(size)];
+  int word_index = 0;
+  uint16_t word;
+
+  uint32_t states[ANS_STATE_COUNT];
+  int j;
+  for (j = 0; j < ANS_STATE_COUNT; ++j) states[j] = ANS_STATE_LOWER_BOUND;
+
+  uint32_t x, frequency;
+  for (i = size-1; i >= 0; --i)
+  {
+
+    j = i % ANS_STATE_COUNT;
+    x = states[j];
+    frequency = frequencies[d[i]];
+
+    if (x >= ((ANS_STATE_LOWER_BOUND >> ANS_PROBABILITY_BITS) << 16)*frequency)
+    {
+      word = (uint16_t)x;
+      word_index -= sizeof(uint16_t);
+      memcpy(&words[word_index], &word, sizeof(uint16_t));
+      x >>= 16;
+    }
+
+    states[j] = ((x/frequency) << ANS_PROBABILITY_BITS) + (x % frequency) + cumulative[d[i]];
+
+  }
+
+  word_index -= sizeof(states);
+  memcpy(&words[word_index], states, sizeof(states));
+
+  memmove(&cd[coded_data_index], &words[word_index], -word_index);
+  coded_data_index += -word_index;
+
+  *coded_size = coded_data_index;
+
+}
+
+bool ansDecode(void *coded_data, const int coded_size, void *data, int *size)
+{
+
+  byte *d = data;
+
+  byte *cd = coded_data;
+  int coded_data_index = 0;
+
+  *size = 0;
+
+  if (coded_size < sizeof(uint32_t)) return false;
+
+  uint32_t tmp;
+  memcpy(&tmp, cd, sizeof(uint32_t));
+  coded_data_index += sizeof(uint32_t);
+
+  if (tmp > INT_MAX) return false;
+
+  const int decoded_size = (int)tmp;
+
+  if (decoded_size == 0) return true;
+
+  if (coded_data_index+2 > coded_size) return false;
+
+  const int symbol_count = (int)cd[coded_data_index++]+1;
+
+  if (symbol_count == 1)
+  {
+    memset(d, cd[coded_data_index], decoded_size);
+    *size = decoded_size;
+    return true;
+  }
+
+  uint16_t frequencies[BYTE_MAX+1];
+  const int frequencies_size = ans_read_frequencies(&cd[coded_data_index], coded_size-coded_data_index, frequencies);
+
+  if (frequencies_size < 0) return false;
+
+  coded_data_index += frequencies_size;
+
+  uint32_t cumulative[BYTE_MAX+1];
+  cumulative[0] = 0;
+
+  int i, j;
+  for (i = 1; i < BYTE_MAX+1; ++i) cumulative[i] = cumulative[i-1]+frequencies[i-1];
+
+  /* The slots are filled from the frequencies, they have to cover them
+   * exactly */
+  if (cumulative[BYTE_MAX]+frequencies[BYTE_MAX] != (1 << ANS_PROBABILITY_BITS)) return false;
+
+  if (coded_data_index+sizeof(uint32_t)*ANS_STATE_COUNT > coded_size) return false;
+
+  /* Symbol of every slot, indexed by the low ANS_PROBABILITY_BITS of a state */
+  byte slots[1 << ANS_PROBABILITY_BITS];
+  for (i = 0; i < BYTE_MAX+1; ++i)
+    memset(&slots[cumulative[i]], i, frequencies[i]);
+
+  const byte *p = &cd[coded_data_index];
+
+  uint32_t states[ANS_STATE_COUNT];
+  memcpy(states, p, sizeof(states));
+  p += sizeof(states);
+
+  const uint32_t mask = (1 << ANS_PROBABILITY_BITS)-1;
+
+  /* A round reads at most one word per state past this */
+  const byte *end = &cd[coded_size];
+
+  byte symbol;
+  uint32_t slot;
+  uint16_t word;
+  int renormalize;
+
+  /* The states do not depend on each other, the inner loop is unrolled and
+   * the renormalization is branchless */
+  const int round_count = decoded_size/ANS_STATE_COUNT;
+  for (i = 0; i < round_count; ++i)
+  {
+
+    if (p > end) return false;
+
+    for (j = 0; j < ANS_STATE_COUNT; ++j)
+    {
+
+      slot = states[j] & mask;
+      symbol = slots[slot];
+      d[j] = symbol;
+      states[j] = frequencies[symbol]*(states[j] >> ANS_PROBABILITY_BITS) + slot - cumulative[symbol];
+
+      memcpy(&word, p, sizeof(uint16_t));
+      renormalize = (states[j] < ANS_STATE_LOWER_BOUND);
+      states[j] = renormalize ? ((states[j] << 16) | word) : states[j];
+      p += renormalize*sizeof(uint16_t);
+
+    }
+
+    d += ANS_STATE_COUNT;
+
+  }
+
+  for (j = 0; j < decoded_size-round_count*ANS_STATE_COUNT; ++j)
+  {
+
+    if (p > end) return false;
+
+    slot = states[j] & mask;
+    symbol = slots[slot];
+    d[j] = symbol;
+    states[j] = frequencies[symbol]*(states[j] >> ANS_PROBABILITY_BITS) + slot - cumulative[symbol];
+
+    if (states[j] < ANS_STATE_LOWER_BOUND)
+    {
+      memcpy(&word, p, sizeof(uint16_t));
+      p += sizeof(uint16_t);
+      states[j] = (states[j] << 16) | word;
+    }
+
+  }
+
+  if (p > end) return false;
+
+  *size = decoded_size;
+
+  return true;
+
+}
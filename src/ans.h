@@ -0,0 +1,64 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANS_H
+#define ANS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "types.h"
+
+/* Range variant of asymmetric numeral systems over bytes. The coded block
+ * starts with the size and the number of symbols, followed by the normalized
+ * frequencies (or the symbol if there is just one), the initial states and
+ * the 16 bit renormalization words. Symbol i is coded with state
+ * i % ANS_STATE_COUNT, all states share one word stream. */
+
+/* Frequencies sum up to 1 << ANS_PROBABILITY_BITS */
+#define ANS_PROBABILITY_BITS 14
+
+#define ANS_STATE_COUNT 4
+
+/* Lower bound of the normalized state interval */
+#define ANS_STATE_LOWER_BOUND (1u << 16)
+
+typedef struct tANSParameters ANSParameters;
+
+/* Passed as parameters to ansEncode, NULL selects the defaults */
+struct tANSParameters
+{
+  const uint32_t *histogram;    /* Byte histogram of the data, NULL to count it */
+};
+
+/* Scales the histogram to frequencies summing up to 1 << ANS_PROBABILITY_BITS,
+ * every occurring symbol keeps a frequency of at least 1 */
+void ans_normalize_frequencies(const uint32_t *histogram, uint16_t *frequencies);
+
+/* Upper bound of the coded size of size bytes, coded_data of ansEncode has
+ * to hold this many bytes */
+int ansEncodeBound(const int size);
+
+void ansEncode(void *data, const int size, void *coded_data, int *coded_size, void *parameters);
+
+/* coded_data has to be readable for 8 bytes past coded_size, false if the
+ * coded data is damaged */
+bool ansDecode(void *coded_data, const int coded_size, void *data, int *size);
+
+#endif
@@ -0,0 +1,141 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+static ArenaBlock* p_ArenaBlockCreate(const size_t capacity, ArenaBlock *next)
+{
+
+  ArenaBlock *block = HeapAlloc(sizeof(ArenaBlock));
+
+  if (!block) return NULL;
+
+  block->next = next;
+  block->capacity = capacity;
+  block->size = 0;
+  block->data = HeapAlignedAlloc(ARENA_ALIGNMENT, capacity);
+
+  if (!block->data)
+  {
+    free(block);
+    return NULL;
+  }
+
+  return block;
+
+}
+
+static void p_ArenaBlocksDestroy(ArenaBlock *block)
+{
+
+  ArenaBlock *next;
+  while (block)
+  {
+    next = block->next;
+    free(block->data);
+    free(block);
+    block = next;
+  }
+
+}
+
+Arena* ArenaCreate(const size_t capacity)
+{
+
+  Arena *arena = HeapAlloc(sizeof(Arena));
+
+  if (!arena) return NULL;
+
+  arena->blocks = p_ArenaBlockCreate(MAX((capacity+ARENA_ALIGNMENT-1) & ~((size_t)ARENA_ALIGNMENT-1), ARENA_ALIGNMENT), NULL);
+
+  if (!arena->blocks)
+  {
+    free(arena);
+    return NULL;
+  }
+
+  return arena;
+
+}
+
+void ArenaDestroy(Arena *arena)
+{
+
+  if (!arena) return;
+
+  p_ArenaBlocksDestroy(arena->blocks);
+
+  free(arena);
+
+}
+
+void* ArenaAlloc(Arena *arena, const size_t size)
+{
+
+  if (!arena) return HeapAlloc(size);
+
+  const size_t aligned_size = MAX((size+ARENA_ALIGNMENT-1) & ~((size_t)ARENA_ALIGNMENT-1), ARENA_ALIGNMENT);
+
+  ArenaBlock *block = arena->blocks;
+
+  if ((!block) || (block->size+aligned_size > block->capacity))
+  {
+    block = p_ArenaBlockCreate(block ? MAX(block->capacity << 1, aligned_size) : aligned_size, block);
+    if (!block) return NULL;
+    arena->blocks = block;
+  }
+
+  void *result = &block->data[block->size];
+  block->size += aligned_size;
+
+  return result;
+
+}
+
+void ArenaFree(Arena *arena, void *data)
+{
+
+  if (!arena) free(data);
+
+}
+
+void ArenaReset(Arena *arena)
+{
+
+  /* Without memory for the merged block the arena is left empty */
+  if (arena->blocks && arena->blocks->next)
+  {
+    const size_t capacity = ArenaCapacity(arena);
+    p_ArenaBlocksDestroy(arena->blocks);
+    arena->blocks = p_ArenaBlockCreate(capacity, NULL);
+  }
+
+  if (arena->blocks) arena->blocks->size = 0;
+
+}
+
+size_t ArenaCapacity(const Arena *arena)
+{
+
+  size_t capacity = 0;
+
+  const ArenaBlock *block;
+  for (block = arena->blocks; block; block = block->next) capacity += block->capacity;
+
+  return capacity;
+
+}
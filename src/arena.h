@@ -0,0 +1,66 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "heap.h"
+
+/* Bump allocator for the buffers of one image. Everything is released at
+ * once by ArenaReset, which also merges the blocks added since the last
+ * reset into one. Once an arena has seen the largest image it does no more
+ * heap allocations.
+ *
+ * A NULL arena stands for the heap: ArenaAlloc mallocs and ArenaFree frees,
+ * while ArenaFree on a real arena does nothing. ArenaCreate and ArenaAlloc
+ * return NULL if out of memory. */
+
+#define ARENA_ALIGNMENT 64
+
+typedef struct tArenaBlock ArenaBlock;
+
+struct tArenaBlock
+{
+  ArenaBlock *next;
+  size_t capacity;
+  size_t size;
+  byte *data;
+};
+
+struct tArena
+{
+  ArenaBlock *blocks;       /* Current block first, NULL if a reset ran out of memory */
+};
+typedef struct tArena Arena;
+
+Arena* ArenaCreate(const size_t capacity);
+void ArenaDestroy(Arena *arena);
+
+void* ArenaAlloc(Arena *arena, const size_t size);
+void ArenaFree(Arena *arena, void *data);
+
+void ArenaReset(Arena *arena);
+
+/* Bytes held by the arena */
+size_t ArenaCapacity(const Arena *arena);
+
+#endif
@@ -0,0 +1,595 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "batch.h"
+
+/* A file on its way through the pipeline */
+struct tBatchJob
+{
+  char *input;
+  char *output;
+  bool result;              /* Not failed so far */
+  InputFile file;           /* Read by the reader */
+  byte *data;               /* Written by the writer */
+  size_t size;
+  FIMEMORY *bmp;            /* Holds data when decompressing */
+  size_t memory;            /* Bytes charged to the memory budget */
+  FileStats stats;
+};
+typedef struct tBatchJob BatchJob;
+
+/* Bounded queue of jobs between two stages. Pop returns NULL once the
+ * queue is closed and empty. */
+struct tBatchQueue
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  BatchJob **jobs;
+  int capacity;
+  int first;
+  int count;
+  bool closed;
+};
+typedef struct tBatchQueue BatchQueue;
+
+/* State of a worker, kept from file to file */
+struct tBatchWorker
+{
+  BILDEncoder *encoder;
+  BILDDecoder *decoder;
+  Buffer *pixels;           /* Image to encode */
+};
+typedef struct tBatchWorker BatchWorker;
+
+/* Pipeline shared by the reader, the workers and the writer */
+struct tBatch
+{
+  FILE *list;
+  const BatchOptions *options;
+  BatchQueue read;          /* Files read, to code */
+  BatchQueue coded;         /* Files coded, to write */
+  BatchWorker *workers;
+  pthread_mutex_t mutex;    /* Memory budget */
+  pthread_cond_t memory_freed;
+  size_t memory;            /* Bytes charged */
+  double read_time;         /* Of the reader and the writer */
+  double write_time;
+  int64_t file_count;       /* Report, kept by the writer */
+  int64_t failed_count;
+  int64_t pixel_count;
+  int64_t coded_size;
+};
+typedef struct tBatch Batch;
+
+/* Running out of memory is not recovered from in batch mode, the library
+ * reports it as BILDErrorMemory */
+static void* p_Check(void *data)
+{
+
+  if (!data)
+  {
+    fprintf(stderr, "%s\n", BILDStatusMessage(BILDErrorMemory));
+    abort();
+  }
+
+  return data;
+
+}
+
+static double p_Now(void)
+{
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+
+}
+
+static void p_QueueInit(BatchQueue *queue, const int capacity)
+{
+
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  queue->jobs = p_Check(HeapAlloc(capacity*sizeof(BatchJob*)));
+  queue->capacity = capacity;
+  queue->first = 0;
+  queue->count = 0;
+  queue->closed = false;
+
+}
+
+static void p_QueueDestroy(BatchQueue *queue)
+{
+
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+  free(queue->jobs);
+
+}
+
+static void p_QueuePush(BatchQueue *queue, BatchJob *job)
+{
+
+  pthread_mutex_lock(&queue->mutex);
+
+  while (queue->count == queue->capacity)
+    pthread_cond_wait(&queue->not_full, &queue->mutex);
+
+  queue->jobs[(queue->first+queue->count++) % queue->capacity] = job;
+
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+
+}
+
+static BatchJob* p_QueuePop(BatchQueue *queue)
+{
+
+  BatchJob *job = NULL;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  while ((queue->count == 0) && !queue->closed)
+    pthread_cond_wait(&queue->not_empty, &queue->mutex);
+
+  if (queue->count > 0)
+  {
+    job = queue->jobs[queue->first];
+    queue->first = (queue->first+1) % queue->capacity;
+    --queue->count;
+    pthread_cond_signal(&queue->not_full);
+  }
+
+  pthread_mutex_unlock(&queue->mutex);
+
+  return job;
+
+}
+
+static void p_QueueClose(BatchQueue *queue)
+{
+
+  pthread_mutex_lock(&queue->mutex);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_mutex_unlock(&queue->mutex);
+
+}
+
+/* Bytes per pixel held while an image is coded losslessly (the worst
+ * case), besides its files: encoding holds the bitmap, the RGB8 pixels, the
+ * planes, their levels and the packed coefficients, decoding the levels and
+ * the bitmap written into */
+#define BATCH_ENCODE_PIXEL_BYTES 21
+#define BATCH_DECODE_LEVEL_BYTES 8
+#define BATCH_DECODE_PIXEL_BYTES 4
+
+/* Estimates the memory that coding the opened file takes from the size of
+ * the image in its header, 0 if it has none */
+static size_t p_EstimateMemory(const InputFile *file, const BatchOptions *options)
+{
+
+  const byte *header = file->data;
+  const size_t size = file->size;
+
+  int64_t width, height;
+
+  if (options->compress)
+  {
+
+    /* BITMAPFILEHEADER and the size of the image in BITMAPCOREHEADER or
+     * BITMAPINFOHEADER, the height is negative for top-down rows */
+    if ((size < 26) || (header[0] != 'B') || (header[1] != 'M')) return 0;
+
+    uint32_t info_size;
+    memcpy(&info_size, &header[14], sizeof(uint32_t));
+
+    if (info_size == 12)
+    {
+      uint16_t core_width, core_height;
+      memcpy(&core_width, &header[18], sizeof(uint16_t));
+      memcpy(&core_height, &header[20], sizeof(uint16_t));
+      width = core_width;
+      height = core_height;
+    }
+    else
+    {
+      int32_t info_width, info_height;
+      memcpy(&info_width, &header[18], sizeof(int32_t));
+      memcpy(&info_height, &header[22], sizeof(int32_t));
+      width = ABS((int64_t)info_width);
+      height = ABS((int64_t)info_height);
+    }
+
+    return width*height*BATCH_ENCODE_PIXEL_BYTES;
+
+  }
+
+  BILDInfo info;
+
+  if (BILDReadInfo(header, size, &info) != BILDOk) return 0;
+
+  int scaled_width, scaled_height;
+  BILDScaledSize(&info, options->scale, &scaled_width, &scaled_height);
+
+  width = options->region ? options->region->width : scaled_width;
+  height = options->region ? options->region->height : scaled_height;
+
+  /* The levels of an untiled image are held at the scaled size, even for a
+   * region, those of a tiled one only for the tiles under it */
+  const int64_t level_pixels = (info.tile_size > 0) ? width*height : (int64_t)scaled_width*scaled_height;
+
+  return level_pixels*BATCH_DECODE_LEVEL_BYTES + width*height*BATCH_DECODE_PIXEL_BYTES;
+
+}
+
+/* Charges size bytes to the memory budget of job. Only the reader waits
+ * for memory, so that the files in flight can always be written, and only
+ * for the other jobs, so that a larger job goes through on its own. */
+static void p_Charge(Batch *batch, BatchJob *job, const size_t size, const bool wait)
+{
+
+  pthread_mutex_lock(&batch->mutex);
+
+  while (wait && (batch->memory > job->memory) && (batch->memory+size > batch->options->memory_budget))
+    pthread_cond_wait(&batch->memory_freed, &batch->mutex);
+
+  batch->memory += size;
+  job->memory += size;
+
+  pthread_mutex_unlock(&batch->mutex);
+
+}
+
+static void p_Release(Batch *batch, BatchJob *job)
+{
+
+  pthread_mutex_lock(&batch->mutex);
+
+  batch->memory -= job->memory;
+  job->memory = 0;
+
+  pthread_cond_broadcast(&batch->memory_freed);
+  pthread_mutex_unlock(&batch->mutex);
+
+}
+
+/* The first length characters of string followed by suffix, in a new string */
+static char* p_CopyString(const char *string, const size_t length, const char *suffix)
+{
+
+  char *result = p_Check(HeapAlloc(length+strlen(suffix)+1));
+
+  memcpy(result, string, length);
+  strcpy(&result[length], suffix);
+
+  return result;
+
+}
+
+/* A job for a line "<input>" or "<input>\t<output>" of the list, by default
+ * the output is the input with extension instead of its own */
+static BatchJob* p_CreateJob(const char *line, const char *extension)
+{
+
+  BatchJob *job = p_Check(HeapAlloc(sizeof(BatchJob)));
+  memset(job, 0, sizeof(BatchJob));
+
+  const char *tab = strchr(line, '\t');
+
+  if (tab)
+  {
+
+    job->input = p_CopyString(line, tab-line, "");
+    job->output = p_CopyString(tab+1, strlen(tab+1), "");
+
+  }
+  else
+  {
+
+    const char *slash = strrchr(line, '/');
+    const char *dot = strrchr(line, '.');
+    const size_t length = (dot && (!slash || (dot > slash))) ? (size_t)(dot-line) : strlen(line);
+
+    job->input = p_CopyString(line, strlen(line), "");
+    job->output = p_CopyString(line, length, extension);
+
+  }
+
+  job->result = true;
+
+  return job;
+
+}
+
+static void p_DestroyJob(BatchJob *job)
+{
+
+  free(job->input);
+  free(job->output);
+  free(job);
+
+}
+
+/* Reader: reads the files of the list into memory. Scaled decodes read
+ * only the prefix they need, the other files are mapped and populated
+ * unless another access is asked for. */
+static void* p_ReadFiles(void *context)
+{
+
+  Batch *batch = context;
+  const BatchOptions *options = batch->options;
+
+  const bool whole = options->compress || ((options->scale == 0) && !options->region);
+  const int scale = options->compress ? 0 : options->scale;
+
+  FileAccess access = options->access;
+  if (access == FileAccessAuto) access = whole ? FileAccessPopulate : FileAccessRead;
+
+  char *line = NULL;
+  size_t line_capacity = 0;
+  ssize_t length;
+  struct stat st;
+  BatchJob *job;
+  StageClock start;
+
+  while ((length = getline(&line, &line_capacity, batch->list)) >= 0)
+  {
+
+    while ((length > 0) && ((line[length-1] == '\n') || (line[length-1] == '\r')))
+      line[--length] = '\0';
+
+    if (length == 0) continue;
+
+    job = p_CreateJob(line, options->compress ? ".bild" : ".bmp");
+
+    /* The file before it is read, then the image decoded from it or coded
+     * into it, from the header read with it */
+    p_Charge(batch, job, (stat(job->input, &st) == 0) ? (size_t)st.st_size : 0, true);
+
+    StageStart(&start);
+    job->result = InputFileOpen(&job->file, job->input, scale, options->region, access);
+
+    /* BMP files give their pixels once parsed by the worker */
+    if (job->result)
+    {
+      StageStop(&start, job->file.size, options->compress ? 0 : job->file.size, &job->stats.read);
+      batch->read_time += job->stats.read.wall;
+      p_Charge(batch, job, p_EstimateMemory(&job->file, options), true);
+    }
+
+    p_QueuePush(&batch->read, job);
+
+  }
+
+  free(line);
+
+  p_QueueClose(&batch->read);
+
+  return NULL;
+
+}
+
+/* Worker: codes the files read from memory into memory */
+static void p_CodeFiles(void *context, const int slot)
+{
+
+  Batch *batch = context;
+  const BatchOptions *options = batch->options;
+  BatchWorker *worker = &batch->workers[slot];
+
+  BatchJob *job;
+  const byte *coded_data;
+
+  while ((job = p_QueuePop(&batch->read)))
+  {
+
+    if (job->result)
+    {
+
+      if (options->compress)
+      {
+
+        /* The coded image belongs to the encoder, the writer gets a copy */
+        job->result = BILDEncoderCodeBMP(worker->encoder, &job->file, options->quality, options->coder, worker->pixels,
+                                         &coded_data, &job->size, &job->stats);
+
+        if (job->result)
+        {
+          job->data = p_Check(HeapAlloc(job->size));
+          memcpy(job->data, coded_data, job->size);
+        }
+
+      }
+      else
+      {
+
+        job->bmp = BILDDecoderDecodeBMP(worker->decoder, &job->file, options->scale, options->region, &job->stats);
+        job->result = (job->bmp != NULL);
+
+        if (job->result)
+        {
+          DWORD size;
+          FreeImage_AcquireMemory(job->bmp, &job->data, &size);
+          job->size = size;
+        }
+
+      }
+
+      InputFileClose(&job->file);
+
+    }
+
+    p_Charge(batch, job, job->size, false);
+
+    p_QueuePush(&batch->coded, job);
+
+  }
+
+}
+
+/* Writer: writes the coded files and keeps the report */
+static void* p_WriteFiles(void *context)
+{
+
+  Batch *batch = context;
+
+  BatchJob *job;
+  FILE *f;
+  StageClock start;
+
+  while ((job = p_QueuePop(&batch->coded)))
+  {
+
+    if (job->result)
+    {
+
+      StageStart(&start);
+
+      f = fopen(job->output, "wb");
+      job->result = f && (fwrite(job->data, sizeof(byte), job->size, f) == job->size);
+      if (f && (fclose(f) != 0)) job->result = false;
+
+      /* BMP files took their pixels when formatted by the worker */
+      StageStop(&start, batch->options->compress ? job->size : 0, job->size, &job->stats.write);
+      batch->write_time += job->stats.write.wall;
+
+      if (!job->result) printf("Cannot write %s.\n", job->output);
+
+    }
+
+    if (job->bmp)
+      FreeImage_CloseMemory(job->bmp);
+    else
+      free(job->data);
+
+    p_Release(batch, job);
+
+    ++batch->file_count;
+
+    if (job->result)
+    {
+      batch->pixel_count += job->stats.pixel_count;
+      batch->coded_size += job->stats.coded_size;
+      FileStatsPrint(job->input, &job->stats, batch->options->compress);
+    }
+    else
+    {
+      printf("Failed: %s\n", job->input);
+      ++batch->failed_count;
+    }
+
+    p_DestroyJob(job);
+
+  }
+
+  return NULL;
+
+}
+
+static void p_PrintReport(const Batch *batch, const double seconds)
+{
+
+  const double megapixels = batch->pixel_count*1e-6;
+
+  printf("Files..................... %lld (%lld failed)\n", (long long)batch->file_count, (long long)batch->failed_count);
+  printf("Pixels.................... %.1f MP\n", megapixels);
+  printf("Coded..................... %.1f MB (%.2f bits/pixel)\n", batch->coded_size*1e-6,
+         (batch->pixel_count > 0) ? 8.0*batch->coded_size/batch->pixel_count : 0.0);
+  printf("Time...................... %.3f sec (reading %.3f sec, writing %.3f sec)\n", seconds, batch->read_time,
+         batch->write_time);
+
+  if (seconds > 0)
+    printf("Throughput................ %.1f files/s, %.1f MP/s\n", batch->file_count/seconds, megapixels/seconds);
+
+}
+
+bool BatchRun(FILE *list, const BatchOptions *options)
+{
+
+  Batch batch;
+  batch.list = list;
+  batch.options = options;
+  batch.memory = 0;
+  batch.read_time = 0;
+  batch.write_time = 0;
+  batch.file_count = 0;
+  batch.failed_count = 0;
+  batch.pixel_count = 0;
+  batch.coded_size = 0;
+
+  const int worker_count = ThreadPoolThreadCount();
+
+  /* A few files per worker are read ahead and wait to be written */
+  p_QueueInit(&batch.read, 2*worker_count);
+  p_QueueInit(&batch.coded, 2*worker_count);
+  pthread_mutex_init(&batch.mutex, NULL);
+  pthread_cond_init(&batch.memory_freed, NULL);
+
+  batch.workers = p_Check(HeapAlloc(worker_count*sizeof(BatchWorker)));
+
+  int i;
+  for (i = 0; i < worker_count; ++i)
+  {
+
+    BatchWorker *worker = &batch.workers[i];
+
+    worker->encoder = options->compress ? p_Check(BILDEncoderCreate()) : NULL;
+    worker->decoder = options->compress ? NULL : p_Check(BILDDecoderCreate());
+    worker->pixels = p_Check(BufferCreate(0));
+
+    if (worker->encoder) BILDEncoderSetTileSize(worker->encoder, options->tile_size);
+
+  }
+
+  const double start = p_Now();
+
+  pthread_t reader, writer;
+  pthread_create(&reader, NULL, p_ReadFiles, &batch);
+  pthread_create(&writer, NULL, p_WriteFiles, &batch);
+
+  ThreadPoolParallelFor(worker_count, p_CodeFiles, &batch);
+
+  p_QueueClose(&batch.coded);
+
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+
+  p_PrintReport(&batch, p_Now()-start);
+
+  for (i = 0; i < worker_count; ++i)
+  {
+    BILDEncoderDestroy(batch.workers[i].encoder);
+    BILDDecoderDestroy(batch.workers[i].decoder);
+    BufferDestroy(batch.workers[i].pixels);
+  }
+
+  free(batch.workers);
+
+  pthread_mutex_destroy(&batch.mutex);
+  pthread_cond_destroy(&batch.memory_freed);
+  p_QueueDestroy(&batch.read);
+  p_QueueDestroy(&batch.coded);
+
+  return (batch.failed_count > 0);
+
+}
@@ -0,0 +1,61 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "bild.h"
+#include "imageio.h"
+
+/* Batch mode of the command line tool: many files coded in one process */
+
+struct tBatchOptions
+{
+  bool compress;            /* BMP to BILD files, else BILD to BMP files */
+  int quality;
+  EntropyCoderID coder;
+  int tile_size;
+  int scale;                /* Decompression at 1/2^scale of the size */
+  const BILDRect *region;   /* NULL decompresses the whole image */
+  FileAccess access;        /* Of the input files */
+  size_t memory_budget;     /* Bytes of files and images held in memory at a time */
+};
+typedef struct tBatchOptions BatchOptions;
+
+/* Codes the files listed in list, a line "<input>" or "<input>\t<output>"
+ * per file, by default the output is the input with the extension of the
+ * other format. The files go through a pipeline: a reader thread reads
+ * them into memory, ThreadPoolThreadCount() workers code them and a writer
+ * thread writes the results, so the I/O of some files overlaps the coding
+ * of others. The stages are joined by bounded queues, and the reader waits
+ * while the files read and not yet written, with an estimate of their
+ * images from the headers read with them, exceed the memory budget (a
+ * single larger file is let through on its own). Each worker keeps its encoder or decoder and buffers from
+ * file to file, outside the budget, threads of the pool left without a
+ * file help with the images still coded. Prints the files that fail and a
+ * report at the end. Returns true if any file failed. */
+bool BatchRun(FILE *list, const BatchOptions *options);
+
+#endif
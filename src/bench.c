@@ -0,0 +1,412 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* bild-bench: times BILDEncode, BILDDecode and their stages on synthetic images */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "globals.h"
+#include "bild.h"
+#include "cpu.h"
+#include "threadpool.h"
+#include "entropy.h"
+
+#include "types.h"
+
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+#define DEFAULT_REPETITIONS 5
+
+/* BILDEncode and BILDDecode as a whole and their stages, see BILDStages */
+enum tBenchStage
+{
+  StageColour = 0, StageTransform, StageCoding, StageEncode,
+  StageDecoding, StageReconstruct, StageInverseColour, StageDecode, StageCount
+};
+typedef enum tBenchStage BenchStage;
+
+static const char *p_stage_names[StageCount] =
+{
+  "colour", "transform", "coding", "encode", "decoding", "reconstruct", "colour inv", "decode"
+};
+
+enum tBenchImage { BenchGradient = 0, BenchNoise, BenchPhoto, BenchImageCount };
+typedef enum tBenchImage BenchImage;
+
+static const char *p_image_names[BenchImageCount] = { "gradient", "noise", "photo" };
+
+double p_Now(void)
+{
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+
+}
+
+static uint32_t p_Random(uint32_t *state)
+{
+
+  *state = *state*1103515245+12345;
+
+  return *state >> 8;
+
+}
+
+void* p_Check(void *data)
+{
+
+  if (!data)
+  {
+    printf("%s\n", BILDStatusMessage(BILDErrorMemory));
+    exit(1);
+  }
+
+  return data;
+
+}
+
+/* RGB8 pixels, width*3 bytes a row */
+uint8_t* p_CreateSyntheticImage(const BenchImage type, const int width, const int height)
+{
+
+  uint8_t *pixels = p_Check(malloc((size_t)width*height*3));
+
+  uint32_t random_state = 0xB11D;
+  double v;
+  int32_t rgb[3];
+
+  int x, y, c;
+  for (y = 0; y < height; ++y)
+  {
+    for (x = 0; x < width; ++x)
+    {
+
+      switch (type)
+      {
+
+        case BenchGradient:
+          rgb[0] = (x*255)/MAX(width-1, 1);
+          rgb[1] = (y*255)/MAX(height-1, 1);
+          rgb[2] = ((x+y)*255)/MAX(width+height-2, 1);
+          break;
+
+        case BenchNoise:
+          rgb[0] = p_Random(&random_state) & 0xFF;
+          rgb[1] = p_Random(&random_state) & 0xFF;
+          rgb[2] = p_Random(&random_state) & 0xFF;
+          break;
+
+        default:
+          /* Smooth shading, a few hard edged shapes and sensor noise */
+          v = 128+60*sin(x*0.013)*cos(y*0.017)+30*sin((x+2*y)*0.041);
+          if (((x/97)+(y/61)) % 5 == 0) v += 50;
+          if ((x-width/3)*(x-width/3)+(y-height/2)*(y-height/2) < (height/5)*(height/5)) v = 220-v/4;
+          for (c = 0; c < 3; ++c)
+            rgb[c] = (int32_t)(v*(0.8+0.15*c))+(int32_t)(p_Random(&random_state) % 9)-4;
+          break;
+
+      }
+
+      for (c = 0; c < 3; ++c)
+        pixels[((size_t)y*width+x)*3+c] = CLIP(rgb[c]);
+
+    }
+  }
+
+  return pixels;
+
+}
+
+int p_CompareTimes(const void *elem1, const void *elem2)
+{
+
+  const double t1 = *(const double*)elem1;
+  const double t2 = *(const double*)elem2;
+
+  return (t1 > t2) - (t1 < t2);
+
+}
+
+/* Peak signal to noise ratio in dB of decoded against source, infinite if
+ * they are the same */
+double p_PSNR(const uint8_t *source, const uint8_t *decoded, const size_t size)
+{
+
+  double error = 0;
+  int d;
+
+  size_t i;
+  for (i = 0; i < size; ++i)
+  {
+    d = (int)source[i]-decoded[i];
+    error += d*d;
+  }
+
+  return (error > 0) ? 10*log10(255.0*255.0*size/error) : INFINITY;
+
+}
+
+/* One BILDEncode and BILDDecode of the width x height RGB8 pixels of source
+ * into decoded, times[stage] receives the seconds of every stage. Returns
+ * the size of the BILD file, lossless images have to decode to source. */
+size_t p_RunOnce(BILDEncoder *encoder, BILDDecoder *decoder, const uint8_t *source, uint8_t *decoded, const int width,
+                 const int height, const int quality, const EntropyCoderID coder, double *times)
+{
+
+  const uint8_t *coded;
+  size_t coded_size;
+  BILDStatus status;
+  double start;
+
+  start = p_Now();
+  status = BILDEncode(encoder, source, width, height, width*3, BILDPixelRGB8, quality, (BILDCoder)coder, &coded, &coded_size);
+  times[StageEncode] = p_Now()-start;
+
+  if (status != BILDOk)
+  {
+    printf("Encoding failed: %s\n", BILDStatusMessage(status));
+    exit(1);
+  }
+
+  const BILDStages *stages = BILDEncoderStages(encoder);
+  times[StageColour] = stages->colour.wall;
+  times[StageTransform] = stages->transform.wall;
+  times[StageCoding] = stages->coding.wall;
+
+  start = p_Now();
+  status = BILDDecode(decoder, coded, coded_size, decoded, width*3, BILDPixelRGB8);
+  times[StageDecode] = p_Now()-start;
+
+  if (status != BILDOk)
+  {
+    printf("Decoding failed: %s\n", BILDStatusMessage(status));
+    exit(1);
+  }
+
+  stages = BILDDecoderStages(decoder);
+  times[StageDecoding] = stages->coding.wall;
+  times[StageReconstruct] = stages->transform.wall;
+  times[StageInverseColour] = stages->colour.wall;
+
+  if ((quality == 0) && (memcmp(decoded, source, (size_t)width*height*3) != 0))
+  {
+    printf("Lossless round trip failed.\n");
+    exit(1);
+  }
+
+  return coded_size;
+
+}
+
+void p_Bench(const BenchImage type, const int width, const int height, const int quality, const int repetitions, const EntropyCoderID coder)
+{
+
+  const size_t raw_size = (size_t)width*height*3;
+  const double pixel_count = (double)width*height;
+
+  uint8_t *source = p_CreateSyntheticImage(type, width, height);
+  uint8_t *decoded = p_Check(malloc(raw_size));
+
+  BILDEncoder *encoder = p_Check(BILDEncoderCreate());
+  BILDDecoder *decoder = p_Check(BILDDecoderCreate());
+
+  double *times = p_Check(malloc(StageCount*repetitions*sizeof(double)));
+  double run_times[StageCount];
+  size_t file_size = 0;
+
+  int r, s;
+  for (r = 0; r < repetitions; ++r)
+  {
+    file_size = p_RunOnce(encoder, decoder, source, decoded, width, height, quality, coder, run_times);
+    for (s = 0; s < StageCount; ++s) times[s*repetitions+r] = run_times[s];
+  }
+
+  printf("%s q%d: %zu -> %zu bytes (ratio %.2f, PSNR %.2f dB)\n", p_image_names[type], quality, raw_size, file_size,
+         (double)raw_size/file_size, p_PSNR(source, decoded, raw_size));
+  printf("  %-12s %10s %10s %10s %10s\n", "stage", "median ms", "p99 ms", "MB/s", "ns/pixel");
+
+  double *t, median, p99;
+  for (s = 0; s < StageCount; ++s)
+  {
+
+    t = &times[s*repetitions];
+    qsort(t, repetitions, sizeof(double), p_CompareTimes);
+
+    median = (repetitions % 2) ? t[repetitions/2] : (t[repetitions/2-1]+t[repetitions/2])/2;
+    /* Nearest rank */
+    p99 = t[MAX((int)ceil(0.99*repetitions)-1, 0)];
+
+    printf("  %-12s %10.3f %10.3f %10.1f %10.2f\n", p_stage_names[s], median*1e3, p99*1e3,
+           (median > 0) ? raw_size/median/1e6 : 0.0, median*1e9/pixel_count);
+
+  }
+
+  printf("\n");
+
+  free(times);
+
+  BILDDecoderDestroy(decoder);
+  BILDEncoderDestroy(encoder);
+
+  free(decoded);
+  free(source);
+
+}
+
+void help(const char *bin)
+{
+
+  fprintf(stdout, "BILD Version %d: Benchmark of BILDEncode and BILDDecode on synthetic images.\n\n", VERSION);
+  fprintf(stdout, "Usage: %s [options]\n\n", bin);
+
+  fprintf(stdout, "Options:\n");
+  fprintf(stdout, "  -s <W>x<H>      Image size (default: %dx%d).\n", DEFAULT_WIDTH, DEFAULT_HEIGHT);
+  fprintf(stdout, "  -r <N>          Repetitions per image and quality (default: %d).\n", DEFAULT_REPETITIONS);
+  fprintf(stdout, "  -q <N>          Only quality N (default: 0..7).\n");
+  fprintf(stdout, "  -t <IMAGE>      Only gradient, noise or photo (default: all).\n");
+  fprintf(stdout, "  -j <N>          Number of threads (default: 1).\n");
+  fprintf(stdout, "  --cpu=<LEVEL>   Kernel set: scalar, sse4.1, avx2 or avx512.\n");
+  fprintf(stdout, "  --coder=<CODER> Entropy coder: huffman (default) or ans.\n");
+  fprintf(stdout, "  -h              Show this help.\n\n");
+
+  fprintf(stdout, "Throughput is given in MB of RGB input per second. Stages fused with the next one show\n");
+  fprintf(stdout, "up as zero, lossless images are checked to decode to the same pixels.\n");
+
+}
+
+int main(int argc, char *argv[])
+{
+
+  int width = DEFAULT_WIDTH;
+  int height = DEFAULT_HEIGHT;
+  int repetitions = DEFAULT_REPETITIONS;
+  int quality = -1;
+  int image_type = -1;
+  int thread_count = 1;
+  EntropyCoderID coder = EntropyHuffman;
+  CPULevel cpu_level = CPUDetectLevel();
+
+  int arg = 1;
+  bool bWrongArgs = false;
+  int i;
+
+  while ((!bWrongArgs) && (arg < argc))
+  {
+
+    /* Every single letter option but -h takes a value */
+    if ((argv[arg][0] != '-') || (!argv[arg][1]) || ((argv[arg][1] != '-') && (argv[arg][1] != 'h') && (arg+1 == argc)))
+    {
+      bWrongArgs = true;
+      break;
+    }
+
+    switch (argv[arg][1])
+    {
+
+      case 's':
+        bWrongArgs = (sscanf(argv[arg+1], "%dx%d", &width, &height) != 2) || (width < 1) || (height < 1);
+        arg += 2;
+        break;
+
+      case 'r':
+        repetitions = atoi(argv[arg+1]);
+        bWrongArgs = (repetitions < 1);
+        arg += 2;
+        break;
+
+      case 'q':
+        quality = atoi(argv[arg+1]);
+        bWrongArgs = ((quality < 0) || (quality > 7));
+        arg += 2;
+        break;
+
+      case 't':
+        image_type = -1;
+        for (i = 0; i < BenchImageCount; ++i)
+          if (strcmp(argv[arg+1], p_image_names[i]) == 0) image_type = i;
+        bWrongArgs = (image_type < 0);
+        arg += 2;
+        break;
+
+      case 'j':
+        thread_count = atoi(argv[arg+1]);
+        bWrongArgs = (thread_count < 1);
+        arg += 2;
+        break;
+
+      case '-':
+        if (strncmp(argv[arg], "--cpu=", 6) == 0)
+          bWrongArgs = !CPUParseLevel(argv[arg]+6, &cpu_level);
+        else if (strncmp(argv[arg], "--coder=", 8) == 0)
+          bWrongArgs = !EntropyParseCoder(argv[arg]+8, &coder);
+        else
+          bWrongArgs = true;
+        arg++;
+        break;
+
+      case 'h':
+        help(argv[0]);
+        return 0;
+
+      default: bWrongArgs = true; break;
+
+    }
+
+  }
+
+  if (bWrongArgs)
+  {
+    help(argv[0]);
+    return 1;
+  }
+
+  if (!CPUSetLevel(cpu_level))
+  {
+    printf("CPU does not support the %s kernels.\n", CPULevelName(cpu_level));
+    return 1;
+  }
+
+  ThreadPoolInit(thread_count);
+
+  printf("BILD benchmark: %dx%d, %d repetitions, %s kernels, %d threads, %s coder\n\n",
+         width, height, repetitions, CPULevelName(CPUGetLevel()), thread_count, EntropyCoderName(coder));
+
+  int t, q;
+  for (t = 0; t < BenchImageCount; ++t)
+  {
+
+    if ((image_type >= 0) && (t != image_type)) continue;
+
+    for (q = 0; q <= 7; ++q)
+    {
+      if ((quality >= 0) && (q != quality)) continue;
+      p_Bench(t, width, height, q, repetitions, coder);
+    }
+
+  }
+
+  ThreadPoolDestroy();
+
+  return 0;
+
+}
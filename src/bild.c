@@ -17,378 +17,3139 @@
 
 #include "bild.h"
 
-Levels2D* p_FileToLevels(FILE *f, const bool rle_compression)
+/* Channel of an image coded row by row, see BILDEncoderBegin */
+struct tBILDStreamChannel
 {
+  LineDecomposition2D *decomposition;
+  Levels2D *levels;         /* Levels coded whole, a block of rows of the split ones */
+  Buffer **coded;           /* Coded levels */
+  Buffer *headers;
+  Buffer *symbols;
+  Buffer *overflow;
+  bool rle_compression;
+  EntropyCoderID coder;
+  sample *row;              /* Row handed to the decomposition */
+  sample *pending;          /* First row of a pair of lossy chroma rows */
+  BILDStatus status;        /* BILDErrorMemory once a block could not be coded */
+};
+typedef struct tBILDStreamChannel BILDStreamChannel;
+
+/* Image coded row by row */
+struct tBILDStream
+{
+  int width;
+  int height;               /* 0 if no image is begun */
+  int quality;
+  EntropyCoderID coder;
+  int row;                  /* Rows written so far */
+  const uint8_t *pixels;    /* Rows of the current BILDEncoderWriteRows */
+  int row_count;
+  int stride;
+  BILDStreamChannel channels[3];
+};
+typedef struct tBILDStream BILDStream;
+
+/* Reusable state of an encoder, the arenas and buffers keep their capacity
+ * across images */
+struct tBILDEncoder
+{
+  Arena *arenas[3];         /* Levels of the channels */
+  Buffer *symbols[3];       /* Packed, run length coded coefficients */
+  Buffer *overflow[3];
+  Buffer *coded[3][BILD_MAX_LEVELS]; /* Coded levels of the channels */
+  Buffer *headers[3];       /* Headers of the channels */
+  Buffer *file;             /* Encoded image */
+  Image *image;             /* Planes of BILDEncode */
+  BILDStages stages;
+  BILDStream stream;
+  int tile_size;            /* 0 codes images in one piece */
+  BILDEncoder **tile_encoders; /* One per thread for the tiles */
+  int tile_encoder_count;
+  Buffer **tiles;           /* Coded tiles */
+  int tile_count;
+};
+
+/* Reusable state of a decoder. Without arenas everything is allocated on the
+ * heap and the image belongs to the caller. */
+struct tBILDDecoder
+{
+  Arena *arenas[3];         /* Levels and reconstructions of the channels */
+  Buffer *file;             /* Padded copy of the coded image */
+  size_t padding;           /* Readable bytes behind the coded image */
+  Image *image;             /* Returned image, NULL to create one */
+  BILDStages stages;
+  BILDDecoder **tile_decoders; /* One per thread for the tiles */
+  int tile_decoder_count;
+};
+
+/* Per channel state shared with the thread pool tasks */
+struct tBILDChannels
+{
+  int quality;
+  EntropyCoderID coder;
+  int scale;                /* Levels not reconstructed when decoding */
+  int fused_count;          /* Leading channels whose last level is left to p_ReconstructRows */
+  bool windowed;            /* Only windows of the planes are decoded */
+  Window2D windows[3];
+  Signal2D *signals[3];
+  Levels2D *levels[3];
+  BILDStatus status[3];     /* Of the tasks on the channels */
+  Arena *arenas[3];
+  Buffer *symbols[3];
+  Buffer *overflow[3];
+  Buffer **coded[3];        /* Coded levels of the channels */
+  Buffer *headers[3];       /* Headers of the channels */
+  const byte *file;         /* Coded image when decoding */
+  size_t file_size;
+  const byte *header_data[3]; /* Start of the channel headers when decoding */
+  size_t plane_size;        /* Bytes of the decoded planes */
+};
+typedef struct tBILDChannels BILDChannels;
+
+/* Tiles shared with the thread pool tasks. Every task has an encoder or
+ * decoder of its own and takes tiles until none are left. */
+struct tBILDTiles
+{
+  pthread_mutex_t mutex;
+  int next;                 /* Next tile to take */
+  int count;                /* Tiles to code */
+  int tile_size;            /* At the scale of the decoded image */
+  int columns;              /* Tiles per row of the image */
+  int first_column;         /* Tiles touched by region */
+  int first_row;
+  int region_columns;
+  int quality;
+  EntropyCoderID coder;
+  int scale;
+  int width;                /* Of the image at full size */
+  int height;
+  Image *image;             /* Source when encoding, region when decoding */
+  BILDRect region;
+  const byte *file;         /* Coded image when decoding */
+  size_t file_size;
+  const byte *file_end;     /* End of the readable bytes behind it */
+  uint8_t *pixels;          /* Region when decoding into pixels, else NULL */
+  const uint8_t *source;    /* Pixels when encoding from them, else NULL */
+  int stride;
+  PixelFormat format;
+  BILDEncoder **encoders;
+  BILDDecoder **decoders;
+  Buffer **buffers;         /* Coded tiles when encoding */
+  BILDStatus status;
+  BILDStages stages;
+};
+typedef struct tBILDTiles BILDTiles;
+
+/* Number of tiles along a side of size pixels */
+static int p_TileCount(const int size, const int tile_size)
+{
+
+  return (size+tile_size-1)/tile_size;
+
+}
+
+/* Checks the size of an image coded in tiles of tile_size, 0 if untiled.
+ * Untiled images and tiles are limited to BILD_MAX_PIXELS. */
+static bool p_CheckSize(const int64_t width, const int64_t height, const int64_t tile_size)
+{
+
+  if ((width < 1) || (height < 1)) return false;
+
+  if (tile_size == 0) return (width*height <= BILD_MAX_PIXELS);
+
+  return (width <= BILD_MAX_TILED_SIZE) && (height <= BILD_MAX_TILED_SIZE) &&
+         (MIN(width, tile_size)*MIN(height, tile_size) <= BILD_MAX_PIXELS) &&
+         ((int64_t)p_TileCount(width, tile_size)*p_TileCount(height, tile_size) <= BILD_MAX_TILE_COUNT);
+
+}
+
+/* Takes the next tile, -1 if none are left */
+static int p_TakeTile(BILDTiles *tiles)
+{
+
+  pthread_mutex_lock(&tiles->mutex);
+  const int index = (tiles->next < tiles->count) ? tiles->next++ : -1;
+  pthread_mutex_unlock(&tiles->mutex);
+
+  return index;
+
+}
+
+/* Adds the stages of a tile */
+static void p_AddTileStages(BILDTiles *tiles, const BILDStages *stages)
+{
+
+  pthread_mutex_lock(&tiles->mutex);
+  StageAdd(&tiles->stages.colour, &stages->colour);
+  StageAdd(&tiles->stages.transform, &stages->transform);
+  StageAdd(&tiles->stages.coding, &stages->coding);
+  pthread_mutex_unlock(&tiles->mutex);
+
+}
+
+/* Number of coefficients in the subbands of a level */
+static int p_LevelCoefficientCount(const BILDLevelHeader *level_header)
+{
+
+  return level_header->lh_width*level_header->lh_height + level_header->hl_width*level_header->hl_height +
+         level_header->hh_width*level_header->hh_height;
+
+}
+
+/* Number of the rows row to row+row_count-1 that a subband of height rows
+ * has */
+static int p_RowCount(const int height, const int row, const int row_count)
+{
+
+  return MAX(MIN(row+row_count, height)-row, 0);
+
+}
+
+/* Rows per block of a split level, the LH band is the highest */
+static int p_BlockRows(const BILDLevelHeader *level_header)
+{
+
+  return MIN(level_header->block_rows, level_header->lh_height);
+
+}
+
+static int p_BlockCount(const BILDLevelHeader *level_header)
+{
+
+  const int block_rows = p_BlockRows(level_header);
+
+  return (level_header->lh_height+block_rows-1)/block_rows;
+
+}
+
+/* Number of coefficients in block of a split level, the first one is the
+ * largest */
+static int p_BlockCoefficientCount(const BILDLevelHeader *level_header, const int block)
+{
+
+  const int block_rows = p_BlockRows(level_header);
+  const int row = block*block_rows;
+
+  return p_RowCount(level_header->lh_height, row, block_rows)*level_header->lh_width +
+         p_RowCount(level_header->hl_height, row, block_rows)*level_header->hl_width +
+         p_RowCount(level_header->hh_height, row, block_rows)*level_header->hh_width;
+
+}
+
+/* Entropy decodes the segment or block at data and returns its count
+ * symbols, the overflow values behind it are copied to overflow_buf. The
+ * buffers hold capacity symbols. NULL if the segment is damaged. */
+static const int8_t* p_DecodeSymbols(const byte *data, const uint32_t coded_size, const uint32_t overflow_size,
+                                     const bool rle_compression, const EntropyCoderID coder, const int count,
+                                     const int capacity, int8_t *buf1, int8_t *buf2, int32_t *overflow_buf)
+{
+
+  int buf1_size, buf2_size;
+  const int8_t *symbols = buf2;
+
+  if (overflow_size > 0)
+    memcpy(overflow_buf, data+coded_size, overflow_size*sizeof(int32_t));
+
+  if (!entropy_coders[coder].decode((void*)data, coded_size, buf2, &buf2_size)) return NULL;
+
+  if (rle_compression)
+  {
+
+    if (!rleDecode8(buf2, buf2_size, buf1, capacity, &buf1_size)) return NULL;
+
+    /* A run at the end may have decoded to a filler byte */
+    if ((buf1_size < count) || (buf1_size > count+1)) return NULL;
+
+    symbols = buf1;
+
+  }
+  else if (buf2_size != count)
+  {
+    return NULL;
+  }
+
+  /* Every escape takes an overflow value */
+  int escape_count = 0;
+
+  int i;
+  for (i = 0; i < count; ++i) escape_count += (symbols[i] == -128);
+
+  return (escape_count == overflow_size) ? symbols : NULL;
+
+}
+
+/* Unpacks rows row to row+row_count-1 of a subband, as far as it has them */
+static void p_UnpackRows(Signal2D *s, const int row, const int row_count, const int8_t *symbols, int *symbol_pos,
+                         int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const int count = p_RowCount(s->height, row, row_count)*s->width;
+  sample *target = &s->data[row*s->width];
+
+  int j;
+  for (j = 0; j < count; ++j)
+    target[j] = unpack8_32(symbols[(*symbol_pos)++], overflow_buf, overflow_buf_pos);
+
+}
+
+/* Decodes the blocks of a split level at data that hold subband rows
+ * first_row to last_row-1, the other rows are left undefined. False if a
+ * block is damaged. */
+static bool p_DecodeBlocks(Level2D *level, const BILDLevelHeader *level_header, const byte *data, const int first_row,
+                           const int last_row, const bool rle_compression, const EntropyCoderID coder, const int capacity,
+                           int8_t *buf1, int8_t *buf2, int32_t *overflow_buf)
+{
+
+  const int block_rows = p_BlockRows(level_header);
+  const int block_count = p_BlockCount(level_header);
+
+  BILDBlockHeader block_header;
+  const byte *block = &data[block_count*sizeof(BILDBlockHeader)];
+  const int8_t *symbols;
+  int symbol_pos, overflow_buf_pos, row;
+
+  int b;
+  for (b = 0; b < block_count; ++b)
+  {
+
+    memcpy(&block_header, &data[b*sizeof(BILDBlockHeader)], sizeof(BILDBlockHeader));
+    row = b*block_rows;
+
+    if ((row < last_row) && (row+block_rows > first_row))
+    {
+
+      symbols = p_DecodeSymbols(block, block_header.coded_size, block_header.overflow_size, rle_compression, coder,
+                                p_BlockCoefficientCount(level_header, b), capacity, buf1, buf2, overflow_buf);
+
+      if (!symbols) return false;
+
+      symbol_pos = 0;
+      overflow_buf_pos = 0;
+
+      p_UnpackRows(level->lh, row, block_rows, symbols, &symbol_pos, overflow_buf, &overflow_buf_pos);
+      p_UnpackRows(level->hl, row, block_rows, symbols, &symbol_pos, overflow_buf, &overflow_buf_pos);
+      p_UnpackRows(level->hh, row, block_rows, symbols, &symbol_pos, overflow_buf, &overflow_buf_pos);
+
+    }
+
+    block += block_header.coded_size+block_header.overflow_size*sizeof(int32_t);
+
+  }
+
+  return true;
+
+}
+
+/* Decodes the levels of the channel whose headers start at header into
+ * *levels, the coded levels are found at their offsets in file. The
+ * subbands of the first skip_levels levels are left out, see
+ * Reconstruct2DScaled. With a window only the blocks of the split levels
+ * under it are decoded, see Reconstruct2DWindow. BILDErrorFormat if a
+ * segment is damaged. */
+BILDStatus p_FileToLevels(const byte *file, const byte *header, const bool rle_compression, const EntropyCoderID coder,
+                          const int skip_levels, const Window2D *window, Arena *arena, Levels2D **levels)
+{
+
+  BILDLevelsHeader levels_header;
+  memcpy(&levels_header, header, sizeof(BILDLevelsHeader));
+  header += sizeof(BILDLevelsHeader);
+
+  Levels2D *result = Levels2DCreate(arena, levels_header.level_count, levels_header.width, levels_header.height);
+
+  if (!result) return BILDErrorMemory;
+
+  result->root_value = levels_header.root_value;
+  result->level_count = levels_header.level_count;
+  result->width = levels_header.width;
+  result->height = levels_header.height;
+
+  BILDLevelHeader level_header;
+
+  int i;
+  for (i = 0; i < levels_header.level_count; ++i)
+  {
+
+    memcpy(&level_header, &header[i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+
+    if (i < skip_levels)
+      result->levels[i] = Level2DCreate(arena, level_header.ll_width, level_header.ll_height, NULL, NULL, NULL);
+    else
+      result->levels[i] = Level2DCreateSubbands(arena, level_header.ll_width, level_header.ll_height,
+                                                level_header.lh_width, level_header.lh_height, level_header.hl_width,
+                                                level_header.hl_height, level_header.hh_width, level_header.hh_height);
+
+    if (!result->levels[i])
+    {
+      Levels2DDestroy(result);
+      return BILDErrorMemory;
+    }
+
+  }
+
+  /* Targets of the levels under the window, level i needs the subband rows
+   * of the row pairs of windows[i] */
+  Window2D *windows = NULL;
+
+  if (window)
+  {
+
+    windows = ArenaAlloc(arena, (levels_header.level_count+1)*sizeof(Window2D));
+
+    if (!windows)
+    {
+      Levels2DDestroy(result);
+      return BILDErrorMemory;
+    }
+
+    Levels2DWindows(result, skip_levels, window, windows);
+
+  }
+
+  /* A level without coded data is coded together with the finer levels up
+   * to the next one that has. first is the coarsest level of a segment. */
+  int first = levels_header.level_count-1;
+  int count = 0;
+  int max_count = 0;
+  int max_overflow_size = 0;
+
+  for (i = levels_header.level_count-1; (i >= 0) && (first >= skip_levels); --i)
+  {
+
+    memcpy(&level_header, &header[i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+    count += p_LevelCoefficientCount(&level_header);
+
+    if (level_header.coded_size == 0) continue;
+
+    /* Split levels are decoded block by block */
+    if (level_header.block_rows > 0) count = p_BlockCoefficientCount(&level_header, 0);
+
+    max_count = MAX(max_count, count);
+    max_overflow_size = MAX(max_overflow_size, (level_header.block_rows > 0) ? count : level_header.overflow_size);
+    count = 0;
+    first = i-1;
+
+  }
+
+  /* Room for the RLE expansion of tiny segments */
+  const int capacity = max_count*2+16;
+  int8_t *buf1 = ArenaAlloc(arena, capacity);
+  int8_t *buf2 = ArenaAlloc(arena, capacity);
+
+  int32_t *overflow_buf = ArenaAlloc(arena, max_overflow_size*sizeof(int32_t));
+  int overflow_buf_pos;
+
+  const int8_t *src_buf;
+  int src_buf_pos;
+
+  Level2D *level;
+  BILDStatus status = (buf1 && buf2 && overflow_buf) ? BILDOk : BILDErrorMemory;
+
+  first = levels_header.level_count-1;
+  count = 0;
+
+  int k;
+  for (i = levels_header.level_count-1; (i >= 0) && (first >= skip_levels) && (status == BILDOk); --i)
+  {
+
+    memcpy(&level_header, &header[i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+    count += p_LevelCoefficientCount(&level_header);
+
+    if (level_header.coded_size == 0) continue;
+
+    const byte *data = &file[level_header.offset];
+
+    /* A split level has a segment of its own */
+    if (level_header.block_rows > 0)
+    {
+
+      bool valid;
+
+      if (windows)
+        valid = p_DecodeBlocks(result->levels[i], &level_header, data, windows[i].y0 >> 1, (windows[i].y1+1) >> 1,
+                               rle_compression, coder, capacity, buf1, buf2, overflow_buf);
+      else
+        valid = p_DecodeBlocks(result->levels[i], &level_header, data, 0, level_header.lh_height, rle_compression, coder,
+                               capacity, buf1, buf2, overflow_buf);
+
+      if (!valid) status = BILDErrorFormat;
+
+      count = 0;
+      first = i-1;
+      continue;
+
+    }
+
+    src_buf = p_DecodeSymbols(data, level_header.coded_size, level_header.overflow_size, rle_compression, coder,
+                              count, capacity, buf1, buf2, overflow_buf);
+    count = 0;
+
+    if (!src_buf)
+    {
+      status = BILDErrorFormat;
+      break;
+    }
+
+    src_buf_pos = 0;
+    overflow_buf_pos = 0;
+
+    /* Coarsest first, finer levels than needed are left in the buffer */
+    for (k = first; k >= MAX(i, skip_levels); --k)
+    {
+
+      level = result->levels[k];
+
+      p_UnpackRows(level->lh, 0, level->lh->height, src_buf, &src_buf_pos, overflow_buf, &overflow_buf_pos);
+      p_UnpackRows(level->hl, 0, level->hl->height, src_buf, &src_buf_pos, overflow_buf, &overflow_buf_pos);
+      p_UnpackRows(level->hh, 0, level->hh->height, src_buf, &src_buf_pos, overflow_buf, &overflow_buf_pos);
+
+    }
+
+    first = i-1;
+
+  }
+
+  ArenaFree(arena, buf1);
+  ArenaFree(arena, buf2);
+
+  ArenaFree(arena, overflow_buf);
+
+  ArenaFree(arena, windows);
+
+  if (status != BILDOk)
+  {
+    Levels2DDestroy(result);
+    return status;
+  }
+
+  *levels = result;
+
+  return BILDOk;
+
+}
+
+static void p_DecodeChannel(void *context, const int index)
+{
+
+  BILDChannels *channels = context;
+  channels->levels[index] = NULL;
+  channels->status[index] = p_FileToLevels(channels->file, channels->header_data[index], (channels->quality > 2),
+                                           channels->coder, channels->scale,
+                                           channels->windowed ? &channels->windows[index] : NULL, channels->arenas[index],
+                                           &channels->levels[index]);
+
+}
+
+static void p_ReconstructChannel(void *context, const int index)
+{
+
+  BILDChannels *channels = context;
+
+  if (channels->windowed)
+    channels->signals[index] = Reconstruct2DWindow(channels->levels[index], channels->quality, channels->scale,
+                                                   &channels->windows[index], channels->arenas[index]);
+  else
+    channels->signals[index] = Reconstruct2DScaled(channels->levels[index], channels->quality,
+                                                   channels->scale+(index < channels->fused_count), channels->arenas[index]);
+
+}
+
+/* Bytes of the planes of image */
+static size_t p_ImageSize(const Image *image)
+{
+
+  size_t size = 0;
+
+  int i;
+  for (i = 0; i < image->channel_count; ++i)
+    size += (size_t)image->channels[i]->width*image->channels[i]->height;
+
+  return size*sizeof(sample);
+
+}
+
+/* Bytes of the planes decoded into channels from a width x height image */
+static size_t p_PlaneSize(const BILDChannels *channels, const int width, const int height)
+{
+
+  size_t size = 0;
+
+  int i;
+  for (i = 0; i < 3; ++i)
+  {
+    if (channels->windowed)
+      size += (size_t)(channels->windows[i].x1-channels->windows[i].x0)*(channels->windows[i].y1-channels->windows[i].y0);
+    else if ((i > 0) && (channels->quality > 0))
+      size += (size_t)((width+1) >> 1)*((height+1) >> 1);
+    else
+      size += (size_t)width*height;
+  }
+
+  return size*sizeof(sample);
+
+}
+
+/* Checks the headers of the channel at data against the decomposition of a
+ * width x height plane and returns their size, -1 if they do not match. If
+ * size is too small to tell, 0 is returned and *missing set to the number
+ * of bytes to add. */
+static int64_t p_CheckLevelsHeaders(const byte *data, const int64_t size, const int width, const int height, int64_t *missing)
+{
+
+  if (size < sizeof(BILDLevelsHeader))
+  {
+    *missing = sizeof(BILDLevelsHeader)-size;
+    return 0;
+  }
+
+  BILDLevelsHeader levels_header;
+  memcpy(&levels_header, data, sizeof(BILDLevelsHeader));
+
+  if ((levels_header.width != width) || (levels_header.height != height) ||
+      (levels_header.level_count != ilog2(get_next_pow(MAX(width, height)))))
+    return -1;
+
+  const int64_t headers_size = sizeof(BILDLevelsHeader) + (int64_t)levels_header.level_count*sizeof(BILDLevelHeader);
+
+  if (size < headers_size)
+  {
+    *missing = headers_size-size;
+    return 0;
+  }
+
+  /* Same geometry as in Decompose2D */
+  BILDLevelHeader level_header;
+  int w1 = width;
+  int h1 = height;
+  int w0, h0;
+
+  int i;
+  for (i = 0; i < levels_header.level_count; ++i)
+  {
+
+    memcpy(&level_header, &data[sizeof(BILDLevelsHeader)+i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+
+    w0 = w1 >> 1;
+    h0 = h1 >> 1;
+    w1 = (w1+1) >> 1;
+    h1 = (h1+1) >> 1;
+
+    if ((level_header.ll_width != w1) || (level_header.ll_height != h1) ||
+        (level_header.lh_width != w0) || (level_header.lh_height != ((h0 < h1) ? h1 : h0)) ||
+        (level_header.hl_width != ((w0 < w1) ? w1 : w0)) || (level_header.hl_height != h0) ||
+        (level_header.hh_width != w0) || (level_header.hh_height != h0))
+      return -1;
+
+  }
+
+  return headers_size;
+
+}
+
+/* Checks that the blocks of a split level fill its segment at data and
+ * that their decoded symbols fit into the buffers of p_FileToLevels */
+static bool p_CheckBlocks(const byte *data, const BILDLevelHeader *level_header)
+{
+
+  const int block_count = p_BlockCount(level_header);
+  int64_t pos = (int64_t)block_count*sizeof(BILDBlockHeader);
+
+  if (pos > level_header->coded_size) return false;
+
+  BILDBlockHeader block_header;
+  uint32_t symbol_count;
+  int64_t count;
+
+  int b;
+  for (b = 0; b < block_count; ++b)
+  {
+
+    memcpy(&block_header, &data[b*sizeof(BILDBlockHeader)], sizeof(BILDBlockHeader));
+    count = p_BlockCoefficientCount(level_header, b);
+
+    if ((block_header.coded_size < sizeof(uint32_t)) || (block_header.overflow_size > count) ||
+        (pos+block_header.coded_size+(int64_t)block_header.overflow_size*sizeof(int32_t) > level_header->coded_size))
+      return false;
+
+    memcpy(&symbol_count, &data[pos], sizeof(uint32_t));
+    if (symbol_count > count*2+16) return false;
+
+    pos += block_header.coded_size+(int64_t)block_header.overflow_size*sizeof(int32_t);
+
+  }
+
+  return (pos == level_header->coded_size);
+
+}
+
+/* Checks the segments holding the levels from scale up, they have to lie
+ * behind the headers and their decoded symbols have to fit into the
+ * buffers of p_FileToLevels. Returns the end of the last one, -1 if they do
+ * not match. Segments past file_size are not looked into. */
+static int64_t p_CheckLevels(const byte *file, const int64_t file_size, const byte *data, const int64_t headers_end, const int scale)
+{
+
+  BILDLevelsHeader levels_header;
+  memcpy(&levels_header, data, sizeof(BILDLevelsHeader));
+
+  BILDLevelHeader level_header;
+  int64_t end = headers_end;
+  int64_t segment_end;
+  int64_t count = 0;
+  uint32_t symbol_count;
+
+  int first = levels_header.level_count-1;
+
+  int i;
+  for (i = levels_header.level_count-1; (i >= 0) && (first >= scale); --i)
+  {
+
+    memcpy(&level_header, &data[sizeof(BILDLevelsHeader)+i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+    count += p_LevelCoefficientCount(&level_header);
+
+    /* The finest level always ends a segment */
+    if ((level_header.coded_size == 0) && (level_header.overflow_size == 0) && (i > 0)) continue;
+
+    if ((level_header.offset < headers_end) || (level_header.coded_size < sizeof(uint32_t)) || (level_header.overflow_size > count))
+      return -1;
+
+    segment_end = (int64_t)level_header.offset+level_header.coded_size+(int64_t)level_header.overflow_size*sizeof(int32_t);
+    end = MAX(end, segment_end);
+
+    if (level_header.block_rows > 0)
+    {
+
+      /* Only a level with a segment of its own is split */
+      if ((first != i) || (level_header.overflow_size > 0)) return -1;
+
+      if ((segment_end <= file_size) && (!p_CheckBlocks(&file[level_header.offset], &level_header))) return -1;
+
+    }
+    else if (segment_end <= file_size)
+    {
+
+      memcpy(&symbol_count, &file[level_header.offset], sizeof(uint32_t));
+      if (symbol_count > count*2+16) return -1;
+
+    }
+
+    count = 0;
+    first = i-1;
+
+  }
+
+  return end;
+
+}
+
+/* Checks the tile index of a tiled image, prefix_size is set to the end of
+ * the last tile */
+static BILDStatus p_ReadTileIndex(const byte *data, const size_t size, const BILDInfo *info, const int scale, size_t *prefix_size)
+{
+
+  if ((1 << scale) > info->tile_size) return BILDErrorArgument;
+
+  const int64_t count = (int64_t)p_TileCount(info->width, info->tile_size)*p_TileCount(info->height, info->tile_size);
+  const int64_t index_end = sizeof(BILDHeader)+count*sizeof(BILDTileHeader);
+
+  if (index_end > size)
+  {
+    *prefix_size = index_end;
+    return BILDErrorTruncated;
+  }
+
+  BILDTileHeader tile_header;
+  uint64_t end = index_end;
+
+  int64_t i;
+  for (i = 0; i < count; ++i)
+  {
+
+    memcpy(&tile_header, &data[sizeof(BILDHeader)+i*sizeof(BILDTileHeader)], sizeof(BILDTileHeader));
+
+    /* Unsigned, so that a damaged offset cannot wrap the end around */
+    if ((tile_header.offset < (uint64_t)index_end) || (tile_header.size < sizeof(BILDHeader)) ||
+        (tile_header.offset > SIZE_MAX-tile_header.size))
+      return BILDErrorFormat;
+
+    end = MAX(end, tile_header.offset+tile_header.size);
+
+  }
+
+  *prefix_size = end;
+
+  return (end > size) ? BILDErrorTruncated : BILDOk;
+
+}
+
+/* Finds the channel headers and the size of the prefix of the file needed
+ * at scale. BILDErrorTruncated if size is shorter, prefix_size tells how
+ * much more to read for the next step. */
+static BILDStatus p_ReadHeaders(const byte *data, const size_t size, const int scale, const byte **headers, size_t *prefix_size)
+{
+
+  BILDInfo info;
+
+  if (size < sizeof(BILDHeader))
+  {
+    *prefix_size = sizeof(BILDHeader);
+    return BILDErrorTruncated;
+  }
+
+  BILDStatus status = BILDReadInfo(data, size, &info);
+
+  if (status != BILDOk) return status;
+
+  if (info.tile_size > 0) return p_ReadTileIndex(data, size, &info, scale, prefix_size);
+
+  int64_t offset = sizeof(BILDHeader);
+  int64_t missing;
+  int64_t headers_size;
+
+  int i;
+  for (i = 0; i < 3; ++i)
+  {
+
+    /* The chroma planes of lossy images are subsampled */
+    if ((i > 0) && (info.quality > 0))
+      headers_size = p_CheckLevelsHeaders(&data[offset], (int64_t)size-offset, (info.width+1) >> 1, (info.height+1) >> 1, &missing);
+    else
+      headers_size = p_CheckLevelsHeaders(&data[offset], (int64_t)size-offset, info.width, info.height, &missing);
+
+    if (headers_size < 0) return BILDErrorFormat;
+
+    if (headers_size == 0)
+    {
+      *prefix_size = size+missing;
+      return BILDErrorTruncated;
+    }
+
+    headers[i] = &data[offset];
+    offset += headers_size;
+
+  }
+
+  int64_t needed = offset;
+  int64_t end;
+  for (i = 0; i < 3; ++i)
+  {
+
+    end = p_CheckLevels(data, size, headers[i], offset, scale);
+
+    if (end < 0) return BILDErrorFormat;
+
+    needed = MAX(needed, end);
+
+  }
+
+  *prefix_size = needed;
+
+  return (needed > size) ? BILDErrorTruncated : BILDOk;
+
+}
+
+BILDStatus BILDScaledPrefixSize(const uint8_t *coded_data, const size_t coded_size, const int scale, size_t *prefix_size)
+{
+
+  if ((!coded_data) || (!prefix_size) || (scale < 0) || (scale > BILD_MAX_SCALE)) return BILDErrorArgument;
+
+  const byte *headers[3];
+
+  return p_ReadHeaders(coded_data, coded_size, scale, headers, prefix_size);
+
+}
+
+BILDStatus BILDReadInfo(const uint8_t *coded_data, const size_t coded_size, BILDInfo *info)
+{
+
+  if ((!coded_data) || (!info)) return BILDErrorArgument;
+
+  BILDHeader header;
+
+  if (coded_size < sizeof(BILDHeader)) return BILDErrorTruncated;
+
+  memcpy(&header, coded_data, sizeof(BILDHeader));
+
+  if (header.type != BILD_TYPE) return BILDErrorFormat;
+
+  info->version = header.version;
+  info->width = header.width;
+  info->height = header.height;
+  info->quality = header.quality;
+  info->coder = header.coder;
+  info->tile_size = header.tile_size;
+
+  if (header.version != VERSION) return BILDErrorVersion;
+
+  if (header.coder >= EntropyCoderCount) return BILDErrorCoder;
+
+  if ((header.tile_size != 0) && ((header.tile_size < BILD_MIN_TILE_SIZE) || (header.tile_size > BILD_MAX_TILE_SIZE) ||
+                                  (header.tile_size & (header.tile_size-1))))
+    return BILDErrorFormat;
+
+  if ((!p_CheckSize(header.width, header.height, header.tile_size)) || (header.quality > 7))
+    return BILDErrorFormat;
+
+  return BILDOk;
+
+}
+
+/* Makes sure the decoder has count decoders for the tiles, false if out
+ * of memory */
+static bool p_ReserveTileDecoders(BILDDecoder *decoder, const int count)
+{
+
+  if (count <= decoder->tile_decoder_count) return true;
+
+  BILDDecoder **tile_decoders = HeapRealloc(decoder->tile_decoders, count*sizeof(BILDDecoder*));
+
+  if (!tile_decoders) return false;
+
+  decoder->tile_decoders = tile_decoders;
+
+  for (; decoder->tile_decoder_count < count; ++decoder->tile_decoder_count)
+  {
+    tile_decoders[decoder->tile_decoder_count] = BILDDecoderCreate();
+    if (!tile_decoders[decoder->tile_decoder_count]) return false;
+  }
+
+  return true;
+
+}
+
+static BILDStatus p_DecodePixels(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const int scale,
+                                 const BILDRect *region, uint8_t *pixels, const int stride, const PixelFormat format);
+
+static void p_DecodeTiles(void *context, const int slot)
+{
+
+  BILDTiles *tiles = context;
+  BILDDecoder *decoder = tiles->decoders[slot];
+  const BILDRect *region = &tiles->region;
+  const int full_tile_size = tiles->tile_size << tiles->scale;
+
+  BILDTileHeader tile_header;
+  BILDInfo info;
+  BILDStatus status;
+  BILDRect part;
+  const byte *data;
+  Image *image;
+
+  int index, column, row, tile_width, tile_height, x0, y0, x1, y1, c, y;
+  while ((index = p_TakeTile(tiles)) >= 0)
+  {
+
+    column = tiles->first_column + index % tiles->region_columns;
+    row = tiles->first_row + index / tiles->region_columns;
+
+    memcpy(&tile_header, &tiles->file[sizeof(BILDHeader)+((size_t)row*tiles->columns+column)*sizeof(BILDTileHeader)],
+           sizeof(BILDTileHeader));
+
+    if ((tile_header.offset <= tiles->file_size) && (tile_header.size <= tiles->file_size-tile_header.offset))
+    {
+
+      data = &tiles->file[tile_header.offset];
+
+      /* The tiles behind a tile are its padding */
+      decoder->padding = tiles->file_end-(data+tile_header.size);
+
+      /* A tile is an untiled image of the size the grid gives it */
+      status = BILDReadInfo(data, tile_header.size, &info);
+
+    }
+    else
+      status = BILDErrorFormat;
+
+    if ((status == BILDOk) &&
+        ((info.width != MIN(full_tile_size, tiles->width-column*full_tile_size)) ||
+         (info.height != MIN(full_tile_size, tiles->height-row*full_tile_size)) ||
+         (info.quality != tiles->quality) || ((EntropyCoderID)info.coder != tiles->coder) || (info.tile_size != 0)))
+      status = BILDErrorFormat;
+
+    if (status == BILDOk)
+    {
+
+      /* Part of the tile inside the region, in the tile */
+      BILDScaledSize(&info, tiles->scale, &tile_width, &tile_height);
+      x0 = MAX(column*tiles->tile_size, region->x);
+      y0 = MAX(row*tiles->tile_size, region->y);
+      x1 = MIN(column*tiles->tile_size+tile_width, region->x+region->width);
+      y1 = MIN(row*tiles->tile_size+tile_height, region->y+region->height);
+
+      part.x = x0-column*tiles->tile_size;
+      part.y = y0-row*tiles->tile_size;
+      part.width = x1-x0;
+      part.height = y1-y0;
+
+      /* Pixels are written in place, planes copied into the region */
+      if (tiles->pixels)
+        status = p_DecodePixels(decoder, data, tile_header.size, tiles->scale, &part,
+                                &tiles->pixels[(int64_t)(y0-region->y)*tiles->stride+(x0-region->x)*PIXEL_SIZE(tiles->format)],
+                                tiles->stride, tiles->format);
+      else
+        status = BILDDecoderDecodeImage(decoder, data, tile_header.size, tiles->scale, &part, &image);
+
+    }
+
+    if (status != BILDOk)
+    {
+      pthread_mutex_lock(&tiles->mutex);
+      tiles->status = (status == BILDErrorTruncated) ? BILDErrorFormat : status;
+      pthread_mutex_unlock(&tiles->mutex);
+      continue;
+    }
+
+    if (!tiles->pixels)
+    {
+      for (c = 0; c < 3; ++c)
+        for (y = 0; y < part.height; ++y)
+          memcpy(&tiles->image->channels[c]->data[(y0-region->y+y)*region->width+x0-region->x],
+                 &image->channels[c]->data[y*part.width], part.width*sizeof(sample));
+    }
+
+    p_AddTileStages(tiles, BILDDecoderStages(decoder));
+
+  }
+
+}
+
+/* Decodes the tiles of a tiled image that region touches into pixels, or
+ * into the planes of an RGB image if pixels is NULL */
+static BILDStatus p_DecodeTiledImage(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const BILDInfo *info,
+                                     const int scale, const BILDRect *region, Image **image, uint8_t *pixels,
+                                     const int stride, const PixelFormat format)
+{
+
+  size_t prefix_size;
+  BILDStatus status = p_ReadTileIndex(coded_data, coded_size, info, scale, &prefix_size);
+
+  if (status != BILDOk) return status;
+
+  BILDTiles tiles;
+  tiles.tile_size = info->tile_size >> scale;
+  tiles.columns = p_TileCount(info->width, info->tile_size);
+  tiles.first_column = region->x/tiles.tile_size;
+  tiles.first_row = region->y/tiles.tile_size;
+  tiles.region_columns = (region->x+region->width-1)/tiles.tile_size-tiles.first_column+1;
+  tiles.count = tiles.region_columns*((region->y+region->height-1)/tiles.tile_size-tiles.first_row+1);
+  tiles.next = 0;
+  tiles.quality = info->quality;
+  tiles.coder = info->coder;
+  tiles.scale = scale;
+  tiles.width = info->width;
+  tiles.height = info->height;
+  tiles.region = *region;
+  tiles.file = coded_data;
+  tiles.file_size = coded_size;
+  tiles.file_end = coded_data+coded_size+decoder->padding;
+  tiles.pixels = pixels;
+  tiles.stride = stride;
+  tiles.format = format;
+  tiles.status = BILDOk;
+  memset(&tiles.stages, 0, sizeof(BILDStages));
+
+  const int slot_count = MIN(ThreadPoolThreadCount(), tiles.count);
+
+  if (!p_ReserveTileDecoders(decoder, slot_count)) return BILDErrorMemory;
+
+  tiles.decoders = decoder->tile_decoders;
+
+  Image *result = NULL;
+
+  int i;
+  for (i = 0; i < 3; ++i)
+    if (decoder->arenas[i]) ArenaReset(decoder->arenas[i]);
+
+  if (!pixels)
+  {
+
+    result = decoder->image;
+    if (!result) result = ImageCreate(0, 0, RGB);
+
+    if (!result) return BILDErrorMemory;
+
+    result->colour_space = RGB;
+    result->width = region->width;
+    result->height = region->height;
+
+    for (i = 0; i < 3; ++i)
+      result->channels[i] = Signal2DCreateInArena(decoder->arenas[i], region->width, region->height);
+
+    if ((!result->channels[0]) || (!result->channels[1]) || (!result->channels[2]))
+      tiles.status = BILDErrorMemory;
+
+  }
+
+  tiles.image = result;
+
+  if (tiles.status == BILDOk)
+  {
+    pthread_mutex_init(&tiles.mutex, NULL);
+    ThreadPoolParallelFor(slot_count, p_DecodeTiles, &tiles);
+    pthread_mutex_destroy(&tiles.mutex);
+  }
+
+  decoder->stages = tiles.stages;
+
+  if (tiles.status != BILDOk)
+  {
+
+    for (i = 0; (i < 3) && result; ++i)
+    {
+      Signal2DDestroy(result->channels[i]);
+      result->channels[i] = NULL;
+    }
+
+    if (!decoder->image) ImageDestroy(result);
+
+    return tiles.status;
+
+  }
+
+  if (image) *image = result;
+
+  return BILDOk;
+
+}
+
+/* Cuts region out of the planes of image, false if out of memory */
+static bool p_CropImage(Image *image, const BILDRect *region)
+{
+
+  Signal2D *plane;
+
+  int c, y;
+  for (c = 0; c < 3; ++c)
+  {
+
+    plane = Signal2DCreateInArena(image->channels[c]->arena, region->width, region->height);
+
+    if (!plane) return false;
+
+    for (y = 0; y < region->height; ++y)
+      memcpy(&plane->data[y*region->width], &image->channels[c]->data[(region->y+y)*image->width+region->x],
+             region->width*sizeof(sample));
+
+    Signal2DDestroy(image->channels[c]);
+    image->channels[c] = plane;
+
+  }
+
+  image->width = region->width;
+  image->height = region->height;
+
+  return true;
+
+}
+
+/* Reads the info of the coded image and checks scale and region against
+ * it, a NULL region becomes the whole image */
+static BILDStatus p_ReadRegion(const byte *coded_data, const size_t coded_size, const int scale, const BILDRect *region,
+                               BILDInfo *info, BILDRect *checked)
+{
+
+  if ((scale < 0) || (scale > BILD_MAX_SCALE)) return BILDErrorArgument;
+
+  BILDStatus status = BILDReadInfo(coded_data, coded_size, info);
+
+  if (status != BILDOk) return status;
+
+  BILDRect whole;
+  whole.x = 0;
+  whole.y = 0;
+  BILDScaledSize(info, scale, &whole.width, &whole.height);
+
+  if (!region)
+  {
+    region = &whole;
+  }
+  else if ((region->x < 0) || (region->y < 0) || (region->width < 1) || (region->height < 1) ||
+           ((int64_t)region->x+region->width > whole.width) || ((int64_t)region->y+region->height > whole.height))
+  {
+    return BILDErrorArgument;
+  }
+
+  *checked = *region;
+
+  return BILDOk;
+
+}
+
+/* Decodes the levels of the channels of an untiled image under region */
+static BILDStatus p_DecodeChannels(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const BILDInfo *info,
+                                   const int scale, const BILDRect *region, BILDChannels *channels)
+{
+
+  const byte *headers[3];
+  size_t prefix_size;
+  BILDStatus status = p_ReadHeaders(coded_data, coded_size, scale, headers, &prefix_size);
+
+  if (status != BILDOk) return status;
+
+  /* Only the prefix is used. The Huffman decoder reads a few bytes past the
+   * coded data, the prefix is decoded in place if they are readable and
+   * from a padded copy otherwise. */
+  const byte *data = coded_data;
+
+  if (coded_size-prefix_size+decoder->padding < BILD_PADDING)
+  {
+
+    decoder->file->size = 0;
+    byte *copy = BufferReserve(decoder->file, prefix_size+BILD_PADDING);
+
+    if (!copy) return BILDErrorMemory;
+
+    memcpy(copy, coded_data, prefix_size);
+    memset(&copy[prefix_size], 0, BILD_PADDING);
+
+    data = copy;
+
+  }
+
+  int width, height;
+  BILDScaledSize(info, scale, &width, &height);
+
+  channels->quality = info->quality;
+  channels->coder = info->coder;
+  channels->scale = scale;
+  channels->fused_count = 0;
+  channels->file = data;
+
+  /* A region is decoded from the windows of the planes under it. The luma
+   * window covers whole pixel pairs, so that the chroma of lossy images is
+   * the window at half the size. */
+  Window2D window;
+  channels->windowed = (region->width != width) || (region->height != height);
+
+  if (channels->windowed)
+  {
+
+    window.x0 = region->x & ~1;
+    window.y0 = region->y & ~1;
+    window.x1 = region->x+region->width;
+    window.y1 = region->y+region->height;
+    window.x1 = MIN(window.x1+(window.x1 & 1), width);
+    window.y1 = MIN(window.y1+(window.y1 & 1), height);
+
+    channels->windows[0] = window;
+
+    if (info->quality > 0)
+    {
+      window.x0 >>= 1;
+      window.y0 >>= 1;
+      window.x1 = (window.x1+1) >> 1;
+      window.y1 = (window.y1+1) >> 1;
+    }
+
+    channels->windows[1] = window;
+    channels->windows[2] = window;
+
+  }
+
+  channels->plane_size = p_PlaneSize(channels, width, height);
+
+  int i;
+  for (i = 0; i < 3; ++i)
+    channels->header_data[i] = &data[headers[i]-coded_data];
+
+  for (i = 0; i < 3; ++i)
+  {
+    channels->arenas[i] = decoder->arenas[i];
+    if (channels->arenas[i]) ArenaReset(channels->arenas[i]);
+  }
+
+  memset(&decoder->stages, 0, sizeof(BILDStages));
+
+  StageClock start;
+  StageStart(&start);
+
+  ThreadPoolParallelFor(3, p_DecodeChannel, channels);
+
+  StageStop(&start, prefix_size, channels->plane_size, &decoder->stages.coding);
+
+  for (i = 0; i < 3; ++i)
+    if ((status == BILDOk) && (channels->status[i] != BILDOk)) status = channels->status[i];
+
+  if (status != BILDOk)
+  {
+    for (i = 0; i < 3; ++i)
+      Levels2DDestroy(channels->levels[i]);
+    return status;
+  }
+
+  return BILDOk;
+
+}
+
+/* Reconstructs the planes of the decoded channels without the colour
+ * transform. The planes may cover a pixel more on each side of region, part
+ * is region within them. */
+static BILDStatus p_ReconstructPlanes(BILDDecoder *decoder, const BILDInfo *info, BILDChannels *channels, const BILDRect *region,
+                                      Image **image, BILDRect *part)
+{
+
+  Image *result = decoder->image;
+  if (!result) result = ImageCreate(0, 0, RGB);
+
+  int i;
+
+  if (!result)
+  {
+    for (i = 0; i < 3; ++i)
+      Levels2DDestroy(channels->levels[i]);
+    return BILDErrorMemory;
+  }
+
+  result->colour_space = (info->quality > 0) ? YCbCr411 : RGBDifference;
+
+  part->x = 0;
+  part->y = 0;
+  part->width = region->width;
+  part->height = region->height;
+
+  if (channels->windowed)
+  {
+    result->width = channels->windows[0].x1-channels->windows[0].x0;
+    result->height = channels->windows[0].y1-channels->windows[0].y0;
+    part->x = region->x-channels->windows[0].x0;
+    part->y = region->y-channels->windows[0].y0;
+  }
+  else
+  {
+    BILDScaledSize(info, channels->scale, &result->width, &result->height);
+  }
+
+  StageClock start;
+  StageStart(&start);
+
+  ThreadPoolParallelFor(3, p_ReconstructChannel, channels);
+
+  StageStop(&start, channels->plane_size, channels->plane_size, &decoder->stages.transform);
+
+  BILDStatus status = BILDOk;
+
+  for (i = 0; i < 3; ++i)
+  {
+    result->channels[i] = channels->signals[i];
+    Levels2DDestroy(channels->levels[i]);
+    if (!channels->signals[i]) status = BILDErrorMemory;
+  }
+
+  if (status != BILDOk)
+  {
+
+    for (i = 0; i < 3; ++i)
+    {
+      Signal2DDestroy(result->channels[i]);
+      result->channels[i] = NULL;
+    }
+
+    if (!decoder->image) ImageDestroy(result);
+
+    return status;
+
+  }
+
+  *image = result;
+
+  return BILDOk;
+
+}
+
+/* The last level of the fused channels, reconstructed a row pair at a time
+ * into rows that go straight to the pixels */
+struct tBILDRows
+{
+  BILDChannels *channels;
+  ColourSpace colour_space;
+  int width;                /* Of the last level and the pixels */
+  int height;
+  int row_pairs;
+  int band_count;
+  int quant_param;
+  sample *scratch;          /* Two rows per fused channel and band */
+  uint8_t *pixels;
+  int stride;
+  PixelFormat format;
+};
+typedef struct tBILDRows BILDRows;
+
+/* Writes rows row to row+row_count-1, the rows of fused channel n are
+ * c[2n] and c[2n+1] */
+static void p_WritePixelRows(const BILDRows *rows, const int row, const int row_count, sample *const *c)
+{
+
+  const BILDChannels *channels = rows->channels;
+  const int chroma_width = (rows->width+1) >> 1;
+
+  const sample *c1, *c2;
+
+  int k;
+  for (k = 0; k < row_count; ++k)
+  {
+
+    /* The chroma of lossy images was reconstructed whole */
+    if (channels->fused_count == 1)
+    {
+      c1 = &channels->signals[1]->data[((row+k) >> 1)*chroma_width];
+      c2 = &channels->signals[2]->data[((row+k) >> 1)*chroma_width];
+    }
+    else
+    {
+      c1 = c[2+k];
+      c2 = c[4+k];
+    }
+
+    ImageRowToPixels(rows->colour_space, c[k], c1, c2, 0, rows->width, &rows->pixels[(int64_t)(row+k)*rows->stride],
+                     rows->format);
+
+  }
+
+}
+
+static void p_ReconstructRows(void *context, const int band)
+{
+
+  BILDRows *rows = context;
+  BILDChannels *channels = rows->channels;
+
+  const int width = rows->width;
+  const int w0 = width >> 1;
+  const int w1 = (width+1) >> 1;
+  const int hl_width = (width % 2) ? w1 : w0;
+  const int level_n = channels->scale;
+
+  const int first = (int)(((int64_t)band*rows->row_pairs)/rows->band_count);
+  const int last = (int)(((int64_t)(band+1)*rows->row_pairs)/rows->band_count);
+
+  sample *c[6];
+  const Level2D *level;
+
+  int i, n;
+  for (n = 0; n < 6; ++n)
+    c[n] = &rows->scratch[((int64_t)band*6+n)*width];
+
+  for (i = first; i < last; ++i)
+  {
+
+    for (n = 0; n < channels->fused_count; ++n)
+    {
+      level = channels->levels[n]->levels[level_n];
+      ReconstructRowPair(c[n<<1], c[(n<<1)+1], width, channels->signals[n]->data+i*w1, level->lh->data+i*w0,
+                         level->hl->data+i*hl_width, level->hh->data+i*w0, rows->quant_param);
+    }
+
+    p_WritePixelRows(rows, i << 1, 2, c);
+
+  }
+
+}
+
+/* Reconstructs the last level of the channels with the colour transform and
+ * writes the pixels as the rows come out, so the planes of the image are
+ * never held. The chroma of lossy images is reconstructed as usual. */
+static BILDStatus p_ReconstructPixels(BILDDecoder *decoder, const BILDInfo *info, BILDChannels *channels, uint8_t *pixels,
+                                      const int stride, const PixelFormat format)
+{
+
+  BILDRows rows;
+  rows.channels = channels;
+  rows.colour_space = (info->quality > 0) ? YCbCr411 : RGBDifference;
+  BILDScaledSize(info, channels->scale, &rows.width, &rows.height);
+  rows.row_pairs = rows.height >> 1;
+  rows.band_count = MAX(MIN(ThreadPoolThreadCount(), rows.row_pairs), 1);
+  rows.quant_param = Levels2DQuantParam(channels->levels[0], channels->quality, channels->scale);
+  rows.pixels = pixels;
+  rows.stride = stride;
+  rows.format = format;
+
+  channels->fused_count = (info->quality > 0) ? 1 : 3;
+
+  int n;
+
+  StageClock start;
+  StageStart(&start);
+
+  ThreadPoolParallelFor(3, p_ReconstructChannel, channels);
+
+  rows.scratch = ArenaAlloc(channels->arenas[0], (size_t)rows.band_count*6*rows.width*sizeof(sample));
+
+  if ((!rows.scratch) || (!channels->signals[0]) || (!channels->signals[1]) || (!channels->signals[2]))
+  {
+
+    ArenaFree(channels->arenas[0], rows.scratch);
+
+    for (n = 0; n < 3; ++n)
+    {
+      Signal2DDestroy(channels->signals[n]);
+      Levels2DDestroy(channels->levels[n]);
+    }
+
+    return BILDErrorMemory;
+
+  }
+
+  ThreadPoolParallelFor(rows.band_count, p_ReconstructRows, &rows);
+
+  if (rows.height % 2)
+  {
+
+    const int w0 = rows.width >> 1;
+    const int w1 = (rows.width+1) >> 1;
+
+    sample *c[6];
+    const Level2D *level;
+
+    for (n = 0; n < channels->fused_count; ++n)
+    {
+      c[n<<1] = &rows.scratch[(n<<1)*rows.width];
+      level = channels->levels[n]->levels[channels->scale];
+      ReconstructLastRow(c[n<<1], rows.width, channels->signals[n]->data+rows.row_pairs*w1,
+                         level->lh->data+rows.row_pairs*w0);
+    }
+
+    p_WritePixelRows(&rows, rows.height-1, 1, c);
+
+  }
+
+  StageStop(&start, channels->plane_size, (size_t)rows.width*rows.height*PIXEL_SIZE(format), &decoder->stages.transform);
+
+  ArenaFree(channels->arenas[0], rows.scratch);
+
+  for (n = 0; n < 3; ++n)
+  {
+    Signal2DDestroy(channels->signals[n]);
+    Levels2DDestroy(channels->levels[n]);
+  }
+
+  return BILDOk;
+
+}
+
+/* Decodes region of the image straight into pixels */
+static BILDStatus p_DecodePixels(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const int scale,
+                                 const BILDRect *region, uint8_t *pixels, const int stride, const PixelFormat format)
+{
+
+  BILDInfo info;
+  BILDRect checked;
+  BILDStatus status = p_ReadRegion(coded_data, coded_size, scale, region, &info, &checked);
+
+  if (status != BILDOk) return status;
+
+  if (info.tile_size > 0)
+    return p_DecodeTiledImage(decoder, coded_data, coded_size, &info, scale, &checked, NULL, pixels, stride, format);
+
+  BILDChannels channels;
+  status = p_DecodeChannels(decoder, coded_data, coded_size, &info, scale, &checked, &channels);
+
+  if (status != BILDOk) return status;
+
+  /* Whole images are written by their last level, regions and images
+   * without levels at scale from planes */
+  if ((!channels.windowed) && (channels.levels[0]->level_count > scale))
+    return p_ReconstructPixels(decoder, &info, &channels, pixels, stride, format);
+
+  Image *image;
+  BILDRect part;
+  status = p_ReconstructPlanes(decoder, &info, &channels, &checked, &image, &part);
+
+  if (status != BILDOk) return status;
+
+  StageClock start;
+  StageStart(&start);
+
+  ImageWritePixels(image, part.x, part.y, part.width, part.height, pixels, stride, format);
+
+  StageStop(&start, p_ImageSize(image), (size_t)part.width*part.height*PIXEL_SIZE(format), &decoder->stages.colour);
+
+  if (!decoder->image) ImageDestroy(image);
+
+  return BILDOk;
+
+}
+
+/* Decodes region of the image into the planes of image without the colour
+ * transform, see p_ReconstructPlanes */
+static BILDStatus p_DecodePlanes(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const int scale,
+                                 const BILDRect *region, Image **image, BILDRect *part)
+{
+
+  BILDInfo info;
+  BILDRect checked;
+  BILDStatus status = p_ReadRegion(coded_data, coded_size, scale, region, &info, &checked);
+
+  if (status != BILDOk) return status;
+
+  if (info.tile_size > 0)
+  {
+
+    /* The planes of a region are held whole */
+    if ((int64_t)checked.width*checked.height > BILD_MAX_PIXELS) return BILDErrorArgument;
+
+    part->x = 0;
+    part->y = 0;
+    part->width = checked.width;
+    part->height = checked.height;
+    return p_DecodeTiledImage(decoder, coded_data, coded_size, &info, scale, &checked, image, NULL, 0, PixelRGB8);
+
+  }
+
+  BILDChannels channels;
+  status = p_DecodeChannels(decoder, coded_data, coded_size, &info, scale, &checked, &channels);
+
+  if (status != BILDOk) return status;
+
+  return p_ReconstructPlanes(decoder, &info, &channels, &checked, image, part);
+
+}
+
+BILDStatus BILDDecoderDecodeImage(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const int scale,
+                                  const BILDRect *region, Image **image)
+{
+
+  Image *result;
+  BILDRect part;
+  BILDStatus status = p_DecodePlanes(decoder, coded_data, coded_size, scale, region, &result, &part);
+
+  if (status != BILDOk) return status;
+
+  const size_t plane_size = p_ImageSize(result);
+
+  StageClock start;
+  StageStart(&start);
+
+  bool done = ImageTransformColourSpace(result, RGB);
+
+  StageStop(&start, plane_size, p_ImageSize(result), &decoder->stages.colour);
+
+  if (done && ((result->width != part.width) || (result->height != part.height))) done = p_CropImage(result, &part);
+
+  if (!done)
+  {
+
+    int i;
+    for (i = 0; i < 3; ++i)
+    {
+      Signal2DDestroy(result->channels[i]);
+      result->channels[i] = NULL;
+    }
+
+    if (!decoder->image) ImageDestroy(result);
+
+    return BILDErrorMemory;
+
+  }
+
+  *image = result;
+
+  return BILDOk;
+
+}
+
+void BILDScaledSize(const BILDInfo *info, const int scale, int *width, int *height)
+{
+
+  *width = (int)(((int64_t)info->width+(1 << scale)-1) >> scale);
+  *height = (int)(((int64_t)info->height+(1 << scale)-1) >> scale);
+
+}
+
+BILDStatus BILDDecode(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size,
+                      uint8_t *pixels, const int stride, const BILDPixelFormat format)
+{
+
+  return BILDDecodeScaled(decoder, coded_data, coded_size, 0, pixels, stride, format);
+
+}
+
+BILDStatus BILDDecodeScaled(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size, const int scale,
+                            uint8_t *pixels, const int stride, const BILDPixelFormat format)
+{
+
+  return BILDDecodeRegion(decoder, coded_data, coded_size, scale, NULL, pixels, stride, format);
+
+}
+
+BILDStatus BILDDecodeRegion(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size, const int scale,
+                            const BILDRect *region, uint8_t *pixels, const int stride, const BILDPixelFormat format)
+{
+
+  if ((!decoder) || (!pixels) || (format < BILDPixelRGB8) || (format > BILDPixelBGR8)) return BILDErrorArgument;
+
+  BILDInfo info;
+  BILDStatus status = BILDReadInfo(coded_data, coded_size, &info);
+
+  if (status != BILDOk) return status;
+
+  if ((scale < 0) || (scale > BILD_MAX_SCALE)) return BILDErrorArgument;
+
+  int width, height;
+  BILDScaledSize(&info, scale, &width, &height);
+
+  if (region) width = region->width;
+
+  if (ABS((int64_t)stride) < (int64_t)width*PIXEL_SIZE((PixelFormat)format)) return BILDErrorArgument;
+
+  return p_DecodePixels(decoder, coded_data, coded_size, scale, region, pixels, stride, (PixelFormat)format);
+
+}
+
+BILDDecoder* BILDDecoderCreate(void)
+{
+
+  CPUInit();
+
+  BILDDecoder *decoder = HeapAlloc(sizeof(BILDDecoder));
+
+  if (!decoder) return NULL;
+
+  int i;
+  for (i = 0; i < 3; ++i) decoder->arenas[i] = ArenaCreate(0);
+
+  decoder->file = BufferCreate(0);
+  decoder->padding = 0;
+  decoder->image = ImageCreate(0, 0, RGB);
+  memset(&decoder->stages, 0, sizeof(BILDStages));
+  decoder->tile_decoders = NULL;
+  decoder->tile_decoder_count = 0;
+
+  if ((!decoder->arenas[0]) || (!decoder->arenas[1]) || (!decoder->arenas[2]) || (!decoder->file) || (!decoder->image))
+  {
+    BILDDecoderDestroy(decoder);
+    return NULL;
+  }
+
+  return decoder;
+
+}
+
+BILDDecoder* BILDDecoderCreateOnHeap(void)
+{
+
+  CPUInit();
+
+  BILDDecoder *decoder = HeapAlloc(sizeof(BILDDecoder));
+
+  if (!decoder) return NULL;
+
+  int i;
+  for (i = 0; i < 3; ++i) decoder->arenas[i] = NULL;
+
+  decoder->file = BufferCreate(0);
+  decoder->padding = 0;
+  decoder->image = NULL;
+  memset(&decoder->stages, 0, sizeof(BILDStages));
+  decoder->tile_decoders = NULL;
+  decoder->tile_decoder_count = 0;
+
+  if (!decoder->file)
+  {
+    BILDDecoderDestroy(decoder);
+    return NULL;
+  }
+
+  return decoder;
+
+}
+
+void BILDDecoderSetPadding(BILDDecoder *decoder, const size_t padding)
+{
+
+  decoder->padding = padding;
+
+}
+
+void BILDDecoderDestroy(BILDDecoder *decoder)
+{
+
+  if (!decoder) return;
+
+  /* The channels of the image belong to the arenas */
+  if (decoder->image)
+  {
+    free(decoder->image->channels);
+    free(decoder->image);
+  }
+
+  BufferDestroy(decoder->file);
+
+  int i;
+  for (i = 0; i < 3; ++i)
+    if (decoder->arenas[i]) ArenaDestroy(decoder->arenas[i]);
+
+  for (i = 0; i < decoder->tile_decoder_count; ++i)
+    BILDDecoderDestroy(decoder->tile_decoders[i]);
+  free(decoder->tile_decoders);
+
+  free(decoder);
+
+}
+
+const BILDStages* BILDDecoderStages(const BILDDecoder *decoder)
+{
+
+  return &decoder->stages;
+
+}
+
+/* Adds the coefficients of subband s to stats, symbols and overflow are
+ * scratch space for them. False if out of memory. */
+static bool p_AddSubbandStats(const Signal2D *s, BILDSubbandStats *stats, Buffer *symbols, Buffer *overflow, Buffer *rle_coded)
+{
+
+  const int count = s->width*s->height;
+
+  symbols->size = 0;
+  overflow->size = 0;
+  int8_t *packed = (int8_t*)BufferReserve(symbols, count);
+  int32_t *overflow_buf = (int32_t*)BufferReserve(overflow, count*sizeof(int32_t));
+  int overflow_pos = 0;
+
+  if ((!packed) || (!overflow_buf)) return false;
+
+  pack8_array(s->data, count, packed, overflow_buf, &overflow_pos);
+
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+    ++stats->histogram[(byte)packed[i]];
+    stats->zero_count += (packed[i] == 0);
+  }
+
+  stats->count += count;
+  stats->escape_count += overflow_pos;
+
+  RLEStream rle;
+  rle_coded->size = 0;
+  rleStreamInit(&rle, rle_coded, stats->rle_histogram);
+
+  if ((!rleStreamEncode8(&rle, (byte*)packed, count)) || (!rleStreamFinish(&rle))) return false;
+
+  stats->rle_size += rle_coded->size;
+
+  return true;
+
+}
+
+/* Adds the subbands of an untiled image, or of a tile */
+static BILDStatus p_AddImageSubbandStats(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size,
+                                         BILDSubbandStats stats[3][BILD_MAX_LEVELS][BILDBandCount], int *level_count)
+{
+
+  BILDInfo info;
+  BILDRect region;
+  BILDStatus status = p_ReadRegion(coded_data, coded_size, 0, NULL, &info, &region);
+
+  if (status != BILDOk) return status;
+
+  if (info.tile_size > 0)
+  {
+
+    size_t prefix_size;
+    status = p_ReadTileIndex(coded_data, coded_size, &info, 0, &prefix_size);
+
+    const int count = p_TileCount(info.width, info.tile_size)*p_TileCount(info.height, info.tile_size);
+    const byte *end = coded_data+coded_size+decoder->padding;
+    BILDTileHeader tile_header;
+
+    int i;
+    for (i = 0; (i < count) && (status == BILDOk); ++i)
+    {
+
+      memcpy(&tile_header, &coded_data[sizeof(BILDHeader)+i*sizeof(BILDTileHeader)], sizeof(BILDTileHeader));
+
+      if ((tile_header.offset > coded_size) || (tile_header.size > coded_size-tile_header.offset))
+      {
+        status = BILDErrorFormat;
+        break;
+      }
+
+      decoder->padding = end-(coded_data+tile_header.offset+tile_header.size);
+      status = p_AddImageSubbandStats(decoder, &coded_data[tile_header.offset], tile_header.size, stats, level_count);
+
+    }
+
+    decoder->padding = end-(coded_data+coded_size);
+
+    return status;
+
+  }
+
+  BILDChannels channels;
+  status = p_DecodeChannels(decoder, coded_data, coded_size, &info, 0, &region, &channels);
+
+  if (status != BILDOk) return status;
+
+  Buffer *symbols = BufferCreate(0);
+  Buffer *overflow = BufferCreate(0);
+  Buffer *rle_coded = BufferCreate(0);
+
+  if ((!symbols) || (!overflow) || (!rle_coded)) status = BILDErrorMemory;
+
+  Level2D *level;
+
+  int c, i;
+  for (c = 0; c < 3; ++c)
+  {
+
+    for (i = 0; (i < channels.levels[c]->level_count) && (status == BILDOk); ++i)
+    {
+      level = channels.levels[c]->levels[i];
+      if ((!p_AddSubbandStats(level->lh, &stats[c][i][BILDBandLH], symbols, overflow, rle_coded)) ||
+          (!p_AddSubbandStats(level->hl, &stats[c][i][BILDBandHL], symbols, overflow, rle_coded)) ||
+          (!p_AddSubbandStats(level->hh, &stats[c][i][BILDBandHH], symbols, overflow, rle_coded)))
+        status = BILDErrorMemory;
+    }
+
+    *level_count = MAX(*level_count, channels.levels[c]->level_count);
+
+    Levels2DDestroy(channels.levels[c]);
+
+  }
+
+  BufferDestroy(symbols);
+  BufferDestroy(overflow);
+  BufferDestroy(rle_coded);
+
+  return status;
+
+}
+
+BILDStatus BILDDecoderSubbandStats(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size,
+                                   BILDSubbandStats stats[3][BILD_MAX_LEVELS][BILDBandCount], int *level_count)
+{
+
+  memset(stats, 0, 3*BILD_MAX_LEVELS*BILDBandCount*sizeof(BILDSubbandStats));
+  *level_count = 0;
+
+  return p_AddImageSubbandStats(decoder, coded_data, coded_size, stats, level_count);
+
+}
+
+/* Coefficients are packed in chunks that stay in the cache */
+#define PACK_CHUNK_SIZE 4096
+
+/* Packs rows row to row+row_count-1 of a subband (as far as it has them)
+ * into symbols, run length coded if rle is set, and accumulates the
+ * histogram of the symbols. False if out of memory. */
+bool p_PackRows(const Signal2D *s, const int row, const int row_count, RLEStream *rle, Buffer *symbols, Buffer *overflow,
+                uint32_t *histogram)
+{
+
+  int8_t chunk[PACK_CHUNK_SIZE];
+  uint32_t chunk_histogram[BYTE_MAX+1];
+
+  const sample *data = &s->data[row*s->width];
+  const int count = p_RowCount(s->height, row, row_count)*s->width;
+  int8_t *packed;
+  int overflow_pos;
+
+  int i, j, n;
+  for (i = 0; i < count; i += PACK_CHUNK_SIZE)
+  {
+
+    n = MIN(PACK_CHUNK_SIZE, count-i);
+
+    if (!BufferReserve(overflow, n*sizeof(int32_t))) return false;
+
+    overflow_pos = overflow->size/sizeof(int32_t);
+
+    if (rle)
+    {
+
+      pack8_array(&data[i], n, chunk, (int32_t*)overflow->data, &overflow_pos);
+      if (!rleStreamEncode8(rle, (byte*)chunk, n)) return false;
+
+    }
+    else
+    {
+
+      packed = (int8_t*)BufferReserve(symbols, n);
+
+      if (!packed) return false;
+
+      pack8_array(&data[i], n, packed, (int32_t*)overflow->data, &overflow_pos);
+      symbols->size += n;
+
+      kernels.histogram((byte*)packed, n, chunk_histogram);
+      for (j = 0; j < BYTE_MAX+1; ++j) histogram[j] += chunk_histogram[j];
+
+    }
+
+    overflow->size = overflow_pos*sizeof(int32_t);
+
+  }
+
+  return true;
+
+}
+
+/* One pass packs the coefficients of a segment or block, run length codes
+ * them and counts the symbols, the entropy coder only emits */
+static void p_BeginSegment(RLEStream *rle, Buffer *symbols, Buffer *overflow, uint32_t *histogram)
+{
+
+  symbols->size = 0;
+  overflow->size = 0;
+  memset(histogram, 0, (BYTE_MAX+1)*sizeof(uint32_t));
+  if (rle) rleStreamInit(rle, symbols, histogram);
+
+}
+
+/* Codes the packed symbols straight into buffer, followed by the overflow
+ * values. False if out of memory. */
+static bool p_EndSegment(Buffer *buffer, RLEStream *rle, const EntropyCoderID coder, Buffer *symbols, Buffer *overflow,
+                         uint32_t *histogram, uint32_t *coded_size, uint32_t *overflow_size)
+{
+
+  int size;
+
+  if (rle && (!rleStreamFinish(rle))) return false;
+
+  byte *coded = BufferReserve(buffer, entropy_coders[coder].encode_bound(symbols->size));
+
+  if (!coded) return false;
+
+  EntropyEncode(coder, symbols->data, symbols->size, histogram, coded, &size);
+  buffer->size += size;
+
+  if (!BufferWrite(buffer, overflow->data, overflow->size)) return false;
+
+  *coded_size = size;
+  *overflow_size = overflow->size/sizeof(int32_t);
+
+  return true;
+
+}
+
+/* Codes rows row to row+row_count-1 of the subbands lh, hl and hh, as far as
+ * they have them, into buffer as a block. False if out of memory. */
+static bool p_BlockToBuffer(const Signal2D *lh, const Signal2D *hl, const Signal2D *hh, const int row, const int row_count,
+                            Buffer *buffer, RLEStream *rle, const EntropyCoderID coder, Buffer *symbols, Buffer *overflow,
+                            uint32_t *histogram, BILDBlockHeader *block_header)
+{
+
+  p_BeginSegment(rle, symbols, overflow, histogram);
+
+  return p_PackRows(lh, row, row_count, rle, symbols, overflow, histogram) &&
+         p_PackRows(hl, row, row_count, rle, symbols, overflow, histogram) &&
+         p_PackRows(hh, row, row_count, rle, symbols, overflow, histogram) &&
+         p_EndSegment(buffer, rle, coder, symbols, overflow, histogram, &block_header->coded_size,
+                      &block_header->overflow_size);
+
+}
+
+/* Codes level as blocks of block_rows rows into buffer, behind a table of
+ * their headers. False if out of memory. */
+static bool p_BlocksToBuffer(const Level2D *level, const int block_rows, Buffer *buffer, RLEStream *rle,
+                             const EntropyCoderID coder, Buffer *symbols, Buffer *overflow, uint32_t *histogram)
+{
+
+  const int block_count = (level->lh->height+block_rows-1)/block_rows;
+
+  BILDBlockHeader block_header;
+  memset(&block_header, 0, sizeof(BILDBlockHeader));
+
+  buffer->size = 0;
+
+  int b;
+  for (b = 0; b < block_count; ++b)
+    if (!BufferWrite(buffer, &block_header, sizeof(BILDBlockHeader))) return false;
+
+  for (b = 0; b < block_count; ++b)
+  {
+
+    if (!p_BlockToBuffer(level->lh, level->hl, level->hh, b*block_rows, block_rows, buffer, rle, coder, symbols, overflow,
+                         histogram, &block_header))
+      return false;
+
+    memcpy(&buffer->data[b*sizeof(BILDBlockHeader)], &block_header, sizeof(BILDBlockHeader));
+
+  }
+
+  return true;
+
+}
+
+/* Writes the headers of a channel of width x height to headers, with the
+ * geometry of Decompose2D. A level large enough for a segment of its own is
+ * split into blocks of rows, so that a region is decoded from the blocks
+ * under it. The root value and the sizes are filled in after coding. False
+ * if out of memory. */
+static bool p_WriteLevelHeaders(Buffer *headers, const int width, const int height)
+{
+
+  BILDLevelsHeader levels_header;
+  levels_header.root_value = 0;
+  levels_header.level_count = ilog2(get_next_pow(MAX(width, height)));
+  levels_header.width = width;
+  levels_header.height = height;
+
+  headers->size = 0;
+
+  if (!BufferWrite(headers, &levels_header, sizeof(BILDLevelsHeader))) return false;
+
+  BILDLevelHeader level_header;
+  memset(&level_header, 0, sizeof(BILDLevelHeader));
+
+  int w1 = width;
+  int h1 = height;
+  int w0, h0;
+
+  int i;
+  for (i = 0; i < levels_header.level_count; ++i)
+  {
+
+    w0 = w1 >> 1;
+    h0 = h1 >> 1;
+    w1 = (w1+1) >> 1;
+    h1 = (h1+1) >> 1;
+
+    level_header.ll_width = w1;
+    level_header.ll_height = h1;
+    level_header.lh_width = w0;
+    level_header.lh_height = h1;
+    level_header.hl_width = w1;
+    level_header.hl_height = h0;
+    level_header.hh_width = w0;
+    level_header.hh_height = h0;
+
+    if (!BufferWrite(headers, &level_header, sizeof(BILDLevelHeader))) return false;
+
+  }
+
+  /* Levels coded whole are grouped as in p_LevelsToBuffers */
+  byte *data = &headers->data[sizeof(BILDLevelsHeader)];
+  int count = 0;
+  int level_size, row_size, block_rows;
+
+  for (i = levels_header.level_count-1; i >= 0; --i)
+  {
+
+    memcpy(&level_header, &data[i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+    level_size = p_LevelCoefficientCount(&level_header);
+
+    if ((count == 0) && (level_size >= BILD_MIN_SEGMENT_SIZE))
+    {
+
+      row_size = level_header.lh_width+level_header.hl_width+level_header.hh_width;
+      block_rows = (BILD_MIN_BLOCK_SIZE+row_size-1)/row_size;
+
+      if (block_rows < level_header.lh_height)
+      {
+        level_header.block_rows = block_rows;
+        memcpy(&data[i*sizeof(BILDLevelHeader)], &level_header, sizeof(BILDLevelHeader));
+        continue;
+      }
+
+    }
+
+    count += level_size;
+
+    if ((count < BILD_MIN_SEGMENT_SIZE) && (i > 0)) continue;
+
+    count = 0;
+
+  }
+
+  return true;
+
+}
+
+/* Codes the levels of l into coded, a buffer per level, and completes
+ * headers. With blocks_coded the split levels are already in coded (see
+ * BILDEncoderWriteRows) and only the others are coded. False if out of
+ * memory. */
+bool p_LevelsToBuffers(Levels2D *l, Buffer **coded, Buffer *headers, const bool blocks_coded, const bool rle_compression,
+                       const EntropyCoderID coder, Buffer *symbols, Buffer *overflow)
+{
+
+  ((BILDLevelsHeader*)headers->data)->root_value = l->root_value;
+
+  uint32_t histogram[BYTE_MAX+1];
+  RLEStream rle;
+  RLEStream *rle_stream = rle_compression ? &rle : NULL;
+
+  byte *data = &headers->data[sizeof(BILDLevelsHeader)];
+  BILDLevelHeader level_header;
+  Level2D *level;
+
+  int count = 0;
+
+  int i;
+  for (i = l->level_count-1; i >= 0; --i)
+  {
+
+    level = l->levels[i];
+
+    memcpy(&level_header, &data[i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+
+    if (level_header.block_rows > 0)
+    {
+
+      if ((!blocks_coded) &&
+          (!p_BlocksToBuffer(level, level_header.block_rows, coded[i], rle_stream, coder, symbols, overflow, histogram)))
+        return false;
+
+      level_header.coded_size = coded[i]->size;
+      level_header.overflow_size = 0;
+      memcpy(&data[i*sizeof(BILDLevelHeader)], &level_header, sizeof(BILDLevelHeader));
+
+      continue;
+
+    }
+
+    if (count == 0) p_BeginSegment(rle_stream, symbols, overflow, histogram);
+
+    if ((!p_PackRows(level->lh, 0, level->lh->height, rle_stream, symbols, overflow, histogram)) ||
+        (!p_PackRows(level->hl, 0, level->hl->height, rle_stream, symbols, overflow, histogram)) ||
+        (!p_PackRows(level->hh, 0, level->hh->height, rle_stream, symbols, overflow, histogram)))
+      return false;
+
+    /* Coarse levels share a segment, coded with the finest of them, so they
+     * do not each pay for a code table */
+    count += p_LevelCoefficientCount(&level_header);
+
+    if ((count < BILD_MIN_SEGMENT_SIZE) && (i > 0)) continue;
+
+    count = 0;
+
+    coded[i]->size = 0;
+
+    if (!p_EndSegment(coded[i], rle_stream, coder, symbols, overflow, histogram, &level_header.coded_size,
+                      &level_header.overflow_size))
+      return false;
+
+    memcpy(&data[i*sizeof(BILDLevelHeader)], &level_header, sizeof(BILDLevelHeader));
+
+  }
+
+  return true;
+
+}
+
+static void p_DecomposeChannel(void *context, const int index)
+{
+
+  BILDChannels *channels = context;
+  channels->levels[index] = Decompose2D(channels->signals[index], channels->quality, channels->arenas[index]);
+  channels->status[index] = channels->levels[index] ? BILDOk : BILDErrorMemory;
+
+}
+
+static void p_EncodeChannel(void *context, const int index)
+{
+
+  BILDChannels *channels = context;
+
+  if (p_WriteLevelHeaders(channels->headers[index], channels->levels[index]->width, channels->levels[index]->height) &&
+      p_LevelsToBuffers(channels->levels[index], channels->coded[index], channels->headers[index], false,
+                        (channels->quality > 2), channels->coder, channels->symbols[index], channels->overflow[index]))
+    channels->status[index] = BILDOk;
+  else
+    channels->status[index] = BILDErrorMemory;
+
+}
+
+BILDEncoder* BILDEncoderCreate(void)
+{
+
+  CPUInit();
 
-  BILDLevelsHeader levels_header;
-  fread(&levels_header, sizeof(byte), sizeof(BILDLevelsHeader), f);
+  BILDEncoder *encoder = HeapAlloc(sizeof(BILDEncoder));
 
-  Levels2D *result = Levels2DCreate(levels_header.level_count, levels_header.width, levels_header.height);
-  result->root_value = levels_header.root_value;
-  result->level_count = levels_header.level_count;
-  result->width = levels_header.width;
-  result->height = levels_header.height;
+  if (!encoder) return NULL;
 
-  BILDLevelHeader level_header;
+  bool created = true;
 
-  int i;
-  for (i = 0; i < levels_header.level_count; ++i)
+  int i, j;
+  for (i = 0; i < 3; ++i)
   {
 
-    fread(&level_header, sizeof(byte), sizeof(BILDLevelHeader), f);
+    encoder->arenas[i] = ArenaCreate(0);
+    encoder->symbols[i] = BufferCreate(0);
+    encoder->overflow[i] = BufferCreate(0);
+    encoder->headers[i] = BufferCreate(0);
+    created = created && encoder->arenas[i] && encoder->symbols[i] && encoder->overflow[i] && encoder->headers[i];
 
-    result->levels[i] = Level2DCreate(level_header.ll_width, level_header.ll_height,
-                                      Signal2DCreate(level_header.lh_width, level_header.lh_height),
-                                      Signal2DCreate(level_header.hl_width, level_header.hl_height),
-                                      Signal2DCreate(level_header.hh_width, level_header.hh_height));
+    for (j = 0; j < BILD_MAX_LEVELS; ++j)
+    {
+      encoder->coded[i][j] = BufferCreate(0);
+      created = created && encoder->coded[i][j];
+    }
 
   }
 
-  int8_t *buf1 = malloc(levels_header.width*levels_header.height*2);
-  int buf1_size;
+  encoder->file = BufferCreate(0);
+  encoder->image = ImageCreate(0, 0, RGB);
+  memset(&encoder->stages, 0, sizeof(BILDStages));
+  encoder->stream.height = 0;
+  encoder->tile_size = 0;
+  encoder->tile_encoders = NULL;
+  encoder->tile_encoder_count = 0;
+  encoder->tiles = NULL;
+  encoder->tile_count = 0;
+
+  if ((!created) || (!encoder->file) || (!encoder->image))
+  {
+    BILDEncoderDestroy(encoder);
+    return NULL;
+  }
 
-  int8_t *buf2 = malloc(levels_header.width*levels_header.height*2);
-  int buf2_size;
+  return encoder;
 
-  int32_t *overflow_buf = malloc(levels_header.overflow_buffer_size*sizeof(int32_t));
-  int overflow_buf_pos = 0;
+}
 
-  fread(buf1, sizeof(int8_t), levels_header.coded_size, f);
+void BILDEncoderDestroy(BILDEncoder *encoder)
+{
 
-  if (levels_header.overflow_buffer_size > 0)
-    fread(overflow_buf, sizeof(int32_t), levels_header.overflow_buffer_size, f);
+  if (!encoder) return;
 
-  huffmanDecode(buf1, levels_header.coded_size, buf2, &buf2_size);
+  /* The channels of the image belong to the arenas */
+  if (encoder->image)
+  {
+    free(encoder->image->channels);
+    free(encoder->image);
+  }
 
-  int8_t *src_buf = buf1;
-  int src_buf_pos = 0;
+  BufferDestroy(encoder->file);
 
-  if (rle_compression)
+  int i, j;
+  for (i = 0; i < 3; ++i)
   {
+    ArenaDestroy(encoder->arenas[i]);
+    BufferDestroy(encoder->symbols[i]);
+    BufferDestroy(encoder->overflow[i]);
+    for (j = 0; j < BILD_MAX_LEVELS; ++j) BufferDestroy(encoder->coded[i][j]);
+    BufferDestroy(encoder->headers[i]);
+  }
 
-    rleDecode8(buf2, buf2_size, buf1, &buf1_size);
+  for (i = 0; i < encoder->tile_encoder_count; ++i)
+    BILDEncoderDestroy(encoder->tile_encoders[i]);
+  free(encoder->tile_encoders);
 
-    src_buf = buf1;
+  for (i = 0; i < encoder->tile_count; ++i)
+    BufferDestroy(encoder->tiles[i]);
+  free(encoder->tiles);
 
-  }
-  else
+  free(encoder);
+
+}
+
+/* Writes the headers and then the coded levels of all channels coarsest
+ * first, level n of every channel before level n-1, and sets their offsets.
+ * False if out of memory. */
+static bool p_WriteFile(Buffer *file, const BILDHeader *header, Buffer **headers, Buffer **coded[3])
+{
+
+  int level_counts[3];
+  int max_level_count = 0;
+
+  int headers_pos[3];
+  int headers_end = sizeof(BILDHeader);
+  int coded_size = 0;
+
+  BILDLevelHeader level_header;
+  byte *level_header_data;
+
+  int c, i;
+  for (c = 0; c < 3; ++c)
   {
 
-    src_buf = buf2;
+    level_counts[c] = ((BILDLevelsHeader*)headers[c]->data)->level_count;
+    max_level_count = MAX(max_level_count, level_counts[c]);
+    headers_pos[c] = headers_end;
+    headers_end += headers[c]->size;
+
+    for (i = 0; i < level_counts[c]; ++i)
+    {
+      memcpy(&level_header, &headers[c]->data[sizeof(BILDLevelsHeader)+i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+      if (level_header.coded_size > 0) coded_size += coded[c][i]->size;
+    }
 
   }
 
-  int j;
-  for (i = 0; i < levels_header.level_count; ++i)
+  /* The writes below then stay within the buffer */
+  file->size = 0;
+
+  if (!BufferReserve(file, headers_end+coded_size)) return false;
+
+  BufferWrite(file, header, sizeof(BILDHeader));
+  for (c = 0; c < 3; ++c)
+    BufferWrite(file, headers[c]->data, headers[c]->size);
+
+  for (i = max_level_count-1; i >= 0; --i)
   {
+    for (c = 0; c < 3; ++c)
+    {
 
-    for (j = 0; j < result->levels[i]->lh->width*result->levels[i]->lh->height; ++j)
-      result->levels[i]->lh->data[result->levels[i]->lh->data_pos++] = unpack8_32(src_buf[src_buf_pos++], overflow_buf, &overflow_buf_pos);
+      if (i >= level_counts[c]) continue;
 
-    for (j = 0; j < result->levels[i]->hl->width*result->levels[i]->hl->height; ++j)
-      result->levels[i]->hl->data[result->levels[i]->hl->data_pos++] = unpack8_32(src_buf[src_buf_pos++], overflow_buf, &overflow_buf_pos);
+      level_header_data = &file->data[headers_pos[c]+sizeof(BILDLevelsHeader)+i*sizeof(BILDLevelHeader)];
+      memcpy(&level_header, level_header_data, sizeof(BILDLevelHeader));
 
-    for (j = 0; j < result->levels[i]->hh->width*result->levels[i]->hh->height; ++j)
-      result->levels[i]->hh->data[result->levels[i]->hh->data_pos++] = unpack8_32(src_buf[src_buf_pos++], overflow_buf, &overflow_buf_pos);
+      if (level_header.coded_size == 0) continue;
 
-  }
+      level_header.offset = file->size;
+      memcpy(level_header_data, &level_header, sizeof(BILDLevelHeader));
 
-  free(buf1);
-  free(buf2);
+      BufferWrite(file, coded[c][i]->data, coded[c][i]->size);
 
-  free(overflow_buf);
+    }
+  }
 
-  return result;
+  return true;
 
 }
 
-Image *ImageLoadFromBILDFileAndCreate(const char *filename)
+/* Encodes image into encoder->file, the arenas have to be reset */
+static BILDStatus p_EncodeImage(BILDEncoder *encoder, Image *image, const int quality, const EntropyCoderID coder)
 {
 
-  struct stat st;
-  stat(filename, &st);
-  if (st.st_size < sizeof(BILDHeader))
+  memset(&encoder->stages, 0, sizeof(BILDStages));
+
+  const size_t rgb_size = p_ImageSize(image);
+
+  StageClock start;
+  StageStart(&start);
+
+  if (!ImageTransformColourSpace(image, (quality > 0) ? YCbCr411 : RGBDifference)) return BILDErrorMemory;
+
+  const size_t plane_size = p_ImageSize(image);
+
+  StageStop(&start, rgb_size, plane_size, &encoder->stages.colour);
+
+  BILDChannels channels;
+  channels.quality = quality;
+  channels.coder = coder;
+
+  int i;
+  for (i = 0; i < 3; ++i)
   {
+    channels.signals[i] = image->channels[i];
+    channels.arenas[i] = encoder->arenas[i];
+    channels.symbols[i] = encoder->symbols[i];
+    channels.overflow[i] = encoder->overflow[i];
+    channels.coded[i] = encoder->coded[i];
+    channels.headers[i] = encoder->headers[i];
+  }
 
-    printf("No BILD file.\n");
+  StageStart(&start);
 
-    return NULL;
+  ThreadPoolParallelFor(3, p_DecomposeChannel, &channels);
 
+  StageStop(&start, plane_size, plane_size, &encoder->stages.transform);
+
+  BILDStatus status = BILDOk;
+
+  for (i = 0; i < 3; ++i)
+    if (channels.status[i] != BILDOk) status = channels.status[i];
+
+  if (status != BILDOk)
+  {
+    for (i = 0; i < 3; ++i)
+      Levels2DDestroy(channels.levels[i]);
+    return status;
   }
 
-  FILE *f = fopen(filename, "rb");
+  StageStart(&start);
+
+  ThreadPoolParallelFor(3, p_EncodeChannel, &channels);
+
+  for (i = 0; i < 3; ++i)
+    if (channels.status[i] != BILDOk) status = channels.status[i];
 
   BILDHeader header;
-  fread(&header, sizeof(byte), sizeof(BILDHeader), f);
+  header.type = BILD_TYPE;
+  header.version = VERSION;
+  header.width = image->width;
+  header.height = image->height;
+  header.quality = quality;
+  header.coder = coder;
+  header.tile_size = 0;
+
+  if ((status == BILDOk) && (!p_WriteFile(encoder->file, &header, channels.headers, channels.coded)))
+    status = BILDErrorMemory;
+
+  StageStop(&start, plane_size, encoder->file->size, &encoder->stages.coding);
+
+  for (i = 0; i < 3; ++i)
+    Levels2DDestroy(channels.levels[i]);
+
+  return status;
+
+}
+
+/* Reads width x height pixels into the planes of image, straight in the
+ * colour space they are coded in. False if out of memory. */
+static bool p_ReadPixels(BILDEncoder *encoder, Image *image, const uint8_t *pixels, const int width, const int height,
+                         const int stride, const int quality, Stage *colour)
+{
+
+  image->colour_space = (quality > 0) ? YCbCr411 : RGBDifference;
+  image->width = width;
+  image->height = height;
 
-  if (header.type != BILD_TYPE)
+  const bool subsampled = (image->colour_space == YCbCr411);
+
+  int i;
+  for (i = 0; i < 3; ++i)
   {
+    ArenaReset(encoder->arenas[i]);
+    if ((i > 0) && subsampled)
+      image->channels[i] = Signal2DCreateInArena(encoder->arenas[i], (width+1) >> 1, (height+1) >> 1);
+    else
+      image->channels[i] = Signal2DCreateInArena(encoder->arenas[i], width, height);
+  }
 
-    printf("No BILD file.\n");
+  if ((!image->channels[0]) || (!image->channels[1]) || (!image->channels[2])) return false;
 
-    fclose(f);
-    return NULL;
+  StageClock start;
+  StageStart(&start);
+
+  ImageReadRGB8(image, pixels, stride);
+
+  StageStop(&start, (size_t)width*height*3, p_ImageSize(image), colour);
+
+  return true;
+
+}
+
+/* Makes sure the encoder has count encoders and buffers for the tiles,
+ * false if out of memory */
+static bool p_ReserveTiles(BILDEncoder *encoder, const int encoder_count, const int count)
+{
+
+  if (encoder_count > encoder->tile_encoder_count)
+  {
+
+    BILDEncoder **tile_encoders = HeapRealloc(encoder->tile_encoders, encoder_count*sizeof(BILDEncoder*));
+
+    if (!tile_encoders) return false;
+
+    encoder->tile_encoders = tile_encoders;
+
+    for (; encoder->tile_encoder_count < encoder_count; ++encoder->tile_encoder_count)
+    {
+      tile_encoders[encoder->tile_encoder_count] = BILDEncoderCreate();
+      if (!tile_encoders[encoder->tile_encoder_count]) return false;
+    }
 
   }
 
-  if (header.version != VERSION)
+  if (count > encoder->tile_count)
   {
 
-    printf("Wrong BILD file version: Found %d but expected %d.\n", header.version, VERSION);
+    Buffer **tile_buffers = HeapRealloc(encoder->tiles, count*sizeof(Buffer*));
 
-    fclose(f);
-    return NULL;
+    if (!tile_buffers) return false;
+
+    encoder->tiles = tile_buffers;
+
+    for (; encoder->tile_count < count; ++encoder->tile_count)
+    {
+      tile_buffers[encoder->tile_count] = BufferCreate(0);
+      if (!tile_buffers[encoder->tile_count]) return false;
+    }
 
   }
 
-  clock_t start, end;
+  return true;
 
-  start = clock();
+}
 
-  Levels2D *l1 = p_FileToLevels(f, (header.quality > 2));
-  Levels2D *l2 = p_FileToLevels(f, (header.quality > 2));
-  Levels2D *l3 = p_FileToLevels(f, (header.quality > 2));
+static void p_EncodeTiles(void *context, const int slot)
+{
 
-  end = clock();
+  BILDTiles *tiles = context;
+  BILDEncoder *encoder = tiles->encoders[slot];
+  const Image *source = tiles->image;
+  Image *image = encoder->image;
+  BILDStatus status;
+  Stage colour;
 
-  printf("Reading and decoding bitstream time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+  int index, x0, y0, width, height, c, y;
+  while ((index = p_TakeTile(tiles)) >= 0)
+  {
 
-  Image *result;
+    x0 = (index % tiles->columns)*tiles->tile_size;
+    y0 = (index / tiles->columns)*tiles->tile_size;
+    width = MIN(tiles->tile_size, tiles->width-x0);
+    height = MIN(tiles->tile_size, tiles->height-y0);
+
+    memset(&colour, 0, sizeof(Stage));
+    status = BILDOk;
+
+    if (tiles->source)
+    {
+      if (!p_ReadPixels(encoder, image, &tiles->source[(int64_t)y0*tiles->stride+x0*3], width, height, tiles->stride,
+                        tiles->quality, &colour))
+        status = BILDErrorMemory;
+    }
+    else
+    {
+
+      image->colour_space = RGB;
+      image->width = width;
+      image->height = height;
+
+      for (c = 0; (c < 3) && (status == BILDOk); ++c)
+      {
+
+        ArenaReset(encoder->arenas[c]);
+        image->channels[c] = Signal2DCreateInArena(encoder->arenas[c], width, height);
+
+        if (!image->channels[c])
+        {
+          status = BILDErrorMemory;
+          break;
+        }
+
+        for (y = 0; y < height; ++y)
+          memcpy(&image->channels[c]->data[y*width], &source->channels[c]->data[(int64_t)(y0+y)*source->width+x0],
+                 width*sizeof(sample));
+
+      }
+
+    }
+
+    if (status == BILDOk) status = p_EncodeImage(encoder, image, tiles->quality, tiles->coder);
+
+    tiles->buffers[index]->size = 0;
+
+    if ((status == BILDOk) && (!BufferWrite(tiles->buffers[index], encoder->file->data, encoder->file->size)))
+      status = BILDErrorMemory;
+
+    if (status != BILDOk)
+    {
+      pthread_mutex_lock(&tiles->mutex);
+      tiles->status = status;
+      pthread_mutex_unlock(&tiles->mutex);
+      continue;
+    }
+
+    StageAdd(&encoder->stages.colour, &colour);
+
+    p_AddTileStages(tiles, &encoder->stages);
+
+  }
+
+}
+
+/* Encodes a width x height image tile by tile into encoder->file. The
+ * tiles are read from pixels, or cut from the RGB planes of image if pixels
+ * is NULL, so only the tiles in flight are held as planes. */
+static BILDStatus p_EncodeTiledImage(BILDEncoder *encoder, const Image *image, const uint8_t *pixels, const int stride,
+                               const int width, const int height, const int quality, const EntropyCoderID coder)
+{
+
+  BILDTiles tiles;
+  tiles.tile_size = encoder->tile_size;
+  tiles.columns = p_TileCount(width, encoder->tile_size);
+  tiles.count = tiles.columns*p_TileCount(height, encoder->tile_size);
+  tiles.next = 0;
+  tiles.quality = quality;
+  tiles.coder = coder;
+  tiles.width = width;
+  tiles.height = height;
+  tiles.image = (Image*)image;
+  tiles.source = pixels;
+  tiles.stride = stride;
+  tiles.status = BILDOk;
+  memset(&tiles.stages, 0, sizeof(BILDStages));
+
+  const int slot_count = MIN(ThreadPoolThreadCount(), tiles.count);
+
+  if (!p_ReserveTiles(encoder, slot_count, tiles.count)) return BILDErrorMemory;
+
+  tiles.encoders = encoder->tile_encoders;
+  tiles.buffers = encoder->tiles;
+
+  pthread_mutex_init(&tiles.mutex, NULL);
+  ThreadPoolParallelFor(slot_count, p_EncodeTiles, &tiles);
+  pthread_mutex_destroy(&tiles.mutex);
+
+  encoder->stages = tiles.stages;
+
+  if (tiles.status != BILDOk) return tiles.status;
+
+  BILDHeader header;
+  header.type = BILD_TYPE;
+  header.version = VERSION;
+  header.width = width;
+  header.height = height;
+  header.quality = quality;
+  header.coder = coder;
+  header.tile_size = encoder->tile_size;
+
+  BILDTileHeader tile_header;
+  tile_header.offset = sizeof(BILDHeader)+(uint64_t)tiles.count*sizeof(BILDTileHeader);
+
+  int i;
+  size_t size = tile_header.offset;
+  for (i = 0; i < tiles.count; ++i) size += tiles.buffers[i]->size;
 
-  if (header.quality > 0)
-    result = ImageCreate(0, 0, YCbCr411);
+  /* The writes below then stay within the buffer */
+  Buffer *file = encoder->file;
+  file->size = 0;
+
+  if (!BufferReserve(file, size)) return BILDErrorMemory;
+
+  BufferWrite(file, &header, sizeof(BILDHeader));
+
+  for (i = 0; i < tiles.count; ++i)
+  {
+    tile_header.size = tiles.buffers[i]->size;
+    BufferWrite(file, &tile_header, sizeof(BILDTileHeader));
+    tile_header.offset += tile_header.size;
+  }
+
+  for (i = 0; i < tiles.count; ++i)
+    BufferWrite(file, tiles.buffers[i]->data, tiles.buffers[i]->size);
+
+  return BILDOk;
+
+}
+
+static bool p_CheckEncodeParameters(const BILDEncoder *encoder, const int width, const int height, const int quality,
+                                    const int coder)
+{
+
+  return p_CheckSize(width, height, encoder->tile_size) &&
+         (quality >= 0) && (quality <= 7) && (coder >= 0) && (coder < EntropyCoderCount);
+
+}
+
+BILDStatus BILDEncoderEncodeImage(BILDEncoder *encoder, Image *image, const int quality, const EntropyCoderID coder,
+                                  const byte **coded_data, size_t *coded_size)
+{
+
+  if ((image->colour_space != RGB) || (!p_CheckEncodeParameters(encoder, image->width, image->height, quality, coder)))
+    return BILDErrorArgument;
+
+  /* A begun image is dropped with the arenas */
+  encoder->stream.height = 0;
+
+  int i;
+  for (i = 0; i < 3; ++i) ArenaReset(encoder->arenas[i]);
+
+  BILDStatus status;
+
+  if (encoder->tile_size > 0)
+    status = p_EncodeTiledImage(encoder, image, NULL, 0, image->width, image->height, quality, coder);
   else
-    result = ImageCreate(0, 0, RGB);
+    status = p_EncodeImage(encoder, image, quality, coder);
+
+  if (status != BILDOk) return status;
+
+  *coded_data = encoder->file->data;
+  *coded_size = encoder->file->size;
 
-  result->width = header.width;
-  result->height = header.height;
+  return BILDOk;
 
-  start = clock();
+}
 
-  result->channels[0] = Reconstruct2D(l1, header.quality);
-  result->channels[1] = Reconstruct2D(l2, header.quality);
-  result->channels[2] = Reconstruct2D(l3, header.quality);
+BILDStatus BILDEncode(BILDEncoder *encoder, const uint8_t *pixels, const int width, const int height, const int stride,
+                      const BILDPixelFormat format, const int quality, const BILDCoder coder,
+                      const uint8_t **coded_data, size_t *coded_size)
+{
 
-  end = clock();
+  if ((!encoder) || (!pixels) || (!coded_data) || (!coded_size) || (format != BILDPixelRGB8) ||
+      (!p_CheckEncodeParameters(encoder, width, height, quality, coder)) || (stride < width*3))
+    return BILDErrorArgument;
 
-  printf("Reconstruction time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+  encoder->stream.height = 0;
 
-  Levels2DDestroy(l1);
-  Levels2DDestroy(l2);
-  Levels2DDestroy(l3);
+  BILDStatus status;
 
-  if (header.quality > 0)
+  /* Tiles are read from the pixels as they are coded */
+  if (encoder->tile_size > 0)
   {
-    start = clock();
-    ImageTransformColourSpace(result, RGB);
-    end = clock();
-    printf("Colour transformation time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+    status = p_EncodeTiledImage(encoder, NULL, pixels, stride, width, height, quality, coder);
   }
   else
   {
-    start = clock();
-    Signal2DAdd(result->channels[1], result->channels[0]);
-    Signal2DAdd(result->channels[2], result->channels[0]);
-    end = clock();
-    printf("Plane addition time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+
+    Stage colour;
+    memset(&colour, 0, sizeof(Stage));
+
+    if (!p_ReadPixels(encoder, encoder->image, pixels, width, height, stride, quality, &colour)) return BILDErrorMemory;
+
+    status = p_EncodeImage(encoder, encoder->image, quality, coder);
+
+    StageAdd(&encoder->stages.colour, &colour);
+
   }
 
-  fclose(f);
+  if (status != BILDOk) return status;
+
+  *coded_data = encoder->file->data;
+  *coded_size = encoder->file->size;
 
-  return result;
+  return BILDOk;
 
 }
 
-void p_LevelsToFile(Levels2D *l, FILE *f, const bool rle_compression)
+/* Takes the subband rows of level n of a channel coded row by row. Whole
+ * levels are kept, the blocks of split levels are coded once their last
+ * row is in. */
+static void p_StreamSubbandRows(void *context, const int n, const int row, const sample *lh, const sample *hl,
+                                const sample *hh)
 {
 
-  int8_t *buf1 = malloc(l->width*l->height*2);
-  int buf1_size = 0;
+  BILDStreamChannel *channel = context;
+  Level2D *level = channel->levels->levels[n];
 
-  int8_t *buf2 = calloc(l->width*l->height*2, sizeof(int8_t));
-  int buf2_size = 0;
+  if (channel->status != BILDOk) return;
 
-  int32_t *overflow_buf = malloc(l->width*l->height*sizeof(int32_t));
-  int overflow_buf_size = 0;
+  BILDLevelHeader level_header;
+  memcpy(&level_header, &channel->headers->data[sizeof(BILDLevelsHeader)+n*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
 
-  int i, j;
-  for (i = 0; i < l->level_count; ++i)
+  const int block_rows = level_header.block_rows;
+  const int block_row = (block_rows > 0) ? row % block_rows : row;
+
+  memcpy(&level->lh->data[block_row*level->lh->width], lh, level->lh->width*sizeof(sample));
+
+  if (hl)
   {
+    memcpy(&level->hl->data[block_row*level->hl->width], hl, level->hl->width*sizeof(sample));
+    memcpy(&level->hh->data[block_row*level->hh->width], hh, level->hh->width*sizeof(sample));
+  }
 
-    for (j = 0; j < l->levels[i]->lh->width*l->levels[i]->lh->height; ++j)
-      buf1[buf1_size++] = pack32_8(l->levels[i]->lh->data[l->levels[i]->lh->data_pos++], overflow_buf, &overflow_buf_size);
+  if ((block_rows == 0) || ((block_row < block_rows-1) && (row < level_header.lh_height-1))) return;
 
-    for (j = 0; j < l->levels[i]->hl->width*l->levels[i]->hl->height; ++j)
-      buf1[buf1_size++] = pack32_8(l->levels[i]->hl->data[l->levels[i]->hl->data_pos++], overflow_buf, &overflow_buf_size);
+  /* The last block may have fewer rows */
+  const int first_row = row-block_row;
 
-    for (j = 0; j < l->levels[i]->hh->width*l->levels[i]->hh->height; ++j)
-      buf1[buf1_size++] = pack32_8(l->levels[i]->hh->data[l->levels[i]->hh->data_pos++], overflow_buf, &overflow_buf_size);
+  Signal2D lh_rows = *level->lh;
+  Signal2D hl_rows = *level->hl;
+  Signal2D hh_rows = *level->hh;
+  lh_rows.height = p_RowCount(level_header.lh_height, first_row, block_rows);
+  hl_rows.height = p_RowCount(level_header.hl_height, first_row, block_rows);
+  hh_rows.height = p_RowCount(level_header.hh_height, first_row, block_rows);
 
-  }
+  uint32_t histogram[BYTE_MAX+1];
+  RLEStream rle;
+  BILDBlockHeader block_header;
+  Buffer *buffer = channel->coded[n];
 
-  int8_t *trg_buf;
-  int trg_buf_size;
-  if (rle_compression)
+  if (!p_BlockToBuffer(&lh_rows, &hl_rows, &hh_rows, 0, block_rows, buffer, channel->rle_compression ? &rle : NULL,
+                       channel->coder, channel->symbols, channel->overflow, histogram, &block_header))
   {
+    channel->status = BILDErrorMemory;
+    return;
+  }
 
-    rleEncode8(buf1, buf1_size, buf2, &buf2_size, NULL);
-    memset(buf1, 0, l->width*l->height*2);
-    huffmanEncode(buf2, buf2_size, buf1, &buf1_size, NULL);
+  memcpy(&buffer->data[(row/block_rows)*sizeof(BILDBlockHeader)], &block_header, sizeof(BILDBlockHeader));
 
-    trg_buf = buf1;
-    trg_buf_size = buf1_size;
+}
 
-  }
-  else
+/* Sets up channel index of the begun image, false if out of memory */
+static bool p_BeginChannel(BILDEncoder *encoder, const int index)
+{
+
+  BILDStream *stream = &encoder->stream;
+  BILDStreamChannel *channel = &stream->channels[index];
+  Arena *arena = encoder->arenas[index];
+
+  /* Chroma of lossy images at half the size */
+  const bool chroma = (stream->quality > 0) && (index > 0);
+  const int width = chroma ? (stream->width+1) >> 1 : stream->width;
+  const int height = chroma ? (stream->height+1) >> 1 : stream->height;
+
+  channel->coded = encoder->coded[index];
+  channel->headers = encoder->headers[index];
+  channel->symbols = encoder->symbols[index];
+  channel->overflow = encoder->overflow[index];
+  channel->rle_compression = (stream->quality > 2);
+  channel->coder = stream->coder;
+  channel->status = BILDOk;
+
+  if (!p_WriteLevelHeaders(channel->headers, width, height)) return false;
+
+  const int level_count = ((BILDLevelsHeader*)channel->headers->data)->level_count;
+  channel->levels = Levels2DCreate(arena, level_count, width, height);
+
+  if (!channel->levels) return false;
+
+  BILDLevelHeader level_header;
+  BILDBlockHeader block_header;
+  memset(&block_header, 0, sizeof(BILDBlockHeader));
+
+  int i, b, rows;
+  for (i = 0; i < level_count; ++i)
   {
 
-    huffmanEncode(buf1, buf1_size, buf2, &buf2_size, NULL);
+    memcpy(&level_header, &channel->headers->data[sizeof(BILDLevelsHeader)+i*sizeof(BILDLevelHeader)], sizeof(BILDLevelHeader));
+
+    /* Split levels hold a block, behind the table of the block headers */
+    rows = (level_header.block_rows > 0) ? level_header.block_rows : level_header.lh_height;
+
+    channel->levels->levels[i] =
+      Level2DCreateSubbands(arena, level_header.ll_width, level_header.ll_height,
+                            level_header.lh_width, MIN(rows, level_header.lh_height),
+                            level_header.hl_width, MIN(rows, level_header.hl_height),
+                            level_header.hh_width, MIN(rows, level_header.hh_height));
 
-    trg_buf = buf2;
-    trg_buf_size = buf2_size;
+    if (!channel->levels->levels[i]) return false;
+
+    channel->coded[i]->size = 0;
+
+    if (level_header.block_rows > 0)
+      for (b = 0; b < p_BlockCount(&level_header); ++b)
+        if (!BufferWrite(channel->coded[i], &block_header, sizeof(BILDBlockHeader))) return false;
 
   }
 
-  BILDLevelsHeader levels_header;
-  levels_header.root_value = l->root_value;
-  levels_header.level_count = l->level_count;
-  levels_header.width = l->width;
-  levels_header.height = l->height;
-  levels_header.coded_size = trg_buf_size;
-  levels_header.overflow_buffer_size = overflow_buf_size;
+  channel->decomposition = LineDecomposition2DCreate(arena, width, height, stream->quality, p_StreamSubbandRows, channel);
 
-  fwrite(&levels_header, sizeof(byte), sizeof(BILDLevelsHeader), f);
+  channel->row = ArenaAlloc(arena, stream->width*sizeof(sample));
+  channel->pending = chroma ? ArenaAlloc(arena, stream->width*sizeof(sample)) : NULL;
 
-  BILDLevelHeader level_header;
-  for (i = 0; i < l->level_count; ++i)
+  return channel->decomposition && channel->row && ((!chroma) || channel->pending);
+
+}
+
+BILDStatus BILDEncoderBegin(BILDEncoder *encoder, const int width, const int height, const BILDPixelFormat format,
+                            const int quality, const BILDCoder coder)
+{
+
+  if ((!encoder) || (format != BILDPixelRGB8) || (encoder->tile_size > 0) ||
+      (!p_CheckEncodeParameters(encoder, width, height, quality, coder)))
+    return BILDErrorArgument;
+
+  BILDStream *stream = &encoder->stream;
+  stream->width = width;
+  stream->height = height;
+  stream->quality = quality;
+  stream->coder = coder;
+  stream->row = 0;
+
+  memset(&encoder->stages, 0, sizeof(BILDStages));
+
+  /* What was set up is left to the arenas */
+  int i;
+  for (i = 0; i < 3; ++i)
   {
-    level_header.ll_width = l->levels[i]->ll_width;
-    level_header.ll_height = l->levels[i]->ll_height;
-    level_header.lh_width = l->levels[i]->lh->width;
-    level_header.lh_height = l->levels[i]->lh->height;
-    level_header.hl_width = l->levels[i]->hl->width;
-    level_header.hl_height = l->levels[i]->hl->height;
-    level_header.hh_width = l->levels[i]->hh->width;
-    level_header.hh_height = l->levels[i]->hh->height;
-    fwrite(&level_header, sizeof(byte), sizeof(BILDLevelHeader), f);
+
+    ArenaReset(encoder->arenas[i]);
+
+    if (!p_BeginChannel(encoder, i))
+    {
+      stream->height = 0;
+      return BILDErrorMemory;
+    }
+
   }
 
-  fwrite(trg_buf, sizeof(int8_t), trg_buf_size, f);
+  return BILDOk;
 
-  if (overflow_buf_size > 0)
-    fwrite(overflow_buf, sizeof(int32_t), overflow_buf_size, f);
+}
 
-  free(buf2);
-  free(buf1);
+/* Bytes of the planes of a row of a streamed image, the chroma of lossy
+ * images has half the width and half the rows */
+static size_t p_StreamRowSize(const BILDStream *stream)
+{
 
-  free(overflow_buf);
+  return (size_t)stream->width*((stream->quality > 0) ? 3 : 6)*sizeof(sample)/2;
 
 }
 
-void ImageSaveAsBILDFile(Image *image, const char *filename, const int quality)
+/* Passes the rows of the current BILDEncoderWriteRows through the colour (or
+ * plane) transform of channel index to its decomposition */
+static void p_WriteChannelRows(void *context, const int index)
 {
 
-  clock_t start, end;
+  BILDStream *stream = context;
+  BILDStreamChannel *channel = &stream->channels[index];
+
+  const int width = stream->width;
+  const bool lossy = (stream->quality > 0);
+
+  const uint8_t *pixel;
+  sample *row, *swap;
+
+  int x, y, r;
+  for (y = 0; y < stream->row_count; ++y)
+  {
+
+    pixel = &stream->pixels[(size_t)y*stream->stride];
+    row = channel->row;
+
+    for (x = 0; x < width; ++x)
+    {
+      if (lossy)
+        row[x] = (index == 0) ? ((pixel[0] + (pixel[1]<<1) + pixel[2]) >> 2) - 128 :
+                 (index == 1) ? pixel[0] - pixel[1] : pixel[2] - pixel[1];
+      else
+        row[x] = (index == 0) ? pixel[0] : pixel[index] - pixel[0];
+      pixel += 3;
+    }
 
-  if (quality > 0) {
+    /* Chroma of lossy images is the mean of 2 x 2 pixels */
+    if (channel->pending)
+    {
 
-    start = clock();
+      r = stream->row+y;
 
-    ImageTransformColourSpace(image, YCbCr411);
+      if ((r % 2 == 0) && (r+1 < stream->height))
+      {
+        swap = channel->pending;
+        channel->pending = row;
+        channel->row = swap;
+        continue;
+      }
 
-    end = clock();
+      Signal2DDownsampleRowPair((r % 2) ? channel->pending : row, row, width, row);
 
-    printf("Colour transformation time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+    }
+
+    LineDecomposition2DPushRow(channel->decomposition, row);
 
   }
-  else
-  {
 
-    start = clock();
+}
+
+BILDStatus BILDEncoderWriteRows(BILDEncoder *encoder, const uint8_t *pixels, const int row_count, const int stride)
+{
+
+  if ((!encoder) || (!pixels) || (row_count < 0)) return BILDErrorArgument;
+
+  BILDStream *stream = &encoder->stream;
 
-    Signal2DSub(image->channels[1], image->channels[0]);
-    Signal2DSub(image->channels[2], image->channels[0]);
+  if ((stream->height == 0) || (row_count > stream->height-stream->row) || (stride < stream->width*3))
+    return BILDErrorArgument;
 
-    end = clock();
+  stream->pixels = pixels;
+  stream->row_count = row_count;
+  stream->stride = stride;
 
-    printf("Plane substraction time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+  StageClock start;
+  StageStart(&start);
 
+  ThreadPoolParallelFor(3, p_WriteChannelRows, stream);
+
+  StageStop(&start, (size_t)row_count*stream->width*3, (size_t)row_count*p_StreamRowSize(stream), &encoder->stages.transform);
+
+  stream->row += row_count;
+
+  /* The image is dropped if a block could not be coded */
+  int i;
+  for (i = 0; i < 3; ++i)
+  {
+    if (stream->channels[i].status != BILDOk)
+    {
+      stream->height = 0;
+      return stream->channels[i].status;
+    }
   }
 
-  start = clock();
+  return BILDOk;
+
+}
+
+/* Codes the levels of channel index that are coded whole */
+static void p_EndChannel(void *context, const int index)
+{
+
+  BILDStream *stream = context;
+  BILDStreamChannel *channel = &stream->channels[index];
+
+  channel->levels->root_value = channel->decomposition->root_value;
+
+  if (!p_LevelsToBuffers(channel->levels, channel->coded, channel->headers, true, channel->rle_compression, channel->coder,
+                         channel->symbols, channel->overflow))
+    channel->status = BILDErrorMemory;
+
+}
+
+BILDStatus BILDEncoderEnd(BILDEncoder *encoder, const uint8_t **coded_data, size_t *coded_size)
+{
 
-  Levels2D *l1 = Decompose2D(image->channels[0], quality);
-  Levels2D *l2 = Decompose2D(image->channels[1], quality);
-  Levels2D *l3 = Decompose2D(image->channels[2], quality);
+  if ((!encoder) || (!coded_data) || (!coded_size)) return BILDErrorArgument;
 
-  end = clock();
+  BILDStream *stream = &encoder->stream;
 
-  printf("Decomposition time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+  if ((stream->height == 0) || (stream->row < stream->height)) return BILDErrorArgument;
 
-  FILE *f = fopen(filename, "wb");
+  StageClock start;
+  StageStart(&start);
+
+  ThreadPoolParallelFor(3, p_EndChannel, stream);
 
   BILDHeader header;
   header.type = BILD_TYPE;
   header.version = VERSION;
-  header.width = image->width;
-  header.height = image->height;
-  header.quality = quality;
-  fwrite(&header, sizeof(byte), sizeof(BILDHeader), f);
+  header.width = stream->width;
+  header.height = stream->height;
+  header.quality = stream->quality;
+  header.coder = stream->coder;
+  header.tile_size = 0;
+
+  BILDStatus status = BILDOk;
+
+  int i;
+  for (i = 0; i < 3; ++i)
+    if (stream->channels[i].status != BILDOk) status = stream->channels[i].status;
+
+  Buffer **coded[3] = {encoder->coded[0], encoder->coded[1], encoder->coded[2]};
 
-  start = clock();
+  if ((status == BILDOk) && (!p_WriteFile(encoder->file, &header, encoder->headers, coded))) status = BILDErrorMemory;
 
-  p_LevelsToFile(l1, f, (quality > 2));
-  p_LevelsToFile(l2, f, (quality > 2));
-  p_LevelsToFile(l3, f, (quality > 2));
+  StageStop(&start, (size_t)stream->height*p_StreamRowSize(stream), encoder->file->size, &encoder->stages.coding);
 
-  end = clock();
+  stream->height = 0;
 
-  printf("Creating and saving bitstream time: %f sec\n", (double)(((double)end - (double)start) / CLOCKS_PER_SEC));
+  if (status != BILDOk) return status;
 
-  fclose(f);
+  *coded_data = encoder->file->data;
+  *coded_size = encoder->file->size;
 
-  Levels2DDestroy(l1);
-  Levels2DDestroy(l2);
-  Levels2DDestroy(l3);
+  return BILDOk;
 
 }
 
-void BILDPrintInformation(const char *filename)
+BILDStatus BILDEncoderSetTileSize(BILDEncoder *encoder, const int tile_size)
 {
 
-  FILE *f = fopen(filename, "rb");
+  if ((!encoder) || ((tile_size != 0) && ((tile_size < BILD_MIN_TILE_SIZE) || (tile_size > BILD_MAX_TILE_SIZE) ||
+                                          (tile_size & (tile_size-1)))))
+    return BILDErrorArgument;
 
-  struct stat st;
-  stat(filename, &st);
-  if (st.st_size < sizeof(BILDHeader))
-  {
+  encoder->tile_size = tile_size;
 
-    printf("No BILD file.\n");
+  return BILDOk;
 
-    fclose(f);
-    return;
+}
 
-  }
+const BILDStages* BILDEncoderStages(const BILDEncoder *encoder)
+{
 
-  BILDHeader header;
-  fread(&header, sizeof(byte), sizeof(BILDHeader), f);
+  return &encoder->stages;
 
-  if (header.type != BILD_TYPE)
-  {
+}
 
-    printf("No BILD file.\n");
+static const char *p_status_messages[] =
+{
+  "Ok.",
+  "Invalid argument.",
+  "No BILD file.",
+  "Wrong BILD file version.",
+  "Unknown entropy coder.",
+  "Truncated BILD file.",
+  "Out of memory."
+};
+
+const char* BILDStatusMessage(const BILDStatus status)
+{
 
-  }
-  else
-  {
+  return ((status >= BILDOk) && (status <= BILDErrorMemory)) ? p_status_messages[status] : "Unknown error.";
 
-    printf("BILD version............... %d\n", header.version);
-    printf("Image size (bytes)........ %d\n", header.width*header.height*3);
-    printf("Image dimension (pixels).. %d x %d (width x height)\n", header.width, header.height);
-    printf("Quality................... %d\n", header.quality);
+}
 
-  }
+void BILDSetThreadCount(const int thread_count)
+{
 
-  fclose(f);
+  ThreadPoolInit(thread_count);
 
 }
@@ -22,18 +22,36 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
-#include <sys/stat.h>
 
+#include "libbild.h"
 #include "globals.h"
 #include "types.h"
+#include "heap.h"
+#include "stage.h"
 #include "image.h"
 #include "decomposition.h"
 #include "pack.h"
 #include "rle.h"
 #include "huffman.h"
+#include "entropy.h"
+#include "buffer.h"
+#include "threadpool.h"
+#include "arena.h"
 
 #define BILD_TYPE         0x444C4942
 
+/* Largest untiled image and largest tile, keeps the buffer sizes within int */
+#define BILD_MAX_PIXELS   (1 << 28)
+
+/* A tiled image is only held a tile at a time. Its sides are limited to
+ * keep rows and coordinates within int, the number of tiles to keep the
+ * tile index small. */
+#define BILD_MAX_TILED_SIZE (1 << 20)
+#define BILD_MAX_TILE_COUNT (1 << 24)
+
+/* Levels of the widest image, a row of BILD_MAX_PIXELS */
+#define BILD_MAX_LEVELS   28
+
 #pragma pack(push, 1)
 
 struct tBILDHeader
@@ -43,6 +61,44 @@ struct tBILDHeader
   uint32_t width;           /* Width of the image in pixels */
   uint32_t height;          /* Height of the image in pixels */
   uint32_t quality;         /* Quality parameter */
+  uint8_t coder;            /* Entropy coder, see EntropyCoderID */
+  uint32_t tile_size;       /* Width and height of the tiles, 0 if not tiled */
+};
+
+/* After the BILDHeader follow the headers of the three channels, each a
+ * BILDLevelsHeader and a BILDLevelHeader per level (finest first). Every
+ * level is coded on its own, except for the coarsest ones: levels without
+ * coded data are coded together with the finer levels up to the next one
+ * that has, so that a segment holds at least BILD_MIN_SEGMENT_SIZE
+ * coefficients. The segments are stored coarsest first, level n of all
+ * channels before level n-1, so a prefix of the file is enough to decode
+ * the image at a smaller scale. */
+
+#define BILD_MIN_SEGMENT_SIZE 4096
+
+/* A level with a segment of its own is split into blocks of block_rows rows
+ * of its three subbands, each holding at least BILD_MIN_BLOCK_SIZE
+ * coefficients. Blocks are coded independently, so a region is decoded
+ * from the blocks under it. Such a segment starts with a BILDBlockHeader
+ * per block, followed by the blocks. */
+
+#define BILD_MIN_BLOCK_SIZE 16384
+
+struct tBILDBlockHeader
+{
+  uint32_t coded_size;      /* Size of the coded block in bytes */
+  uint32_t overflow_size;   /* Number of overflow values after the coded block */
+};
+
+/* A tiled image has no channels of its own. The BILDHeader is followed by a
+ * BILDTileHeader per tile, row by row, and every tile is stored as an
+ * untiled BILD image of the same quality and coder. Tiles start at even
+ * coordinates, so the chroma planes of lossy images split along the same
+ * lines. */
+struct tBILDTileHeader
+{
+  uint64_t offset;          /* Position of the tile in the file, which may pass 4 GB */
+  uint32_t size;            /* Size of the coded tile in bytes */
 };
 
 struct tBILDLevelsHeader
@@ -51,8 +107,6 @@ struct tBILDLevelsHeader
   uint32_t level_count;
   uint32_t width;
   uint32_t height;
-  uint32_t coded_size;      /* Size of the coded levels in bytes */
-  uint32_t overflow_buffer_size; /* Size of overflow buffer */
 };
 
 struct tBILDLevelHeader
@@ -65,6 +119,10 @@ struct tBILDLevelHeader
   uint32_t hh_height;
   uint32_t ll_width;
   uint32_t ll_height;
+  uint32_t offset;          /* Position of the coded level in the file */
+  uint32_t coded_size;      /* Size of the coded subbands in bytes */
+  uint32_t overflow_size;   /* Number of overflow values after the coded subbands */
+  uint32_t block_rows;      /* Rows per block, 0 if the level is not split */
 };
 
 #pragma pack(pop)
@@ -72,10 +130,56 @@ struct tBILDLevelHeader
 typedef struct tBILDHeader BILDHeader;
 typedef struct tBILDLevelsHeader BILDLevelsHeader;
 typedef struct tBILDLevelHeader BILDLevelHeader;
+typedef struct tBILDTileHeader BILDTileHeader;
+typedef struct tBILDBlockHeader BILDBlockHeader;
+
+/* Stages of the last image, colour is the colour (or plane) transform,
+ * transform the wavelet transform and coding the entropy coding. A last
+ * level that writes the pixels counts as transform. Tiles are coded in
+ * parallel, the stages of a tiled image are the sums over its tiles. */
+struct tBILDStages
+{
+  Stage colour;
+  Stage transform;
+  Stage coding;
+};
+typedef struct tBILDStages BILDStages;
+
+/* The channels of image are used as scratch space. The coded image belongs
+ * to the encoder and is valid until its next use. */
+BILDStatus BILDEncoderEncodeImage(BILDEncoder *encoder, Image *image, const int quality, const EntropyCoderID coder,
+                                  const byte **coded_data, size_t *coded_size);
+const BILDStages* BILDEncoderStages(const BILDEncoder *encoder);
 
-Image *ImageLoadFromBILDFileAndCreate(const char *filename);
-void ImageSaveAsBILDFile(Image *image, const char *filename, const int quality);
+/* Allocates every image on the heap, the caller releases it with ImageDestroy */
+BILDDecoder* BILDDecoderCreateOnHeap(void);
+
+/* See BILDDecodeRegion for scale and region. Unless created on the heap, the image belongs to the decoder and
+ * is valid until its next use */
+BILDStatus BILDDecoderDecodeImage(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size, const int scale,
+                                  const BILDRect *region, Image **image);
+const BILDStages* BILDDecoderStages(const BILDDecoder *decoder);
+
+/* Subbands of a level */
+enum tBILDBand { BILDBandLH = 0, BILDBandHL, BILDBandHH, BILDBandCount };
+typedef enum tBILDBand BILDBand;
+
+/* Statistics of a subband of a coded image */
+struct tBILDSubbandStats
+{
+  int64_t count;            /* Coefficients */
+  int64_t zero_count;
+  int64_t escape_count;     /* Coefficients pack32_8 sends to the overflow values */
+  int64_t rle_size;         /* Bytes of the packed coefficients run length coded on their own */
+  uint32_t histogram[BYTE_MAX+1];     /* Of the packed coefficients */
+  uint32_t rle_histogram[BYTE_MAX+1]; /* Of their run length coding */
+};
+typedef struct tBILDSubbandStats BILDSubbandStats;
 
-void BILDPrintInformation(const char *filename);
+/* Statistics of the subbands of every channel and level (finest first) of a
+ * coded image, for tiled images added up over the tiles. *level_count is
+ * the number of levels of the largest channel, stats is zeroed first. */
+BILDStatus BILDDecoderSubbandStats(BILDDecoder *decoder, const byte *coded_data, const size_t coded_size,
+                                   BILDSubbandStats stats[3][BILD_MAX_LEVELS][BILDBandCount], int *level_count);
 
 #endif
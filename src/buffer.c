@@ -0,0 +1,84 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buffer.h"
+
+Buffer* BufferCreate(const size_t capacity)
+{
+
+  Buffer *buffer = HeapAlloc(sizeof(Buffer));
+
+  if (!buffer) return NULL;
+
+  buffer->size = 0;
+  buffer->capacity = MAX(capacity, (size_t)64);
+  buffer->data = HeapAlloc(buffer->capacity);
+
+  if (!buffer->data)
+  {
+    free(buffer);
+    return NULL;
+  }
+
+  return buffer;
+
+}
+
+void BufferDestroy(Buffer *buffer)
+{
+
+  if (!buffer) return;
+
+  free(buffer->data);
+
+  free(buffer);
+
+}
+
+byte* BufferReserve(Buffer *buffer, const size_t size)
+{
+
+  if (buffer->size+size > buffer->capacity)
+  {
+
+    const size_t capacity = MAX(buffer->capacity << 1, buffer->size+size);
+    byte *data = HeapRealloc(buffer->data, capacity);
+
+    if (!data) return NULL;
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+  }
+
+  return &buffer->data[buffer->size];
+
+}
+
+bool BufferWrite(Buffer *buffer, const void *data, const size_t size)
+{
+
+  byte *target = BufferReserve(buffer, size);
+
+  if (!target) return false;
+
+  memcpy(target, data, size);
+  buffer->size += size;
+
+  return true;
+
+}
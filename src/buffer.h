@@ -0,0 +1,46 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "heap.h"
+
+/* Growable byte buffer */
+struct tBuffer
+{
+  byte *data;
+  size_t size;
+  size_t capacity;
+};
+typedef struct tBuffer Buffer;
+
+/* NULL if out of memory */
+Buffer* BufferCreate(const size_t capacity);
+void BufferDestroy(Buffer *buffer);
+
+/* Makes room for size more bytes and returns a pointer to them, NULL if out
+ * of memory, the buffer is then left as it was */
+byte* BufferReserve(Buffer *buffer, const size_t size);
+bool BufferWrite(Buffer *buffer, const void *data, const size_t size);
+
+#endif
@@ -0,0 +1,153 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "cpu.h"
+#include "huffman.h"
+
+static int p_DecomposeRowPairScalar(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param) { return 0; }
+static int p_ReconstructRowPairScalar(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param) { return 0; }
+static int p_ColourScalar(sample *c0, sample *c1, sample *c2, const int count) { return 0; }
+static int p_RGB8ToYCbCrRowPairScalar(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr) { return 0; }
+static int p_YCbCrToPixelsRowScalar(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format) { return 0; }
+static int p_Downsample2RowPairScalar(const sample *row0, const sample *row1, const int count, sample *row) { return 0; }
+static int p_Upsample2RowScalar(const sample *src, const int count, sample *row0, sample *row1) { return 0; }
+static int p_Pack8Scalar(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos) { return 0; }
+
+static const Kernels p_kernels[] =
+{
+  { /* CPUScalar */
+    p_DecomposeRowPairScalar, p_ReconstructRowPairScalar,
+    p_ColourScalar, p_ColourScalar,
+    p_RGB8ToYCbCrRowPairScalar, p_YCbCrToPixelsRowScalar,
+    p_Downsample2RowPairScalar, p_Upsample2RowScalar,
+    p_Pack8Scalar, huffman_histogram
+  },
+  { /* CPUSSE41 */
+    DecomposeRowPairSSE41, ReconstructRowPairSSE41,
+    RGBToYCbCrSSE41, YCbCrToRGBSSE41,
+    RGB8ToYCbCrRowPairSSE41, YCbCrToPixelsRowSSE41,
+    Downsample2RowPairSSE41, Upsample2RowSSE41,
+    Pack8SSE41, HistogramSSE41
+  },
+  { /* CPUAVX2 */
+    DecomposeRowPairAVX2, ReconstructRowPairAVX2,
+    RGBToYCbCrAVX2, YCbCrToRGBAVX2,
+    RGB8ToYCbCrRowPairAVX2, YCbCrToPixelsRowAVX2,
+    Downsample2RowPairAVX2, Upsample2RowAVX2,
+    Pack8AVX2, HistogramSSE41
+  },
+  { /* CPUAVX512 */
+    DecomposeRowPairAVX512, ReconstructRowPairAVX512,
+    RGBToYCbCrAVX512, YCbCrToRGBAVX512,
+    RGB8ToYCbCrRowPairAVX512, YCbCrToPixelsRowAVX512,
+    Downsample2RowPairAVX512, Upsample2RowAVX512,
+    Pack8AVX512, HistogramSSE41
+  }
+};
+
+static const char *p_level_names[] = { "scalar", "sse4.1", "avx2", "avx512" };
+
+Kernels kernels =
+{
+  p_DecomposeRowPairScalar, p_ReconstructRowPairScalar,
+  p_ColourScalar, p_ColourScalar,
+  p_RGB8ToYCbCrRowPairScalar, p_YCbCrToPixelsRowScalar,
+  p_Downsample2RowPairScalar, p_Upsample2RowScalar,
+  p_Pack8Scalar, huffman_histogram
+};
+
+static CPULevel p_level = CPUScalar;
+static bool p_level_set = false;
+static pthread_once_t p_init_once = PTHREAD_ONCE_INIT;
+
+CPULevel CPUDetectLevel(void)
+{
+
+  __builtin_cpu_init();
+
+#ifdef BILD_WIDE_SAMPLES
+  if (__builtin_cpu_supports("avx512f")) return CPUAVX512;
+#else
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return CPUAVX512;
+#endif
+  if (__builtin_cpu_supports("avx2")) return CPUAVX2;
+  if (__builtin_cpu_supports("sse4.1")) return CPUSSE41;
+
+  return CPUScalar;
+
+}
+
+bool CPUSetLevel(const CPULevel level)
+{
+
+  if (level > CPUDetectLevel()) return false;
+
+  kernels = p_kernels[level];
+  p_level = level;
+  p_level_set = true;
+
+  return true;
+
+}
+
+CPULevel CPUGetLevel(void)
+{
+
+  return p_level;
+
+}
+
+static void p_Init(void)
+{
+
+  if (!p_level_set) CPUSetLevel(CPUDetectLevel());
+
+}
+
+void CPUInit(void)
+{
+
+  /* Encoders and decoders may be created on several threads at once */
+  pthread_once(&p_init_once, p_Init);
+
+}
+
+const char* CPULevelName(const CPULevel level)
+{
+
+  return p_level_names[level];
+
+}
+
+bool CPUParseLevel(const char *name, CPULevel *level)
+{
+
+  int i;
+  for (i = CPUScalar; i <= CPUAVX512; ++i)
+  {
+    if (strcmp(name, p_level_names[i]) == 0)
+    {
+      *level = i;
+      return true;
+    }
+  }
+
+  return false;
+
+}
@@ -0,0 +1,67 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "simd.h"
+
+/* Kernel sets, each level includes the instruction sets of the ones below */
+enum tCPULevel { CPUScalar = 0, CPUSSE41, CPUAVX2, CPUAVX512 };
+typedef enum tCPULevel CPULevel;
+
+/* Hot kernels dispatched at runtime. Every kernel returns the number of
+ * elements it handled (a scalar entry handles none), the caller does the
+ * rest with its scalar loop. See simd.h for the individual contracts. */
+struct tKernels
+{
+  int (*decompose_row_pair)(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param);
+  int (*reconstruct_row_pair)(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param);
+  int (*rgb_to_ycbcr)(sample *c0, sample *c1, sample *c2, const int count);
+  int (*ycbcr_to_rgb)(sample *c0, sample *c1, sample *c2, const int count);
+  int (*rgb8_to_ycbcr_row_pair)(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr);
+  int (*ycbcr_to_pixels_row)(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format);
+  int (*downsample2_row_pair)(const sample *row0, const sample *row1, const int count, sample *row);
+  int (*upsample2_row)(const sample *src, const int count, sample *row0, sample *row1);
+  int (*pack8)(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos);
+  void (*histogram)(const byte *data, const int size, uint32_t *histogram);
+};
+typedef struct tKernels Kernels;
+
+extern Kernels kernels;
+
+/* Highest level supported by the running CPU */
+CPULevel CPUDetectLevel(void);
+
+/* Selects the kernel set of a level, fails if the CPU does not support it */
+bool CPUSetLevel(const CPULevel level);
+CPULevel CPUGetLevel(void);
+
+/* Selects the detected level unless a level has been set before, once
+ * however many threads call it. CPUSetLevel is not synchronised and has to
+ * be called before encoders or decoders are created. */
+void CPUInit(void);
+
+const char* CPULevelName(const CPULevel level);
+bool CPUParseLevel(const char *name, CPULevel *level);
+
+#endif
@@ -20,7 +20,10 @@
 Level1D* Level1DCreate(const int l_size, Signal1D *h)
 {
 
-  Level1D *level = malloc(sizeof(Level1D));
+  Level1D *level = HeapAlloc(sizeof(Level1D));
+
+  if (!level) return NULL;
+
   level->l_size = l_size;
   level->h = h;
   return level;
@@ -30,6 +33,8 @@ Level1D* Level1DCreate(const int l_size, Signal1D *h)
 void Level1DDestroy(Level1D *level)
 {
 
+  if (!level) return;
+
   Signal1DDestroy(level->h);
   free(level);
 
@@ -38,10 +43,22 @@ void Level1DDestroy(Level1D *level)
 Levels1D* Levels1DCreate(const int level_count, const int size)
 {
 
-  Levels1D *levels = malloc(sizeof(Levels1D));
+  Levels1D *levels = HeapAlloc(sizeof(Levels1D));
+
+  if (!levels) return NULL;
+
   levels->level_count = level_count;
-  levels->levels = malloc(sizeof(Levels1D*)*level_count);
+  levels->levels = HeapAlloc(sizeof(Levels1D*)*level_count);
   levels->size = size;
+
+  if (!levels->levels)
+  {
+    free(levels);
+    return NULL;
+  }
+
+  memset(levels->levels, 0, sizeof(Levels1D*)*level_count);
+
   return levels;
 
 }
@@ -59,7 +76,7 @@ void Levels1DDestroy(Levels1D *levels)
 
 }
 
-void DecomposeLevel1D(int32_t *source, const int source_size, Signal1D *l, Signal1D *h)
+void DecomposeLevel1D(sample *source, const int source_size, Signal1D *l, Signal1D *h)
 {
 
   const bool odd_size = source_size % 2;
@@ -86,6 +103,8 @@ Levels1D* Decompose1D(Signal1D *signal0)
 
   Levels1D *levels = Levels1DCreate(level_count, signal->size);
 
+  if (!levels) return NULL;
+
   int s0, sb;
   int s1 = signal->size;
 
@@ -103,7 +122,15 @@ Levels1D* Decompose1D(Signal1D *signal0)
     s0 = sb >> 1;
     s1 = (sb+1) >> 1;
 
-    level = Level1DCreate(s1, Signal1DCreate(odd_size?s1:s0));
+    Signal1D *h = Signal1DCreate(odd_size?s1:s0);
+    level = h ? Level1DCreate(s1, h) : NULL;
+
+    if (!level)
+    {
+      Signal1DDestroy(h);
+      Levels1DDestroy(levels);
+      return NULL;
+    }
 
     DecomposeLevel1D(signal->data, sb, signal, level->h);
 
@@ -120,7 +147,7 @@ Levels1D* Decompose1D(Signal1D *signal0)
 
 }
 
-void ReconstructLevel1D(int32_t *target, const int target_size, Signal1D *l, Signal1D *h)
+void ReconstructLevel1D(sample *target, const int target_size, Signal1D *l, Signal1D *h)
 {
 
   const bool odd_size = target_size % 2;
@@ -142,7 +169,14 @@ Signal1D* reconstruct1D(Levels1D *levels)
 
   Signal1D *l_src = Signal1DCreate(0);
 
-  int32_t *l_trg;
+  if ((!signal) || (!l_src))
+  {
+    Signal1DDestroy(signal);
+    Signal1DDestroy(l_src);
+    return NULL;
+  }
+
+  sample *l_trg;
   int l_trg_size;
 
   if (level_n % 2)
@@ -184,15 +218,40 @@ Signal1D* reconstruct1D(Levels1D *levels)
 }
 
 
-Level2D* Level2DCreate(const int ll_width, const int ll_height, Signal2D *lh, Signal2D *hl, Signal2D *hh)
+Level2D* Level2DCreate(Arena *arena, const int ll_width, const int ll_height, Signal2D *lh, Signal2D *hl, Signal2D *hh)
 {
 
-  Level2D *level = malloc(sizeof(Level2D));
+  Level2D *level = ArenaAlloc(arena, sizeof(Level2D));
+
+  if (!level) return NULL;
+
   level->ll_width = ll_width;
   level->ll_height = ll_height;
   level->lh = lh;
   level->hl = hl;
   level->hh = hh;
+  level->arena = arena;
+  return level;
+
+}
+
+Level2D* Level2DCreateSubbands(Arena *arena, const int ll_width, const int ll_height, const int lh_width, const int lh_height,
+                               const int hl_width, const int hl_height, const int hh_width, const int hh_height)
+{
+
+  Signal2D *lh = Signal2DCreateInArena(arena, lh_width, lh_height);
+  Signal2D *hl = Signal2DCreateInArena(arena, hl_width, hl_height);
+  Signal2D *hh = Signal2DCreateInArena(arena, hh_width, hh_height);
+
+  Level2D *level = (lh && hl && hh) ? Level2DCreate(arena, ll_width, ll_height, lh, hl, hh) : NULL;
+
+  if (!level)
+  {
+    Signal2DDestroy(lh);
+    Signal2DDestroy(hl);
+    Signal2DDestroy(hh);
+  }
+
   return level;
 
 }
@@ -200,22 +259,38 @@ Level2D* Level2DCreate(const int ll_width, const int ll_height, Signal2D *lh, Si
 void Level2DDestroy(Level2D *level)
 {
 
+  if (!level) return;
+
   Signal2DDestroy(level->lh);
   Signal2DDestroy(level->hl);
   Signal2DDestroy(level->hh);
 
-  free(level);
+  ArenaFree(level->arena, level);
 
 }
 
-Levels2D* Levels2DCreate(const int level_count, const int width, const int height)
+Levels2D* Levels2DCreate(Arena *arena, const int level_count, const int width, const int height)
 {
 
-  Levels2D *levels = malloc(sizeof(Levels2D));
+  Levels2D *levels = ArenaAlloc(arena, sizeof(Levels2D));
+
+  if (!levels) return NULL;
+
   levels->level_count = level_count;
-  levels->levels = malloc(sizeof(Level2D*)*level_count);
+  levels->levels = ArenaAlloc(arena, sizeof(Level2D*)*level_count);
+  levels->arena = arena;
   levels->width = width;
   levels->height = height;
+
+  if (!levels->levels)
+  {
+    ArenaFree(arena, levels);
+    return NULL;
+  }
+
+  /* Levels not created yet are left out by Levels2DDestroy */
+  memset(levels->levels, 0, sizeof(Level2D*)*level_count);
+
   return levels;
 
 }
@@ -223,83 +298,154 @@ Levels2D* Levels2DCreate(const int level_count, const int width, const int heigh
 void Levels2DDestroy(Levels2D *levels)
 {
 
+  if (!levels) return;
+
   int i;
   for (i = 0; i < levels->level_count; ++i)
     Level2DDestroy(levels->levels[i]);
 
-  free(levels->levels);
+  ArenaFree(levels->arena, levels->levels);
 
-  free(levels);
+  ArenaFree(levels->arena, levels);
 
 }
 
-void DecomposeLevel2D(int32_t *source, const int source_width, const int source_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param)
+/* Bands of row pairs processed by the thread pool. Subband rows are written
+ * at offsets computed from the row index, so the bands are independent. */
+struct tBands2D
+{
+  sample *data;            /* Source when decomposing, target when reconstructing */
+  int width;
+  int row_pairs;
+  int band_count;
+  Signal2D *ll;
+  Signal2D *lh;
+  Signal2D *hl;
+  Signal2D *hh;
+  int quant_param;
+};
+typedef struct tBands2D Bands2D;
+
+/* Levels below this size are not worth splitting */
+#define MIN_BAND_PIXELS (1 << 15)
+
+static int p_BandCount(const int width, const int row_pairs)
 {
 
-  const bool odd_width = source_width % 2;
-  const bool odd_height = source_height % 2;
+  const int max_bands = MIN(row_pairs, (width*row_pairs*2)/MIN_BAND_PIXELS);
 
-  int32_t *row0 = source;
-  int32_t *row1 = source+source_width;
+  return MAX(MIN(ThreadPoolThreadCount(), max_bands), 1);
 
-  int i, j;
-  for (i = 0; i < (source_height>>1); ++i)
+}
+
+void DecomposeRowPair(sample *row0, sample *row1, const int source_width, sample *ll, sample *lh, sample *hl, sample *hh,
+                      const int quant_param)
+{
+
+  const int w0 = source_width >> 1;
+
+  int j = kernels.decompose_row_pair(row0, row1, w0, ll, lh, hl, hh, quant_param);
+
+  for (; j < w0; ++j)
   {
 
-    for (j = 0; j < (source_width>>1); ++j)
-    {
+    HaarForwardTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
+    HaarForwardTransform(row1[j<<1], row1[(j<<1)+1], &row1[j<<1], &row1[(j<<1)+1]);
+    HaarForwardTransform(row0[j<<1], row1[j<<1], &row0[j<<1], &row1[j<<1]);
+    HaarForwardTransform(row0[(j<<1)+1], row1[(j<<1)+1], &row0[(j<<1)+1], &row1[(j<<1)+1]);
 
-      HaarForwardTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
-      HaarForwardTransform(row1[j<<1], row1[(j<<1)+1], &row1[j<<1], &row1[(j<<1)+1]);
-      HaarForwardTransform(row0[j<<1], row1[j<<1], &row0[j<<1], &row1[j<<1]);
-      HaarForwardTransform(row0[(j<<1)+1], row1[(j<<1)+1], &row0[(j<<1)+1], &row1[(j<<1)+1]);
+    ll[j] = row0[j<<1];
+    hl[j] = quantize(row1[j<<1], quant_param);
+    lh[j] = quantize(row0[(j<<1)+1], quant_param);
+    hh[j] = quantize(row1[(j<<1)+1], quant_param);
 
-      ll->data[ll->data_pos++] = row0[j<<1];
-      hl->data[hl->data_pos++] = quantize(row1[j<<1], quant_param);
-      lh->data[lh->data_pos++] = quantize(row0[(j<<1)+1], quant_param);
-      hh->data[hh->data_pos++] = quantize(row1[(j<<1)+1], quant_param);
+  }
 
-    }
+  if (source_width % 2)
+  {
 
-    if (odd_width)
-    {
+    HaarForwardTransform(row0[source_width-1], row1[source_width-1], &row0[source_width-1], &row1[source_width-1]);
+    ll[w0] = row0[source_width-1];
+    hl[w0] = quantize(row1[source_width-1], quant_param);
 
-      HaarForwardTransform(row0[source_width-1], row1[source_width-1], &row0[source_width-1], &row1[source_width-1]);
-      ll->data[ll->data_pos++] = row0[source_width-1];
-      hl->data[hl->data_pos++] = quantize(row1[source_width-1], quant_param);
+  }
 
-    }
+}
 
-    row0 += (source_width << 1);
-    row1 += (source_width << 1);
+void DecomposeLastRow(sample *row0, const int source_width, sample *ll, sample *lh, const int quant_param)
+{
 
+  int j;
+  for (j = 0; j < (source_width>>1); ++j)
+  {
+    HaarForwardTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
+    ll[j] = row0[j<<1];
+    lh[j] = quantize(row0[(j<<1)+1], quant_param);
   }
 
-  if (odd_height)
+  if (source_width % 2)
+    ll[j] = row0[source_width-1];
+
+}
+
+static void p_DecomposeBand(void *context, const int band)
+{
+
+  Bands2D *bands = context;
+
+  const int source_width = bands->width;
+  const int w0 = source_width >> 1;
+  const int w1 = (source_width+1) >> 1;
+  const int hl_width = (source_width % 2) ? w1 : w0;
+
+  const int first = (int)(((int64_t)band*bands->row_pairs)/bands->band_count);
+  const int last = (int)(((int64_t)(band+1)*bands->row_pairs)/bands->band_count);
+
+  sample *row0;
+
+  int i;
+  for (i = first; i < last; ++i)
   {
 
-    for (j = 0; j < (source_width>>1); ++j)
-    {
-      HaarForwardTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
-      ll->data[ll->data_pos++] = row0[j<<1];
-      lh->data[lh->data_pos++] = quantize(row0[(j<<1)+1], quant_param);
-    }
+    row0 = bands->data+(i<<1)*source_width;
 
-    if (odd_width)
-      ll->data[ll->data_pos++] = row0[source_width-1];
+    DecomposeRowPair(row0, row0+source_width, source_width, bands->ll->data+i*w1, bands->lh->data+i*w0,
+                     bands->hl->data+i*hl_width, bands->hh->data+i*w0, bands->quant_param);
 
   }
 
 }
 
-Levels2D* Decompose2D(Signal2D *signal0, const int quant_param)
+void DecomposeLevel2D(sample *source, const int source_width, const int source_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param)
+{
+
+  Bands2D bands;
+  bands.data = source;
+  bands.width = source_width;
+  bands.row_pairs = source_height >> 1;
+  bands.band_count = p_BandCount(source_width, bands.row_pairs);
+  bands.ll = ll;
+  bands.lh = lh;
+  bands.hl = hl;
+  bands.hh = hh;
+  bands.quant_param = quant_param;
+
+  ThreadPoolParallelFor(bands.band_count, p_DecomposeBand, &bands);
+
+  if (source_height % 2)
+    DecomposeLastRow(source+(source_height-1)*source_width, source_width, ll->data+bands.row_pairs*((source_width+1)>>1),
+                     lh->data+bands.row_pairs*(source_width>>1), quant_param);
+
+}
+
+Levels2D* Decompose2D(Signal2D *signal0, const int quant_param, Arena *arena)
 {
 
   Signal2D *signal = signal0;
 
   const int level_count = ilog2(get_next_pow(MAX(signal->width, signal->height)));
 
-  Levels2D *levels = Levels2DCreate(level_count, signal->width, signal->height);
+  Levels2D *levels = Levels2DCreate(arena, level_count, signal->width, signal->height);
 
   int w1 = signal->width;
   int h1 = signal->height;
@@ -307,7 +453,23 @@ Levels2D* Decompose2D(Signal2D *signal0, const int quant_param)
 
   bool odd_width, odd_height;
 
-  int q = quant_param;
+  /* The coarsest level is left unquantized, as Levels2DQuantParam expects,
+   * so small signals are coded at quant_param level_count-1 at most */
+  int q = MIN(quant_param, MAX(level_count-1, 0));
+
+  /* The LL band of a level is written to the other buffer and becomes the
+   * source of the next level */
+  Signal2D *scratch = Signal2DCreateInArena(arena, (w1+1) >> 1, (h1+1) >> 1);
+
+  if ((!levels) || (!scratch))
+  {
+    Levels2DDestroy(levels);
+    Signal2DDestroy(scratch);
+    return NULL;
+  }
+
+  Signal2D ll;
+  sample *source = signal->data;
 
   Level2D *level;
   int level_n = 0;
@@ -325,17 +487,23 @@ Levels2D* Decompose2D(Signal2D *signal0, const int quant_param)
     w0 = wb >> 1;
     h0 = hb >> 1;
 
-    level = Level2DCreate(w1, h1,
-                          Signal2DCreate(w0, odd_height?h1:h0),
-                          Signal2DCreate(odd_width?w1:w0, h0),
-                          Signal2DCreate(w0, h0));
+    level = Level2DCreateSubbands(arena, w1, h1, w0, odd_height?h1:h0, odd_width?w1:w0, h0, w0, h0);
 
-    DecomposeLevel2D(signal->data, wb, hb, signal, level->lh, level->hl, level->hh, q);
+    if (!level)
+    {
+      Levels2DDestroy(levels);
+      Signal2DDestroy(scratch);
+      return NULL;
+    }
 
-    signal->data_pos = 0;
-    level->lh->data_pos = 0;
-    level->hl->data_pos = 0;
-    level->hh->data_pos = 0;
+    ll.width = w1;
+    ll.height = h1;
+    ll.data = (source == signal->data) ? scratch->data : signal->data;
+    ll.data_pos = 0;
+
+    DecomposeLevel2D(source, wb, hb, &ll, level->lh, level->hl, level->hh, q);
+
+    source = ll.data;
 
     levels->levels[level_n++] = level;
 
@@ -343,103 +511,299 @@ Levels2D* Decompose2D(Signal2D *signal0, const int quant_param)
 
   }
 
-  levels->root_value = signal->data[0];
+  levels->root_value = source[0];
+
+  Signal2DDestroy(scratch);
 
   return levels;
 
 }
 
-void ReconstructLevel2D(int32_t *target, const int target_width, const int target_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param)
+/* Rows of level n in LineDecomposition2D.rows */
+#define LINE_ROWS 5
+
+LineDecomposition2D* LineDecomposition2DCreate(Arena *arena, const int width, const int height, const int quant_param,
+                                               SubbandRowsFunction emit, void *context)
 {
 
-  const bool odd_width = target_width % 2;
-  const bool odd_height = target_height % 2;
+  const int level_count = ilog2(get_next_pow(MAX(width, height)));
 
-  int32_t *row0 = target;
-  int32_t *row1 = target+target_width;
+  LineDecomposition2D *decomposition = ArenaAlloc(arena, sizeof(LineDecomposition2D));
 
-  int i, j;
-  for (i = 0; i < (target_height>>1); ++i)
+  if (!decomposition) return NULL;
+
+  decomposition->level_count = level_count;
+  decomposition->widths = ArenaAlloc(arena, (level_count+1)*sizeof(int));
+  decomposition->heights = ArenaAlloc(arena, (level_count+1)*sizeof(int));
+  decomposition->row_counts = ArenaAlloc(arena, (level_count+1)*sizeof(int));
+  decomposition->rows = ArenaAlloc(arena, level_count*LINE_ROWS*sizeof(sample*));
+  decomposition->quant_param = MIN(quant_param, MAX(level_count-1, 0)); /* As in Decompose2D */
+  decomposition->root_value = 0;
+  decomposition->emit = emit;
+  decomposition->context = context;
+  decomposition->arena = arena;
+
+  if ((!decomposition->widths) || (!decomposition->heights) || (!decomposition->row_counts) || (!decomposition->rows))
+    return NULL;
+
+  int w = width;
+  int h = height;
+
+  int i, n;
+  for (n = 0; n <= level_count; ++n)
   {
 
-    for (j = 0; j < (target_width>>1); ++j)
+    decomposition->widths[n] = w;
+    decomposition->heights[n] = h;
+    decomposition->row_counts[n] = 0;
+
+    if (n < level_count)
     {
-      HaarInverseTransform(ll->data[ll->data_pos++], dequantize(hl->data[hl->data_pos++], quant_param), &row0[j<<1], &row1[j<<1]);
-      HaarInverseTransform(dequantize(lh->data[lh->data_pos++], quant_param), dequantize(hh->data[hh->data_pos++], quant_param), &row0[(j<<1)+1], &row1[(j<<1)+1]);
-      HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
-      HaarInverseTransform(row1[j<<1], row1[(j<<1)+1], &row1[j<<1], &row1[(j<<1)+1]);
+      decomposition->rows[n*LINE_ROWS] = ArenaAlloc(arena, w*sizeof(sample));
+      decomposition->rows[n*LINE_ROWS+1] = ArenaAlloc(arena, ((w+1) >> 1)*sizeof(sample));
+      decomposition->rows[n*LINE_ROWS+2] = ArenaAlloc(arena, (w >> 1)*sizeof(sample));
+      decomposition->rows[n*LINE_ROWS+3] = ArenaAlloc(arena, ((w+1) >> 1)*sizeof(sample));
+      decomposition->rows[n*LINE_ROWS+4] = ArenaAlloc(arena, (w >> 1)*sizeof(sample));
+
+      for (i = n*LINE_ROWS; i < (n+1)*LINE_ROWS; ++i)
+        if (!decomposition->rows[i]) return NULL;
     }
 
-    if (odd_width)
-      HaarInverseTransform(ll->data[ll->data_pos++], hl->data[hl->data_pos++], &row0[target_width-1], &row1[target_width-1]);
+    w = (w+1) >> 1;
+    h = (h+1) >> 1;
+
+  }
 
-    row0 += (target_width << 1);
-    row1 += (target_width << 1);
+  return decomposition;
+
+}
+
+void LineDecomposition2DDestroy(LineDecomposition2D *decomposition)
+{
+
+  if (!decomposition) return;
+
+  Arena *arena = decomposition->arena;
+
+  int i;
+  for (i = 0; i < decomposition->level_count*LINE_ROWS; ++i)
+    ArenaFree(arena, decomposition->rows[i]);
+
+  ArenaFree(arena, decomposition->rows);
+  ArenaFree(arena, decomposition->row_counts);
+  ArenaFree(arena, decomposition->heights);
+  ArenaFree(arena, decomposition->widths);
+  ArenaFree(arena, decomposition);
+
+}
 
+/* Passes row to level n, or sets the root value past the last level */
+static void p_PushRow(LineDecomposition2D *decomposition, const int n, sample *row)
+{
+
+  if (n == decomposition->level_count)
+  {
+    decomposition->root_value = row[0];
+    return;
   }
 
-  if (odd_height)
+  const int width = decomposition->widths[n];
+  const int r = decomposition->row_counts[n]++;
+  const int quant_param = MAX(decomposition->quant_param-n, 0);
+
+  sample **rows = &decomposition->rows[n*LINE_ROWS];
+
+  if (r % 2)
+  {
+    DecomposeRowPair(rows[0], row, width, rows[1], rows[2], rows[3], rows[4], quant_param);
+    decomposition->emit(decomposition->context, n, r >> 1, rows[2], rows[3], rows[4]);
+  }
+  else if (r+1 < decomposition->heights[n])
+  {
+    memcpy(rows[0], row, width*sizeof(sample));
+    return;
+  }
+  else
   {
+    DecomposeLastRow(row, width, rows[1], rows[2], quant_param);
+    decomposition->emit(decomposition->context, n, r >> 1, rows[2], NULL, NULL);
+  }
 
-    for (j = 0; j < (target_width>>1); ++j)
-    {
-      row0[j<<1] = ll->data[ll->data_pos++];
-      row0[(j<<1)+1] = lh->data[lh->data_pos++];
-      HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
-    }
+  p_PushRow(decomposition, n+1, rows[1]);
 
-    if (odd_width)
-      row0[target_width-1] = ll->data[ll->data_pos++];
+}
 
+void LineDecomposition2DPushRow(LineDecomposition2D *decomposition, sample *row)
+{
+
+  p_PushRow(decomposition, 0, row);
+
+}
+
+void ReconstructRowPair(sample *row0, sample *row1, const int target_width, const sample *ll, const sample *lh,
+                        const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const int w0 = target_width >> 1;
+
+  int j = kernels.reconstruct_row_pair(row0, row1, w0, ll, lh, hl, hh, quant_param);
+
+  for (; j < w0; ++j)
+  {
+    HaarInverseTransform(ll[j], dequantize(hl[j], quant_param), &row0[j<<1], &row1[j<<1]);
+    HaarInverseTransform(dequantize(lh[j], quant_param), dequantize(hh[j], quant_param), &row0[(j<<1)+1], &row1[(j<<1)+1]);
+    HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
+    HaarInverseTransform(row1[j<<1], row1[(j<<1)+1], &row1[j<<1], &row1[(j<<1)+1]);
+  }
+
+  if (target_width % 2)
+    HaarInverseTransform(ll[w0], hl[w0], &row0[target_width-1], &row1[target_width-1]);
+
+}
+
+void ReconstructLastRow(sample *row0, const int target_width, const sample *ll, const sample *lh)
+{
+
+  int j;
+  for (j = 0; j < (target_width>>1); ++j)
+  {
+    row0[j<<1] = ll[j];
+    row0[(j<<1)+1] = lh[j];
+    HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
   }
 
+  if (target_width % 2)
+    row0[target_width-1] = ll[j];
+
 }
 
-Signal2D* Reconstruct2D(Levels2D *levels, const int quant_param)
+static void p_ReconstructBand(void *context, const int band)
 {
 
+  Bands2D *bands = context;
+
+  const int target_width = bands->width;
+  const int w0 = target_width >> 1;
+  const int w1 = (target_width+1) >> 1;
+  const int hl_width = (target_width % 2) ? w1 : w0;
+
+  const int first = (int)(((int64_t)band*bands->row_pairs)/bands->band_count);
+  const int last = (int)(((int64_t)(band+1)*bands->row_pairs)/bands->band_count);
+
+  sample *row0;
+
+  int i;
+  for (i = first; i < last; ++i)
+  {
+
+    row0 = bands->data+(i<<1)*target_width;
+
+    ReconstructRowPair(row0, row0+target_width, target_width, bands->ll->data+i*w1, bands->lh->data+i*w0,
+                       bands->hl->data+i*hl_width, bands->hh->data+i*w0, bands->quant_param);
+
+  }
+
+}
+
+void ReconstructLevel2D(sample *target, const int target_width, const int target_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param)
+{
+
+  Bands2D bands;
+  bands.data = target;
+  bands.width = target_width;
+  bands.row_pairs = target_height >> 1;
+  bands.band_count = p_BandCount(target_width, bands.row_pairs);
+  bands.ll = ll;
+  bands.lh = lh;
+  bands.hl = hl;
+  bands.hh = hh;
+  bands.quant_param = quant_param;
+
+  ThreadPoolParallelFor(bands.band_count, p_ReconstructBand, &bands);
+
+  if (target_height % 2)
+    ReconstructLastRow(target+(target_height-1)*target_width, target_width, ll->data+bands.row_pairs*((target_width+1)>>1),
+                       lh->data+bands.row_pairs*(target_width>>1));
+
+}
+
+int Levels2DQuantParam(const Levels2D *levels, const int quant_param, const int n)
+{
+
+  /* The reconstruction starts unquantized at the coarsest level and adds a
+   * step per level below quant_param */
+  return MIN(quant_param, MAX(0, MIN(levels->level_count-1, quant_param)-n));
+
+}
+
+Signal2D* Reconstruct2DScaled(Levels2D *levels, const int quant_param, const int scale, Arena *arena)
+{
+
+  /* Levels finer than scale are not reconstructed */
+  const int last_level = MIN(scale, levels->level_count);
+
   int level_n = levels->level_count-1;
 
-  Signal2D *signal = Signal2DCreate(levels->width, levels->height);
+  Signal2D *signal;
+
+  if (last_level == 0)
+    signal = Signal2DCreateInArena(arena, levels->width, levels->height);
+  else
+    signal = Signal2DCreateInArena(arena, levels->levels[last_level-1]->ll_width, levels->levels[last_level-1]->ll_height);
 
-  Signal2D *ll_src = Signal2DCreate(0, 0);
+  if (!signal) return NULL;
 
-  int32_t *ll_trg;
+  if (level_n < last_level)
+  {
+    signal->data[0] = levels->root_value;
+    return signal;
+  }
+
+  /* Levels are reconstructed alternately into the scratch buffer and the
+   * signal, ending with the signal, so a level never overwrites its own LL
+   * source */
+  Signal2D *scratch = Signal2DCreateInArena(arena, levels->levels[last_level]->ll_width, levels->levels[last_level]->ll_height);
+
+  if (!scratch)
+  {
+    Signal2DDestroy(signal);
+    return NULL;
+  }
+
+  Signal2D ll_src;
+  ll_src.data_pos = 0;
+
+  sample *ll_trg;
   int ll_trg_width, ll_trg_height;
 
-  if (level_n % 2)
+  if ((level_n-last_level) % 2)
     signal->data[0] = levels->root_value;
   else
-    signal->data[(levels->width*levels->height)-1] = levels->root_value;
+    scratch->data[0] = levels->root_value;
 
   int q = 0;
 
-  while (level_n >= 0)
+  while (level_n >= last_level)
   {
 
-    ll_src->width = levels->levels[level_n]->ll_width;
-    ll_src->height = levels->levels[level_n]->ll_height;
-    ll_src->data_pos = 0;
+    ll_src.width = levels->levels[level_n]->ll_width;
+    ll_src.height = levels->levels[level_n]->ll_height;
 
     ll_trg_width = (level_n == 0)?levels->width:levels->levels[level_n-1]->ll_width;
     ll_trg_height = (level_n == 0)?levels->height:levels->levels[level_n-1]->ll_height;
 
-    if (level_n % 2)
+    if ((level_n-last_level) % 2)
     {
-      ll_trg = &signal->data[(levels->width*levels->height)-(ll_trg_width*ll_trg_height)];
-      ll_src->data = signal->data;
+      ll_trg = scratch->data;
+      ll_src.data = signal->data;
     }
     else
     {
       ll_trg = signal->data;
-      ll_src->data = &signal->data[(levels->width*levels->height)-(ll_src->width*ll_src->height)];
+      ll_src.data = scratch->data;
     }
 
-    levels->levels[level_n]->lh->data_pos = 0;
-    levels->levels[level_n]->hl->data_pos = 0;
-    levels->levels[level_n]->hh->data_pos = 0;
-
-    ReconstructLevel2D(ll_trg, ll_trg_width, ll_trg_height, ll_src, levels->levels[level_n]->lh, levels->levels[level_n]->hl, levels->levels[level_n]->hh, q);
+    ReconstructLevel2D(ll_trg, ll_trg_width, ll_trg_height, &ll_src, levels->levels[level_n]->lh, levels->levels[level_n]->hl, levels->levels[level_n]->hh, q);
 
     --level_n;
 
@@ -447,8 +811,224 @@ Signal2D* Reconstruct2D(Levels2D *levels, const int quant_param)
 
   }
 
-  signal->data_pos = 0;
+  Signal2DDestroy(scratch);
 
   return signal;
 
 }
+
+Signal2D* Reconstruct2D(Levels2D *levels, const int quant_param, Arena *arena)
+{
+
+  return Reconstruct2DScaled(levels, quant_param, 0, arena);
+
+}
+
+/* Size of the target of level n */
+static void p_TargetSize(const Levels2D *levels, const int n, int *width, int *height)
+{
+
+  if (n == 0)
+  {
+    *width = levels->width;
+    *height = levels->height;
+  }
+  else
+  {
+    *width = levels->levels[n-1]->ll_width;
+    *height = levels->levels[n-1]->ll_height;
+  }
+
+}
+
+/* Widens window to whole pairs of a width x height target */
+static void p_AlignWindow(Window2D *window, const int width, const int height)
+{
+
+  window->x0 &= ~1;
+  window->y0 &= ~1;
+  window->x1 = MIN(window->x1+(window->x1 & 1), width);
+  window->y1 = MIN(window->y1+(window->y1 & 1), height);
+
+}
+
+void Levels2DWindows(const Levels2D *levels, const int scale, const Window2D *window, Window2D *windows)
+{
+
+  const int last_level = MIN(scale, levels->level_count);
+
+  int width, height;
+
+  windows[last_level] = *window;
+
+  int n;
+  for (n = last_level; n <= levels->level_count; ++n)
+  {
+
+    if (n > last_level)
+    {
+      windows[n].x0 = windows[n-1].x0 >> 1;
+      windows[n].y0 = windows[n-1].y0 >> 1;
+      windows[n].x1 = (windows[n-1].x1+1) >> 1;
+      windows[n].y1 = (windows[n-1].y1+1) >> 1;
+    }
+
+    if (n < levels->level_count)
+    {
+      p_TargetSize(levels, n, &width, &height);
+      p_AlignWindow(&windows[n], width, height);
+    }
+
+  }
+
+}
+
+/* ReconstructLevel2D restricted to window of the target, ll holds
+ * ll_window of the LL band */
+static void p_ReconstructLevelWindow(Signal2D *target, const Window2D *window, const int target_width, const int target_height,
+                                     const Signal2D *ll, const Window2D *ll_window, const Level2D *level, const int quant_param)
+{
+
+  const int w0 = target_width >> 1;
+  const int hl_width = (target_width % 2) ? w0+1 : w0;
+  const int row_pairs = target_height >> 1;
+
+  /* Pairs under the window, which starts at an even position */
+  const int j0 = window->x0 >> 1;
+  const int pair_count = MIN(w0, (window->x1+1) >> 1)-j0;
+  const int i0 = window->y0 >> 1;
+  const int i1 = MIN(row_pairs, (window->y1+1) >> 1);
+
+  const bool last_column = (window->x1 == target_width) && (target_width % 2);
+  const bool last_row = (window->y1 == target_height) && (target_height % 2);
+
+  sample *row0, *row1;
+  const sample *ll_row, *lh, *hl, *hh;
+
+  int i, j;
+  for (i = i0; i < i1; ++i)
+  {
+
+    row0 = target->data+((i<<1)-window->y0)*target->width;
+    row1 = row0+target->width;
+
+    ll_row = ll->data+(i-ll_window->y0)*ll->width+j0-ll_window->x0;
+    lh = level->lh->data+i*w0+j0;
+    hl = level->hl->data+i*hl_width+j0;
+    hh = level->hh->data+i*w0+j0;
+
+    j = kernels.reconstruct_row_pair(row0, row1, pair_count, ll_row, lh, hl, hh, quant_param);
+
+    for (; j < pair_count; ++j)
+    {
+      HaarInverseTransform(ll_row[j], dequantize(hl[j], quant_param), &row0[j<<1], &row1[j<<1]);
+      HaarInverseTransform(dequantize(lh[j], quant_param), dequantize(hh[j], quant_param), &row0[(j<<1)+1], &row1[(j<<1)+1]);
+      HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
+      HaarInverseTransform(row1[j<<1], row1[(j<<1)+1], &row1[j<<1], &row1[(j<<1)+1]);
+    }
+
+    if (last_column)
+      HaarInverseTransform(ll_row[pair_count], hl[pair_count], &row0[target->width-1], &row1[target->width-1]);
+
+  }
+
+  if (last_row)
+  {
+
+    row0 = target->data+(target_height-1-window->y0)*target->width;
+    ll_row = ll->data+(row_pairs-ll_window->y0)*ll->width+j0-ll_window->x0;
+    lh = level->lh->data+row_pairs*w0+j0;
+
+    for (j = 0; j < pair_count; ++j)
+    {
+      row0[j<<1] = ll_row[j];
+      row0[(j<<1)+1] = lh[j];
+      HaarInverseTransform(row0[j<<1], row0[(j<<1)+1], &row0[j<<1], &row0[(j<<1)+1]);
+    }
+
+    if (last_column)
+      row0[target->width-1] = ll_row[pair_count];
+
+  }
+
+}
+
+Signal2D* Reconstruct2DWindow(Levels2D *levels, const int quant_param, const int scale, const Window2D *window, Arena *arena)
+{
+
+  const int last_level = MIN(scale, levels->level_count);
+
+  Window2D *windows = ArenaAlloc(arena, (levels->level_count+1)*sizeof(Window2D));
+  Signal2D *ll = Signal2DCreateInArena(arena, 1, 1);
+
+  if ((!windows) || (!ll))
+  {
+    ArenaFree(arena, windows);
+    Signal2DDestroy(ll);
+    return NULL;
+  }
+
+  Levels2DWindows(levels, scale, window, windows);
+
+  ll->data[0] = levels->root_value;
+
+  Signal2D *target;
+  int width, height;
+  int q = 0;
+
+  int n;
+  for (n = levels->level_count-1; n >= last_level; --n)
+  {
+
+    p_TargetSize(levels, n, &width, &height);
+
+    target = Signal2DCreateInArena(arena, windows[n].x1-windows[n].x0, windows[n].y1-windows[n].y0);
+
+    if (!target) break;
+
+    p_ReconstructLevelWindow(target, &windows[n], width, height, ll, &windows[n+1], levels->levels[n], q);
+
+    Signal2DDestroy(ll);
+    ll = target;
+
+    if ((n-1 < quant_param) && (q < quant_param)) ++q;
+
+  }
+
+  if (n >= last_level)
+  {
+    ArenaFree(arena, windows);
+    Signal2DDestroy(ll);
+    return NULL;
+  }
+
+  /* The aligned window may be larger */
+  const Window2D *aligned = &windows[last_level];
+  Signal2D *result = ll;
+
+  if ((aligned->x0 != window->x0) || (aligned->y0 != window->y0) || (aligned->x1 != window->x1) || (aligned->y1 != window->y1))
+  {
+
+    result = Signal2DCreateInArena(arena, window->x1-window->x0, window->y1-window->y0);
+
+    if (!result)
+    {
+      ArenaFree(arena, windows);
+      Signal2DDestroy(ll);
+      return NULL;
+    }
+
+    int y;
+    for (y = 0; y < result->height; ++y)
+      memcpy(&result->data[y*result->width], &ll->data[(window->y0-aligned->y0+y)*ll->width+window->x0-aligned->x0],
+             result->width*sizeof(sample));
+
+    Signal2DDestroy(ll);
+
+  }
+
+  ArenaFree(arena, windows);
+
+  return result;
+
+}
@@ -28,9 +28,12 @@
 #include <string.h>
 
 #include "types.h"
+#include "heap.h"
 #include "wavelet.h"
 #include "signal.h"
 #include "quantize.h"
+#include "cpu.h"
+#include "threadpool.h"
 
 struct tLevel1D
 {
@@ -48,17 +51,18 @@ struct tLevels1D
 };
 typedef struct tLevels1D Levels1D;
 
+/* NULL if out of memory, as are the 1D decompositions */
 Level1D* Level1DCreate(const int l_size, Signal1D *h);
 void Level1DDestroy(Level1D *level);
 
 Levels1D* Levels1DCreate(const int level_count, const int size);
 void Levels1DDestroy(Levels1D *levels);
 
-void decomposeLevel1D(int32_t *source, const int source_size, Signal1D *l, Signal1D *h);
+void decomposeLevel1D(sample *source, const int source_size, Signal1D *l, Signal1D *h);
 Levels1D* decompose1D(Signal1D *signal0);
 
 /* Reconstruction, q = quality parameter */
-void reconstructLevel1D(int32_t *target, const int target_size, Signal1D *l, Signal1D *h);
+void reconstructLevel1D(sample *target, const int target_size, Signal1D *l, Signal1D *h);
 Signal1D* reconstruct1D(Levels1D *levels);
 
 
@@ -71,6 +75,7 @@ struct tLevel2D
   Signal2D *lh;
   Signal2D *hl;
   Signal2D *hh;
+  Arena *arena;
 };
 typedef struct tLevel2D Level2D;
 
@@ -81,21 +86,102 @@ struct tLevels2D
   int level_count;
   int width;
   int height;
+  Arena *arena;
 };
 typedef struct tLevels2D Levels2D;
 
-Level2D* Level2DCreate(const int ll_width, const int ll_height, Signal2D *lh, Signal2D *hl, Signal2D *hh);
+/* The structures are allocated from arena, NULL for the heap. The
+ * functions that create levels return NULL if out of memory. */
+Level2D* Level2DCreate(Arena *arena, const int ll_width, const int ll_height, Signal2D *lh, Signal2D *hl, Signal2D *hh);
+Level2D* Level2DCreateSubbands(Arena *arena, const int ll_width, const int ll_height, const int lh_width, const int lh_height,
+                               const int hl_width, const int hl_height, const int hh_width, const int hh_height);
 void Level2DDestroy(Level2D *level);
 
-Levels2D* Levels2DCreate(const int level_count, const int width, const int height);
+Levels2D* Levels2DCreate(Arena *arena, const int level_count, const int width, const int height);
 void Levels2DDestroy(Levels2D *levels);
 
-/* Mallat decomposition */
-void DecomposeLevel2D(int32_t *source, const int source_width, const int source_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param);
-Levels2D* Decompose2D(Signal2D *signal0, const int quant_param);
+/* Mallat decomposition. The level is split into bands of row pairs that run
+ * on the thread pool, so ll must not overlap the source. Level n is
+ * quantized by Levels2DQuantParam, quant_param is clamped to one less than
+ * the level count. Decompose2D and the reconstructions below return NULL if
+ * out of memory. */
+void DecomposeLevel2D(sample *source, const int source_width, const int source_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param);
+Levels2D* Decompose2D(Signal2D *signal0, const int quant_param, Arena *arena);
+
+/* A row pair of DecomposeLevel2D, transformed in place into a row of each
+ * band. The last row of a source of odd height only gives LL and LH. */
+void DecomposeRowPair(sample *row0, sample *row1, const int source_width, sample *ll, sample *lh, sample *hl, sample *hh,
+                      const int quant_param);
+void DecomposeLastRow(sample *row0, const int source_width, sample *ll, sample *lh, const int quant_param);
+
+/* Receives row of the LH, HL and HH bands of level, hl and hh are NULL for
+ * the last LH row of a source of odd height */
+typedef void (*SubbandRowsFunction)(void *context, const int level, const int row, const sample *lh, const sample *hl,
+                                    const sample *hh);
+
+/* Decompose2D of a signal that arrives row by row. A level keeps the first
+ * row of a pair of its source until the second arrives and passes the LL
+ * row on to the next level, so memory is O(width) per level instead of the
+ * whole signal. The subband rows go to emit as soon as they are done. */
+struct tLineDecomposition2D
+{
+  int level_count;
+  int *widths;              /* Of the sources of the levels */
+  int *heights;
+  int *row_counts;          /* Rows the sources have received */
+  sample **rows;            /* Pending source row, LL, LH, HL and HH row per level */
+  int quant_param;
+  uint32_t root_value;      /* Set by the last row */
+  SubbandRowsFunction emit;
+  void *context;
+  Arena *arena;
+};
+typedef struct tLineDecomposition2D LineDecomposition2D;
+
+/* NULL if out of memory, what was allocated is left to the arena */
+LineDecomposition2D* LineDecomposition2DCreate(Arena *arena, const int width, const int height, const int quant_param,
+                                               SubbandRowsFunction emit, void *context);
+void LineDecomposition2DDestroy(LineDecomposition2D *decomposition);
+
+/* Passes the next row of the signal, row is used as scratch space */
+void LineDecomposition2DPushRow(LineDecomposition2D *decomposition, sample *row);
+
+/* Mallat reconstruction, ll must not overlap the target */
+void ReconstructLevel2D(sample *target, const int target_width, const int target_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param);
+Signal2D* Reconstruct2D(Levels2D *levels, const int quant_param, Arena *arena);
+
+/* A row pair of ReconstructLevel2D from the subband rows under it. The last
+ * row of a target of odd height only takes LL and LH. */
+void ReconstructRowPair(sample *row0, sample *row1, const int target_width, const sample *ll, const sample *lh,
+                        const sample *hl, const sample *hh, const int quant_param);
+void ReconstructLastRow(sample *row0, const int target_width, const sample *ll, const sample *lh);
+
+/* Quantization parameter Reconstruct2D uses for level n */
+int Levels2DQuantParam(const Levels2D *levels, const int quant_param, const int n);
+
+/* Stops scale levels early and returns the LL band of level scale, an
+ * image of 1/2^scale the size (rounded up). The subbands of the skipped
+ * levels may be NULL. */
+Signal2D* Reconstruct2DScaled(Levels2D *levels, const int quant_param, const int scale, Arena *arena);
+
+/* Rectangle [x0, x1) x [y0, y1) of a signal */
+struct tWindow2D
+{
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+};
+typedef struct tWindow2D Window2D;
+
+/* Every pixel depends on one Haar pair of each level, so window of the
+ * result of Reconstruct2DScaled only needs windows[n] of the target of each
+ * level n >= scale (the LL band of level n-1, or the signal for level 0)
+ * and windows[level_count] of the root. They are aligned to the pairs. */
+void Levels2DWindows(const Levels2D *levels, const int scale, const Window2D *window, Window2D *windows);
 
-/* Mallat reconstruction */
-void ReconstructLevel2D(int32_t *target, const int target_width, const int target_height, Signal2D *ll, Signal2D *lh, Signal2D *hl, Signal2D *hh, const int quant_param);
-Signal2D* Reconstruct2D(Levels2D *levels, const int quant_param);
+/* Reconstructs and returns only window of the result of
+ * Reconstruct2DScaled. Only the subband rows under the windows are read. */
+Signal2D* Reconstruct2DWindow(Levels2D *levels, const int quant_param, const int scale, const Window2D *window, Arena *arena);
 
 #endif
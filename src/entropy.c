@@ -0,0 +1,64 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "entropy.h"
+
+const EntropyCoder entropy_coders[EntropyCoderCount] =
+{
+  { huffmanEncode, huffmanDecode, huffmanEncodeBound },
+  { ansEncode, ansDecode, ansEncodeBound }
+};
+
+static const char *p_coder_names[EntropyCoderCount] = { "huffman", "ans" };
+
+void EntropyEncode(const EntropyCoderID coder, void *data, const int size, const uint32_t *histogram, void *coded_data, int *coded_size)
+{
+
+  HuffmanParameters huffman_parameters = { 0, histogram };
+  ANSParameters ans_parameters = { histogram };
+
+  switch (coder)
+  {
+    case EntropyANS: ansEncode(data, size, coded_data, coded_size, &ans_parameters); break;
+    default: huffmanEncode(data, size, coded_data, coded_size, &huffman_parameters); break;
+  }
+
+}
+
+const char* EntropyCoderName(const EntropyCoderID coder)
+{
+
+  return (coder < EntropyCoderCount) ? p_coder_names[coder] : "unknown";
+
+}
+
+bool EntropyParseCoder(const char *name, EntropyCoderID *coder)
+{
+
+  int i;
+  for (i = 0; i < EntropyCoderCount; ++i)
+  {
+    if (strcmp(name, p_coder_names[i]) == 0)
+    {
+      *coder = i;
+      return true;
+    }
+  }
+
+  return false;
+
+}
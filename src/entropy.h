@@ -0,0 +1,50 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "huffman.h"
+#include "ans.h"
+
+/* Entropy coder of a file, stored in the BILD header */
+enum tEntropyCoderID { EntropyHuffman = 0, EntropyANS, EntropyCoderCount };
+typedef enum tEntropyCoderID EntropyCoderID;
+
+struct tEntropyCoder
+{
+  void (*encode)(void *data, const int size, void *coded_data, int *coded_size, void *parameters);
+  bool (*decode)(void *coded_data, const int coded_size, void *data, int *size); /* false if damaged */
+  int (*encode_bound)(const int size);
+};
+typedef struct tEntropyCoder EntropyCoder;
+
+extern const EntropyCoder entropy_coders[EntropyCoderCount];
+
+/* Encodes data with a known byte histogram (may be NULL) through the
+ * coder specific parameters */
+void EntropyEncode(const EntropyCoderID coder, void *data, const int size, const uint32_t *histogram, void *coded_data, int *coded_size);
+
+const char* EntropyCoderName(const EntropyCoderID coder);
+bool EntropyParseCoder(const char *name, EntropyCoderID *coder);
+
+#endif
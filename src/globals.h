@@ -18,6 +18,6 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
-#define VERSION 7
+#define VERSION 14
 
 #endif
@@ -0,0 +1,54 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "heap.h"
+
+static int64_t p_allocation_count = 0;
+
+void* HeapAlloc(const size_t size)
+{
+
+  __atomic_fetch_add(&p_allocation_count, 1, __ATOMIC_RELAXED);
+
+  return malloc(MAX(size, (size_t)1));
+
+}
+
+void* HeapAlignedAlloc(const size_t alignment, const size_t size)
+{
+
+  __atomic_fetch_add(&p_allocation_count, 1, __ATOMIC_RELAXED);
+
+  return aligned_alloc(alignment, MAX(size, alignment));
+
+}
+
+void* HeapRealloc(void *data, const size_t size)
+{
+
+  __atomic_fetch_add(&p_allocation_count, 1, __ATOMIC_RELAXED);
+
+  return realloc(data, MAX(size, (size_t)1));
+
+}
+
+int64_t HeapAllocationCount(void)
+{
+
+  return __atomic_load_n(&p_allocation_count, __ATOMIC_RELAXED);
+
+}
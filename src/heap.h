@@ -0,0 +1,38 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "types.h"
+
+/* Heap allocations of the library, counted for the stage statistics (see
+ * stage.h). Memory is released with free. NULL only if out of memory,
+ * empty allocations take a byte. The library then returns BILDErrorMemory. */
+
+void* HeapAlloc(const size_t size);
+void* HeapAlignedAlloc(const size_t alignment, const size_t size);
+void* HeapRealloc(void *data, const size_t size);
+
+/* Allocations of all threads since the start of the process */
+int64_t HeapAllocationCount(void);
+
+#endif
@@ -16,113 +16,311 @@
  */
 
 #include "huffman.h"
+#include "cpu.h"
+
+struct tHuffmanSymbol
+{
+  uint32_t frequency;
+  byte symbol;
+};
+typedef struct tHuffmanSymbol HuffmanSymbol;
 
 int huffman_frequency_compare(const void *elem1, const void *elem2)
 {
 
-  HuffmanNode *node1 = (HuffmanNode*)elem1;
-  HuffmanNode *node2 = (HuffmanNode*)elem2;
+  const HuffmanSymbol *symbol1 = elem1;
+  const HuffmanSymbol *symbol2 = elem2;
 
-  if (node1->frequency == node2->frequency) return 0;
+  if (symbol1->frequency == symbol2->frequency)
+    return symbol1->symbol > symbol2->symbol ? 1 : -1;
 
-  return node1->frequency < node2->frequency ? 1 : -1;
+  return symbol1->frequency > symbol2->frequency ? 1 : -1;
 
 }
 
-int huffman_symbol_compare(const void *elem1, const void *elem2 )
+void huffman_histogram(const byte *data, const int size, uint32_t *histogram)
 {
 
-  return ((HuffmanNode*)elem1)->symbol > ((HuffmanNode*)elem2)->symbol ? 1 : -1;
+  memset(histogram, 0, (BYTE_MAX+1)*sizeof(uint32_t));
+
+  int i;
+  for (i = 0; i < size; ++i) ++histogram[data[i]];
 
 }
 
-HuffmanNode* huffman_pop_node(HuffmanNode *nodes[], const int i, const bool bRight)
+/* Moffat, Katajainen: In-place calculation of minimum-redundancy codes.
+ * a holds n > 1 frequencies in ascending order and receives the code lengths. */
+void huffman_minimum_redundancy(uint32_t a[], const int n)
 {
 
-  HuffmanNode *node = nodes[i];
-  node->code = bRight;
-  node->code_length = 1;
-  return node;
+  int root, leaf, next, avbl, used, dpth;
+
+  /* Parent pointers, left to right */
+  a[0] += a[1];
+  root = 0;
+  leaf = 2;
+  for (next = 1; next < n-1; ++next)
+  {
+
+    if ((leaf >= n) || (a[root] < a[leaf]))
+    {
+      a[next] = a[root];
+      a[root++] = next;
+    }
+    else
+    {
+      a[next] = a[leaf++];
+    }
+
+    if ((leaf >= n) || ((root < next) && (a[root] < a[leaf])))
+    {
+      a[next] += a[root];
+      a[root++] = next;
+    }
+    else
+    {
+      a[next] += a[leaf++];
+    }
+
+  }
+
+  /* Internal node depths, right to left */
+  a[n-2] = 0;
+  for (next = n-3; next >= 0; --next)
+    a[next] = a[a[next]]+1;
+
+  /* Leaf depths, right to left */
+  avbl = 1;
+  used = dpth = 0;
+  root = n-2;
+  next = n-1;
+  while (avbl > 0)
+  {
+    while ((root >= 0) && (a[root] == dpth)) { ++used; --root; }
+    while (avbl > used) { a[next--] = dpth; --avbl; }
+    avbl = used << 1;
+    ++dpth;
+    used = 0;
+  }
 
 }
 
-void huffman_set_node_code(HuffmanNode *node)
+void huffman_code_lengths(const uint32_t *histogram, byte *code_lengths)
 {
 
-  HuffmanNode *parent = node->parent;
+  HuffmanSymbol symbols[BYTE_MAX+1];
+  uint32_t a[BYTE_MAX+1];
+  int length_count[BYTE_MAX+1];
+
+  memset(code_lengths, 0, (BYTE_MAX+1)*sizeof(byte));
+
+  int n = 0;
+  int i, j;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+  {
+    if (!histogram[i]) continue;
+    symbols[n].frequency = histogram[i];
+    symbols[n].symbol = i;
+    ++n;
+  }
+
+  if (n == 0) return;
+
+  if (n == 1)
+  {
+    code_lengths[symbols[0].symbol] = 1;
+    return;
+  }
+
+  qsort(symbols, n, sizeof(HuffmanSymbol), huffman_frequency_compare);
+
+  for (i = 0; i < n; ++i) a[i] = symbols[i].frequency;
+
+  huffman_minimum_redundancy(a, n);
 
-  while (parent && parent->code_length)
+  memset(length_count, 0, sizeof(length_count));
+  for (i = 0; i < n; ++i) ++length_count[a[i]];
+
+  /* Limit the code lengths (JPEG, Annex K.3): a pair of leaves below the
+   * limit is replaced by one leaf, its sibling moves under the next shallower
+   * leaf */
+  for (i = BYTE_MAX; i > HUFFMAN_MAX_CODE_LENGTH; --i)
   {
+    while (length_count[i] > 0)
+    {
+      j = i-2;
+      while (length_count[j] == 0) --j;
+      length_count[i] -= 2;
+      length_count[i-1] += 1;
+      length_count[j+1] += 2;
+      length_count[j] -= 1;
+    }
+  }
+
+  /* The most frequent symbols get the shortest codes */
+  n--;
+  for (i = 1; i <= HUFFMAN_MAX_CODE_LENGTH; ++i)
+    for (j = 0; j < length_count[i]; ++j)
+      code_lengths[symbols[n--].symbol] = i;
 
-    node->code <<= 1;
-    node->code |= parent->code;
-    node->code_length++;
-    parent = parent->parent;
+}
 
+static uint32_t huffman_reverse(uint32_t code, const int length)
+{
+
+  uint32_t result = 0;
+
+  int i;
+  for (i = 0; i < length; ++i)
+  {
+    result = (result << 1) | (code & 1);
+    code >>= 1;
   }
 
+  return result;
+
 }
 
-int huffman_get_tree(HuffmanNode nodes[], bool bSetCodes)
+void huffman_canonical_codes(const byte *code_lengths, HuffmanCode *codes)
 {
 
-  HuffmanNode *pnodes[BYTE_MAX+1], *node;
+  int length_count[HUFFMAN_MAX_CODE_LENGTH+1];
+  uint32_t next_code[HUFFMAN_MAX_CODE_LENGTH+1];
+
+  memset(length_count, 0, sizeof(length_count));
 
-  int node_count = 0;
   int i;
+  for (i = 0; i < BYTE_MAX+1; ++i) ++length_count[code_lengths[i]];
+  length_count[0] = 0;
+
+  uint32_t code = 0;
+  for (i = 1; i <= HUFFMAN_MAX_CODE_LENGTH; ++i)
+  {
+    code = (code + length_count[i-1]) << 1;
+    next_code[i] = code;
+  }
+
+  for (i = 0; i < BYTE_MAX+1; ++i)
+  {
+    codes[i].code_length = code_lengths[i];
+    codes[i].code = code_lengths[i] ? huffman_reverse(next_code[code_lengths[i]]++, code_lengths[i]) : 0;
+  }
 
-  for (i = 0; (i < BYTE_MAX+1) && (nodes[i].frequency); ++i)
-    pnodes[node_count++] = &nodes[i];
+}
 
-  int nParentNode = node_count;
-  int back_node = node_count-1;
+/* Code lengths as nibbles, a 0 nibble is followed by the length of the zero
+ * run minus one. Returns the number of bytes written. */
+int huffman_write_code_lengths(const byte *code_lengths, byte *cd)
+{
 
-  while (back_node > 0)
+  int nibble_count = 0;
+  byte nibbles[2*(BYTE_MAX+1)];
+
+  int i = 0, run;
+  while (i < BYTE_MAX+1)
   {
 
-    node = &nodes[nParentNode++];
+    if (code_lengths[i])
+    {
+      nibbles[nibble_count++] = code_lengths[i++];
+      continue;
+    }
+
+    run = 0;
+    while ((i < BYTE_MAX+1) && (!code_lengths[i]) && (run < 16)) { ++run; ++i; }
+
+    nibbles[nibble_count++] = 0;
+    nibbles[nibble_count++] = run-1;
+
+  }
+
+  if (nibble_count % 2) nibbles[nibble_count++] = 0;
+
+  for (i = 0; i < nibble_count; i += 2)
+    cd[i>>1] = nibbles[i] | (nibbles[i+1] << 4);
+
+  return nibble_count >> 1;
 
-    node->left_child = huffman_pop_node(pnodes, back_node--, 0);
+}
+
+int huffman_read_code_lengths(const byte *cd, const int size, byte *code_lengths)
+{
 
-    node->right_child = huffman_pop_node(pnodes, back_node--, 1);
+  int nibble_index = 0;
+  int i = 0, run;
+  byte nibble;
 
-    node->left_child->parent = node;
-    node->right_child->parent = node;
+  while (i < BYTE_MAX+1)
+  {
 
-    node->frequency = node->left_child->frequency + node->right_child->frequency;
+    /* A nibble and the run length behind it */
+    if ((nibble_index+1) >> 1 >= size) return -1;
+
+    nibble = (cd[nibble_index>>1] >> ((nibble_index&1) << 2)) & 0xF;
+    ++nibble_index;
+
+    if (nibble)
+    {
+      code_lengths[i++] = nibble;
+      continue;
+    }
 
-    for (i = back_node; i >= 0; --i)
-      if (pnodes[i]->frequency >= node->frequency) break;
+    run = ((cd[nibble_index>>1] >> ((nibble_index&1) << 2)) & 0xF)+1;
+    ++nibble_index;
 
-    memmove(pnodes+i+2, pnodes+i+1, (back_node-i)*sizeof(HuffmanNode*));
-    pnodes[i+1] = node;
-    ++back_node;
+    while ((run > 0) && (i < BYTE_MAX+1)) { code_lengths[i++] = 0; --run; }
 
   }
 
-  if (bSetCodes)
-    for (i = 0; i < node_count; ++i)
-      huffman_set_node_code(&nodes[i]);
+  return (nibble_index+1) >> 1;
+
+}
 
-  return node_count;
+int huffmanEncodeBound(const int size)
+{
+
+  /* Size, symbol count, code lengths, stream table and the bitstreams */
+  return sizeof(uint32_t) + 1 + (BYTE_MAX+1) + 1 + (HUFFMAN_MAX_STREAM_COUNT-1)*sizeof(uint32_t) +
+         (int)(((int64_t)size*HUFFMAN_MAX_CODE_LENGTH+7) >> 3) + HUFFMAN_MAX_STREAM_COUNT*sizeof(uint32_t);
 
 }
 
-void huffman_init_nodes(HuffmanNode nodes[])
+/* Codes every stride-th byte. Returns the number of bytes written. */
+int huffman_encode_stream(const byte *d, const int size, const int stride, const HuffmanCode *codes, byte *p)
 {
 
+  int p_index = 0;
+  uint64_t bits = 0;
+  int bit_count = 0;
+  uint32_t word;
+
   int i;
-  for (i = 0; i < MAX_NODE_COUNT; ++i)
+  for (i = 0; i < size; i += stride)
+  {
+
+    bits |= (uint64_t)codes[d[i]].code << bit_count;
+    bit_count += codes[d[i]].code_length;
+
+    if (bit_count >= 32)
+    {
+      word = (uint32_t)bits;
+      memcpy(&p[p_index], &word, sizeof(uint32_t));
+      p_index += sizeof(uint32_t);
+      bits >>= 32;
+      bit_count -= 32;
+    }
+
+  }
+
+  while (bit_count > 0)
   {
-    nodes[i].frequency = 0;
-    nodes[i].symbol = 0;
-    nodes[i].code = 0;
-    nodes[i].code_length = 0;
-    nodes[i].parent = NULL;
-    nodes[i].left_child = NULL;
-    nodes[i].right_child = NULL;
+    p[p_index++] = (byte)bits;
+    bits >>= 8;
+    bit_count -= 8;
   }
 
+  return p_index;
+
 }
 
 void huffmanEncode(void *data, const int size, void *coded_data, int *coded_size, void *parameters)
@@ -133,93 +331,384 @@ void huffmanEncode(void *data, const int size, void *coded_data, int *coded_size
   byte *cd = coded_data;
   int coded_data_index = 0;
 
-  HuffmanNode nodes[MAX_NODE_COUNT];
-  huffman_init_nodes(nodes);
+  uint32_t tmp = (uint32_t)size;
+  memcpy(cd, &tmp, sizeof(uint32_t));
+  coded_data_index += sizeof(uint32_t);
+
+  if (size == 0)
+  {
+    *coded_size = coded_data_index;
+    return;
+  }
+
+  const HuffmanParameters *huffman_parameters = parameters;
+
+  uint32_t counted_histogram[BYTE_MAX+1];
+  const uint32_t *histogram = counted_histogram;
+  if (huffman_parameters && huffman_parameters->histogram)
+    histogram = huffman_parameters->histogram;
+  else
+    kernels.histogram(d, size, counted_histogram);
 
+  byte code_lengths[BYTE_MAX+1];
+  huffman_code_lengths(histogram, code_lengths);
+
+  int symbol_count = 0;
   int i;
-  for (i = 0; i < BYTE_MAX+1; ++i) nodes[i].symbol = i;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+    if (code_lengths[i]) ++symbol_count;
 
-  for (i = 0; i < size; ++i) ++nodes[d[i]].frequency;
-  qsort(nodes, BYTE_MAX+1, sizeof(HuffmanNode), huffman_frequency_compare);
+  cd[coded_data_index++] = (byte)(symbol_count-1);
 
-  uint32_t tmp = (uint32_t)size;
-  memcpy(cd, &tmp, sizeof(uint32_t));
-  coded_data_index += sizeof(uint32_t);
+  if (symbol_count == 1)
+  {
+    cd[coded_data_index++] = d[0];
+    *coded_size = coded_data_index;
+    return;
+  }
+
+  coded_data_index += huffman_write_code_lengths(code_lengths, &cd[coded_data_index]);
+
+  HuffmanCode codes[BYTE_MAX+1];
+  huffman_canonical_codes(code_lengths, codes);
+
+  int stream_count;
+  if (huffman_parameters && huffman_parameters->stream_count)
+    stream_count = huffman_parameters->stream_count;
+  else
+    stream_count = (size < HUFFMAN_MIN_INTERLEAVED_SIZE) ? 1 : HUFFMAN_DEFAULT_STREAM_COUNT;
+  stream_count = MAX(1, MIN(stream_count, MIN(size, HUFFMAN_MAX_STREAM_COUNT)));
+
+  cd[coded_data_index++] = (byte)stream_count;
+
+  /* The sizes are known after coding, reserve the table */
+  byte *stream_sizes = &cd[coded_data_index];
+  coded_data_index += (stream_count-1)*sizeof(uint32_t);
+
+  for (i = 0; i < stream_count; ++i)
+  {
+
+    tmp = (uint32_t)huffman_encode_stream(&d[i], size-i, stream_count, codes, &cd[coded_data_index]);
+    coded_data_index += tmp;
+
+    if (i < stream_count-1) memcpy(&stream_sizes[i*sizeof(uint32_t)], &tmp, sizeof(uint32_t));
+
+  }
+
+  *coded_size = coded_data_index;
+
+}
+
+void huffman_build_table(const byte *code_lengths, const HuffmanCode *codes, HuffmanTableEntry table[])
+{
+
+  memset(table, 0, (1 << HUFFMAN_TABLE_BITS)*sizeof(HuffmanTableEntry));
+
+  int i;
+  uint32_t j;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+  {
+
+    if ((!code_lengths[i]) || (code_lengths[i] > HUFFMAN_TABLE_BITS)) continue;
+
+    /* All table indices starting with the code */
+    for (j = codes[i].code; j < (1 << HUFFMAN_TABLE_BITS); j += (1 << code_lengths[i]))
+    {
+      table[j].symbol = i;
+      table[j].code_length = code_lengths[i];
+    }
+
+  }
+
+}
+
+struct tHuffmanDecoder
+{
+  HuffmanTableEntry table[1 << HUFFMAN_TABLE_BITS];
+  /* Canonical order for the codes longer than the table */
+  int length_count[HUFFMAN_MAX_CODE_LENGTH+1];
+  byte sorted_symbols[BYTE_MAX+1];
+};
+typedef struct tHuffmanDecoder HuffmanDecoder;
+
+void huffman_init_decoder(const byte *code_lengths, HuffmanDecoder *decoder)
+{
 
-  int node_count = huffman_get_tree(nodes, 1);
+  HuffmanCode codes[BYTE_MAX+1];
+  huffman_canonical_codes(code_lengths, codes);
 
-  cd[coded_data_index++] = (byte)node_count-1;
+  huffman_build_table(code_lengths, codes, decoder->table);
 
-  for (i = 0; i < node_count; ++i)
+  int sorted_count = 0;
+
+  int i, j;
+  for (i = 1; i <= HUFFMAN_MAX_CODE_LENGTH; ++i)
   {
-    memcpy(&cd[coded_data_index], &nodes[i].frequency, sizeof(uint32_t));
-    coded_data_index += sizeof(uint32_t);
-    cd[coded_data_index++] = nodes[i].symbol;
+    decoder->length_count[i] = 0;
+    for (j = 0; j < BYTE_MAX+1; ++j)
+    {
+      if (code_lengths[j] != i) continue;
+      decoder->sorted_symbols[sorted_count++] = j;
+      ++decoder->length_count[i];
+    }
   }
 
-  qsort(nodes, BYTE_MAX+1, sizeof(HuffmanNode), huffman_symbol_compare);
+}
+
+/* The code lengths of more than one symbol have to form a complete prefix
+ * code, anything else cannot come from huffmanEncode */
+bool huffman_check_code_lengths(const byte *code_lengths, const int symbol_count)
+{
+
+  int count = 0;
+  uint32_t kraft_sum = 0;
 
-  byte *p = &cd[coded_data_index];
-  int coded_data_bit_index = 0;
-  for (i = 0; i < size; ++i)
+  int i;
+  for (i = 0; i < BYTE_MAX+1; ++i)
   {
-    *(uint32_t*)(&p[coded_data_bit_index>>3]) |= nodes[d[i]].code << (coded_data_bit_index&7);
-    coded_data_bit_index += nodes[d[i]].code_length;
+    if (!code_lengths[i]) continue;
+    if (code_lengths[i] > HUFFMAN_MAX_CODE_LENGTH) return false;
+    kraft_sum += 1 << (HUFFMAN_MAX_CODE_LENGTH-code_lengths[i]);
+    ++count;
   }
 
-  *coded_size = coded_data_index+((coded_data_bit_index+7) >> 3);
+  return (count == symbol_count) && (kraft_sum == (1 << HUFFMAN_MAX_CODE_LENGTH));
 
 }
 
-void huffmanDecode(void *coded_data, const int coded_size, void *data, int *size)
+/* Canonical decoding bit by bit, bits holds at least HUFFMAN_MAX_CODE_LENGTH valid bits */
+static inline byte huffman_decode_long(const HuffmanDecoder *decoder, uint64_t bits, int *code_length)
 {
 
-  byte *d = data;
+  int code = 0, first = 0, index = 0;
+  int length;
+  for (length = 1; length <= HUFFMAN_MAX_CODE_LENGTH; ++length)
+  {
+    code |= bits&1;
+    bits >>= 1;
+    if (code-decoder->length_count[length] < first) break;
+    index += decoder->length_count[length];
+    first += decoder->length_count[length];
+    first <<= 1;
+    code <<= 1;
+  }
+
+  *code_length = length;
+
+  return decoder->sorted_symbols[index+(code-first)];
+
+}
+
+/* bits holds at least HUFFMAN_MAX_CODE_LENGTH valid bits */
+static inline byte huffman_decode_symbol(const HuffmanDecoder *decoder, uint64_t *bits, int64_t *bit_index)
+{
+
+  const HuffmanTableEntry entry = decoder->table[*bits&((1 << HUFFMAN_TABLE_BITS)-1)];
+
+  int code_length = entry.code_length;
+  byte symbol = entry.symbol;
+
+  if (!code_length) symbol = huffman_decode_long(decoder, *bits, &code_length);
+
+  *bits >>= code_length;
+  *bit_index += code_length;
+
+  return symbol;
+
+}
+
+/* Returns false if the stream runs past its stream_size bytes */
+bool huffman_decode_stream(const HuffmanDecoder *decoder, const byte *p, const int64_t stream_size, byte *d, const int size)
+{
+
+  const uint64_t mask = (1 << HUFFMAN_TABLE_BITS)-1;
+
   int data_index = 0;
 
+  uint64_t nCode;
+  int64_t coded_data_bit_index = 0;
+  HuffmanTableEntry entry;
+  int i, code_length;
+  while (data_index < size)
+  {
+
+    if ((coded_data_bit_index >> 3) > stream_size) return false;
+
+    /* At least 57 valid bits, enough for 5 table codes */
+    memcpy(&nCode, &p[coded_data_bit_index >> 3], sizeof(uint64_t));
+    nCode >>= coded_data_bit_index&7;
+
+    for (i = 0; (i < 5) && (data_index < size); ++i)
+    {
+
+      entry = decoder->table[nCode&mask];
+
+      if (entry.code_length)
+      {
+        d[data_index++] = entry.symbol;
+        nCode >>= entry.code_length;
+        coded_data_bit_index += entry.code_length;
+        continue;
+      }
+
+      /* Long code, decode with freshly loaded bits */
+      if (i > 0) break;
+
+      d[data_index++] = huffman_decode_long(decoder, nCode, &code_length);
+      coded_data_bit_index += code_length;
+      break;
+
+    }
+
+  }
+
+  return (coded_data_bit_index <= stream_size*8);
+
+}
+
+/* The streams do not depend on each other, with a constant stream_count the
+ * loop over them is unrolled and their decoding overlaps. Returns false if a
+ * stream runs past its stream_sizes[] bytes. */
+static inline bool huffman_decode_interleaved(const HuffmanDecoder *decoder, const byte *streams[], const int64_t stream_sizes[],
+                                              byte *d, const int size, const int stream_count)
+{
+
+  int64_t bit_index[HUFFMAN_MAX_STREAM_COUNT];
+  uint64_t bits[HUFFMAN_MAX_STREAM_COUNT];
+  bool overrun = false;
+
+  int i, j, k;
+  for (j = 0; j < stream_count; ++j) bit_index[j] = 0;
+
+  /* A refill gives at least 57 valid bits, enough for 3 codes of any length */
+  const int round_count = size/(3*stream_count);
+  for (i = 0; i < round_count; ++i)
+  {
+
+    for (j = 0; j < stream_count; ++j)
+      overrun |= ((bit_index[j] >> 3) > stream_sizes[j]);
+
+    if (overrun) return false;
+
+    for (j = 0; j < stream_count; ++j)
+    {
+      memcpy(&bits[j], &streams[j][bit_index[j] >> 3], sizeof(uint64_t));
+      bits[j] >>= bit_index[j]&7;
+    }
+
+    for (k = 0; k < 3; ++k)
+    {
+      for (j = 0; j < stream_count; ++j)
+        d[j] = huffman_decode_symbol(decoder, &bits[j], &bit_index[j]);
+      d += stream_count;
+    }
+
+  }
+
+  for (i = 0; i < size-round_count*3*stream_count; ++i)
+  {
+    j = i % stream_count;
+    if ((bit_index[j] >> 3) > stream_sizes[j]) return false;
+    memcpy(&bits[j], &streams[j][bit_index[j] >> 3], sizeof(uint64_t));
+    bits[j] >>= bit_index[j]&7;
+    d[i] = huffman_decode_symbol(decoder, &bits[j], &bit_index[j]);
+  }
+
+  for (j = 0; j < stream_count; ++j)
+    if (bit_index[j] > stream_sizes[j]*8) return false;
+
+  return true;
+
+}
+
+bool huffmanDecode(void *coded_data, const int coded_size, void *data, int *size)
+{
+
+  byte *d = data;
+
   byte *cd = coded_data;
   int coded_data_index = 0;
 
+  *size = 0;
+
+  if (coded_size < sizeof(uint32_t)) return false;
+
   uint32_t tmp;
   memcpy(&tmp, cd, sizeof(uint32_t));
-  *size = (int)tmp;
   coded_data_index += sizeof(uint32_t);
 
-  int node_count = (int)cd[coded_data_index++]+1;
+  if (tmp > INT_MAX) return false;
 
-  HuffmanNode nodes[MAX_NODE_COUNT];
-  huffman_init_nodes(nodes);
+  const int decoded_size = (int)tmp;
 
-  int i;
-  for (i = 0; i < node_count; ++i)
+  if (decoded_size == 0) return true;
+
+  if (coded_data_index+2 > coded_size) return false;
+
+  const int symbol_count = (int)cd[coded_data_index++]+1;
+
+  if (symbol_count == 1)
   {
-    memcpy(&nodes[i].frequency, &cd[coded_data_index], sizeof(uint32_t));
-    coded_data_index += sizeof(uint32_t);
-    nodes[i].symbol = cd[coded_data_index++];
+    memset(d, cd[coded_data_index], decoded_size);
+    *size = decoded_size;
+    return true;
   }
 
-  huffman_get_tree(nodes, 0);
+  byte code_lengths[BYTE_MAX+1];
+  const int code_lengths_size = huffman_read_code_lengths(&cd[coded_data_index], coded_size-coded_data_index, code_lengths);
+
+  if ((code_lengths_size < 0) || (!huffman_check_code_lengths(code_lengths, symbol_count))) return false;
+
+  coded_data_index += code_lengths_size;
 
-  HuffmanNode *pRoot = &nodes[0];
-  while (pRoot->parent) pRoot = pRoot->parent;
+  if (coded_data_index >= coded_size) return false;
 
-  uint32_t nCode;
-  byte *p = (byte*)&cd[coded_data_index];
-  int coded_data_bit_index = 0;
-  HuffmanNode *pNode;
-  while (data_index < *size)
+  const int stream_count = cd[coded_data_index++];
+
+  if ((stream_count == 0) || (stream_count > HUFFMAN_MAX_STREAM_COUNT) || (stream_count > decoded_size)) return false;
+
+  /* The streams have to lie within the coded data */
+  const byte *streams[HUFFMAN_MAX_STREAM_COUNT];
+  int64_t stream_sizes[HUFFMAN_MAX_STREAM_COUNT];
+  int64_t stream_start = coded_data_index+(int64_t)(stream_count-1)*sizeof(uint32_t);
+
+  if (stream_start > coded_size) return false;
+
+  int i;
+  for (i = 0; i < stream_count; ++i)
   {
 
-    nCode = (*(uint32_t*)(&p[coded_data_bit_index>>3]))>>(coded_data_bit_index&7);
-    pNode = pRoot;
-    while (pNode->left_child)
+    if (i < stream_count-1)
+    {
+      memcpy(&tmp, &cd[coded_data_index+i*sizeof(uint32_t)], sizeof(uint32_t));
+      stream_sizes[i] = tmp;
+    }
+    else
     {
-      pNode = (nCode&1) ? pNode->right_child : pNode->left_child;
-      nCode >>= 1;
-      ++coded_data_bit_index;
+      stream_sizes[i] = coded_size-stream_start;
     }
-    d[data_index++] = pNode->symbol;
+
+    if ((stream_sizes[i] < 0) || (stream_start+stream_sizes[i] > coded_size)) return false;
+
+    streams[i] = &cd[stream_start];
+    stream_start += stream_sizes[i];
 
   }
 
+  HuffmanDecoder decoder;
+  huffman_init_decoder(code_lengths, &decoder);
+
+  bool valid;
+
+  if (stream_count == 1)
+    valid = huffman_decode_stream(&decoder, streams[0], stream_sizes[0], d, decoded_size);
+  else if (stream_count == HUFFMAN_DEFAULT_STREAM_COUNT)
+    valid = huffman_decode_interleaved(&decoder, streams, stream_sizes, d, decoded_size, HUFFMAN_DEFAULT_STREAM_COUNT);
+  else
+    valid = huffman_decode_interleaved(&decoder, streams, stream_sizes, d, decoded_size, stream_count);
+
+  if (valid) *size = decoded_size;
+
+  return valid;
+
 }
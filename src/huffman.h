@@ -21,23 +21,66 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "types.h"
 
-#define MAX_NODE_COUNT 511
+/* Canonical Huffman codes over bytes. The coded block starts with the number
+ * of symbols, followed by the code lengths only (or the symbol if there is
+ * just one), then the number of streams, the byte sizes of all streams but
+ * the last and the LSB first bitstreams. Symbol i is coded in stream
+ * i % stream_count, so the decoder can follow the streams side by side. */
 
-typedef struct tHuffmanNode HuffmanNode;
+#define HUFFMAN_MAX_CODE_LENGTH 15
 
-struct tHuffmanNode
+/* Codes up to this length are decoded with one table lookup */
+#define HUFFMAN_TABLE_BITS 11
+
+#define HUFFMAN_MAX_STREAM_COUNT 16
+#define HUFFMAN_DEFAULT_STREAM_COUNT 4
+
+/* Inputs smaller than this are coded in one stream by default */
+#define HUFFMAN_MIN_INTERLEAVED_SIZE (1 << 14)
+
+typedef struct tHuffmanCode HuffmanCode;
+typedef struct tHuffmanTableEntry HuffmanTableEntry;
+typedef struct tHuffmanParameters HuffmanParameters;
+
+/* code is stored bit reversed, ready to be written LSB first */
+struct tHuffmanCode
 {
-  uint32_t frequency;
-  byte symbol;
   uint32_t code;
   int code_length;
-  HuffmanNode *parent, *left_child, *right_child;
 };
 
+/* Decoding table indexed by the next HUFFMAN_TABLE_BITS bits of the stream.
+ * code_length 0 marks longer codes, these are decoded canonically. */
+struct tHuffmanTableEntry
+{
+  byte symbol;
+  byte code_length;
+};
+
+/* Passed as parameters to huffmanEncode, NULL selects the defaults */
+struct tHuffmanParameters
+{
+  int stream_count;             /* 0 selects the default */
+  const uint32_t *histogram;    /* Byte histogram of the data, NULL to count it */
+};
+
+void huffman_histogram(const byte *data, const int size, uint32_t *histogram);
+
+/* Optimal code lengths limited to HUFFMAN_MAX_CODE_LENGTH, 0 for unused symbols */
+void huffman_code_lengths(const uint32_t *histogram, byte *code_lengths);
+void huffman_canonical_codes(const byte *code_lengths, HuffmanCode *codes);
+
+/* Upper bound of the coded size of size bytes */
+int huffmanEncodeBound(const int size);
+
 void huffmanEncode(void *data, const int size, void *coded_data, int *coded_size, void *parameters);
-void huffmanDecode(void *coded_data, const int coded_size, void *data, int *size);
+
+/* coded_data has to be readable for 8 bytes past coded_size. The coded data
+ * is checked as far as needed to stay within it, false if it is damaged. */
+bool huffmanDecode(void *coded_data, const int coded_size, void *data, int *size);
 
 #endif
@@ -20,7 +20,10 @@
 Image* ImageCreate(const int width, const int height, const ColourSpace cs)
 {
 
-  Image *image = malloc(sizeof(Image));
+  Image *image = HeapAlloc(sizeof(Image));
+
+  if (!image) return NULL;
+
   image->width = width;
   image->height = height;
   image->colour_space = cs;
@@ -28,20 +31,34 @@ Image* ImageCreate(const int width, const int height, const ColourSpace cs)
   switch (image->colour_space) {
     case Grayscale : image->channel_count = 1; break;
     case RGB :
-    case YCbCr411 : image->channel_count = 3; break;
+    case YCbCr411 :
+    case RGBDifference : image->channel_count = 3; break;
   }
 
-  image->channels = malloc(sizeof(Signal2D*)*image->channel_count);
+  image->channels = HeapAlloc(sizeof(Signal2D*)*image->channel_count);
 
-  int i;
-  if ((width == 0) || (height == 0))
+  if (!image->channels)
   {
-    for (i = 0; i < image->channel_count; ++i) image->channels[i] = NULL;
+    free(image);
+    return NULL;
   }
-  else
+
+  int i;
+  for (i = 0; i < image->channel_count; ++i) image->channels[i] = NULL;
+
+  if ((width == 0) || (height == 0)) return image;
+
+  for (i = 0; i < image->channel_count; ++i)
   {
-    for (i = 0; i < image->channel_count; ++i)
-      image->channels[i] = Signal2DCreate(image->width, image->height);
+
+    image->channels[i] = Signal2DCreate(image->width, image->height);
+
+    if (!image->channels[i])
+    {
+      ImageDestroy(image);
+      return NULL;
+    }
+
   }
 
   return image;
@@ -50,6 +67,8 @@ Image* ImageCreate(const int width, const int height, const ColourSpace cs)
 
 void ImageDestroy(Image *image) {
 
+  if (!image) return;
+
   int i;
   for (i = 0; i < image->channel_count; ++i)
     Signal2DDestroy(image->channels[i]);
@@ -60,128 +79,130 @@ void ImageDestroy(Image *image) {
 
 }
 
-Image* ImageLoadFromBMPFileAndCreate(const char *filename) {
-
-  FreeImage_Initialise(FALSE);
-
-  FIBITMAP *bmp = FreeImage_Load(FIF_BMP, filename, BMP_DEFAULT);
-
-  /*const int bpp = FreeImage_GetBPP(bmp);*/
-  const int w = FreeImage_GetWidth(bmp);
-  const int h = FreeImage_GetHeight(bmp);
+static void p_RGBToYCbCr(sample *c0, sample *c1, sample *c2, const int count)
+{
 
-  Image *result = ImageCreate(w, h, RGB);
+  int i = kernels.rgb_to_ycbcr(c0, c1, c2, count);
 
-  int x, y; byte *data;
-  for (y = 0; y < h; ++y)
+  for (; i < count; ++i)
   {
-    data = FreeImage_GetScanLine(bmp, h-y-1);
-    for (x = 0; x < w; ++x) {
-      result->channels[0]->data[result->channels[0]->data_pos++] = data[FI_RGBA_RED];
-      result->channels[1]->data[result->channels[1]->data_pos++] = data[FI_RGBA_GREEN];
-      result->channels[2]->data[result->channels[2]->data_pos++] = data[FI_RGBA_BLUE];
-      data += 3;
-    }
-  }
 
-  result->channels[0]->data_pos = 0;
-  result->channels[1]->data_pos = 0;
-  result->channels[2]->data_pos = 0;
+    const int32_t R = c0[i];
+    const int32_t G = c1[i];
+    const int32_t B = c2[i];
 
-  FreeImage_Unload(bmp);
+    c0[i] = ((R + (G<<1) + B) >> 2) - 128;
+    c1[i] = R - G;
+    c2[i] = B - G;
 
-  FreeImage_DeInitialise();
-
-  return result;
+  }
 
 }
 
-void ImageSaveAsBMPFile(Image *image, const char *filename) {
-
-  if (image->colour_space != RGB) return;
-
-  FreeImage_Initialise(FALSE);
-
-  const int bpp = 24;
-  const int w = image->width;
-  const int h = image->height;
-
-  FIBITMAP *bmp = FreeImage_Allocate(w, h, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+static void p_YCbCrToRGB(sample *c0, sample *c1, sample *c2, const int count)
+{
 
-  image->channels[0]->data_pos = 0;
-  image->channels[1]->data_pos = 0;
-  image->channels[2]->data_pos = 0;
+  int i = kernels.ycbcr_to_rgb(c0, c1, c2, count);
 
-  int x, y; byte *data;
-  for (y = 0; y < h; ++y)
+  for (; i < count; ++i)
   {
-    data = FreeImage_GetScanLine(bmp, h-y-1);
-    for (x = 0; x < w; ++x)
-    {
-      data[FI_RGBA_RED] = CLIP(image->channels[0]->data[image->channels[0]->data_pos]);
-      data[FI_RGBA_GREEN] = CLIP(image->channels[1]->data[image->channels[1]->data_pos]);
-      data[FI_RGBA_BLUE] = CLIP(image->channels[2]->data[image->channels[2]->data_pos]);
-      ++image->channels[0]->data_pos;
-      ++image->channels[1]->data_pos;
-      ++image->channels[2]->data_pos;
-      data += 3;
-    }
-  }
 
-  FreeImage_Save(FIF_BMP, bmp, filename, 0);
+    const int32_t Y = c0[i];
+    const int32_t Cb = c1[i];
+    const int32_t Cr = c2[i];
+    const int32_t G = Y - ((Cb + Cr) >> 2) + 128;
 
-  FreeImage_Unload(bmp);
+    c0[i] = Cb + G;
+    c1[i] = G;
+    c2[i] = Cr + G;
 
-  FreeImage_DeInitialise();
+  }
 
 }
 
-void ImageTransformColourSpace(Image *image, const ColourSpace new_cs)
+bool ImageTransformColourSpace(Image *image, const ColourSpace new_cs)
 {
 
-  if (image->colour_space == new_cs) return;
+  if (image->colour_space == new_cs) return true;
 
-  int i;
+  const int width = image->width;
+  const int height = image->height;
+  const int chroma_width = (width+1) >> 1;
+  const int chroma_height = (height+1) >> 1;
+
+  sample *c0 = image->channels[0]->data;
+  Signal2D *g, *b;
+
+  /* The chroma is resampled a row pair at a time, right after or before the
+   * colour transform of the pair, so that every pixel passes once. The last
+   * row of an odd height is its own pair. */
+  int i, j, row, rows;
 
   if ((image->colour_space == YCbCr411) && (new_cs == RGB)) /* YCbCr411 -> RGB */
   {
 
-    Signal2DUpsample2(image->channels[1], image->width, image->height);
-    Signal2DUpsample2(image->channels[2], image->width, image->height);
+    g = Signal2DCreateInArena(image->channels[1]->arena, width, height);
+    b = Signal2DCreateInArena(image->channels[2]->arena, width, height);
 
-    for (i = 0; i < image->width*image->height; ++i)
+    if ((!g) || (!b))
     {
+      Signal2DDestroy(g);
+      Signal2DDestroy(b);
+      return false;
+    }
 
-      const int32_t Y = image->channels[0]->data[i];
-      const int32_t Cb = image->channels[1]->data[i];
-      const int32_t Cr = image->channels[2]->data[i];
-      const int32_t G = Y - ((Cb + Cr) >> 2) + 128;
+    for (j = 0; j < chroma_height; ++j)
+    {
 
-      image->channels[0]->data[i] = Cb + G;
-      image->channels[1]->data[i] = G;
-      image->channels[2]->data[i] = Cr + G;
+      row = (j<<1)*width;
+      rows = ((j<<1)+1 < height) ? 2 : 1;
+
+      Signal2DUpsampleRowPair(&image->channels[1]->data[j*chroma_width], width, &g->data[row], &g->data[row+(rows-1)*width]);
+      Signal2DUpsampleRowPair(&image->channels[2]->data[j*chroma_width], width, &b->data[row], &b->data[row+(rows-1)*width]);
+
+      p_YCbCrToRGB(&c0[row], &g->data[row], &b->data[row], rows*width);
 
     }
 
+    Signal2DDestroy(image->channels[1]);
+    Signal2DDestroy(image->channels[2]);
+    image->channels[1] = g;
+    image->channels[2] = b;
+
   }
   else if ((image->colour_space == RGB) && (new_cs == YCbCr411)) /* RGB -> YCbCr411 */
   {
 
-    for (i = 0; i < image->width*image->height; ++i)
+    for (j = 0; j < chroma_height; ++j)
     {
 
-      const int32_t R = image->channels[0]->data[i];
-      const int32_t G = image->channels[1]->data[i];
-      const int32_t B = image->channels[2]->data[i];
+      row = (j<<1)*width;
+      rows = ((j<<1)+1 < height) ? 2 : 1;
 
-      image->channels[0]->data[i] = ((R + (G<<1) + B) >> 2) - 128;
-      image->channels[1]->data[i] = R - G;
-      image->channels[2]->data[i] = B - G;
+      p_RGBToYCbCr(&c0[row], &image->channels[1]->data[row], &image->channels[2]->data[row], rows*width);
+
+      for (i = 1; i < 3; ++i)
+        Signal2DDownsampleRowPair(&image->channels[i]->data[row], &image->channels[i]->data[row+(rows-1)*width], width,
+                                  &image->channels[i]->data[j*chroma_width]);
 
     }
 
-    Signal2DDownsample2(image->channels[1]);
-    Signal2DDownsample2(image->channels[2]);
+    Signal2DShrink(image->channels[1], chroma_width, chroma_height);
+    Signal2DShrink(image->channels[2], chroma_width, chroma_height);
+
+  }
+  else if ((image->colour_space == RGB) && (new_cs == RGBDifference)) /* RGB -> RGBDifference */
+  {
+
+    Signal2DSub(image->channels[1], image->channels[0]);
+    Signal2DSub(image->channels[2], image->channels[0]);
+
+  }
+  else if ((image->colour_space == RGBDifference) && (new_cs == RGB)) /* RGBDifference -> RGB */
+  {
+
+    Signal2DAdd(image->channels[1], image->channels[0]);
+    Signal2DAdd(image->channels[2], image->channels[0]);
 
   }
   else if ((image->colour_space == RGB) && (new_cs == Grayscale)) /* RGB -> Grayscale */
@@ -218,4 +239,158 @@ void ImageTransformColourSpace(Image *image, const ColourSpace new_cs)
 
   image->colour_space = new_cs;
 
+  return true;
+
+}
+
+void ImageReadRGB8(Image *image, const uint8_t *pixels, const int stride)
+{
+
+  const int width = image->width;
+  const int half_width = width >> 1;
+  const int chroma_width = (width+1) >> 1;
+
+  sample *c0 = image->channels[0]->data;
+  sample *c1 = image->channels[1]->data;
+  sample *c2 = image->channels[2]->data;
+
+  const uint8_t *rgb0, *rgb1;
+  sample *y0, *y1, *cb, *cr;
+
+  int i, j, x;
+
+  if (image->colour_space == YCbCr411)
+  {
+
+    /* A row pair of pixels gives two Y rows and a row of the means of the
+     * 2 x 2 chroma. The last row of an odd height is its own pair. */
+    for (j = 0; j < image->height; j += 2)
+    {
+
+      rgb0 = &pixels[(size_t)j*stride];
+      rgb1 = (j+1 < image->height) ? rgb0+stride : rgb0;
+      y0 = &c0[j*width];
+      y1 = (j+1 < image->height) ? y0+width : y0;
+      cb = &c1[(j>>1)*chroma_width];
+      cr = &c2[(j>>1)*chroma_width];
+
+      i = kernels.rgb8_to_ycbcr_row_pair(rgb0, rgb1, half_width, y0, y1, cb, cr);
+
+      for (x = i<<1; x < width; ++x)
+      {
+        y0[x] = ((rgb0[x*3] + (rgb0[x*3+1]<<1) + rgb0[x*3+2]) >> 2) - 128;
+        y1[x] = ((rgb1[x*3] + (rgb1[x*3+1]<<1) + rgb1[x*3+2]) >> 2) - 128;
+      }
+
+      for (; i < half_width; ++i)
+      {
+        x = i*6;
+        cb[i] = (rgb0[x] - rgb0[x+1] + rgb0[x+3] - rgb0[x+4] + rgb1[x] - rgb1[x+1] + rgb1[x+3] - rgb1[x+4]) >> 2;
+        cr[i] = (rgb0[x+2] - rgb0[x+1] + rgb0[x+5] - rgb0[x+4] + rgb1[x+2] - rgb1[x+1] + rgb1[x+5] - rgb1[x+4]) >> 2;
+      }
+
+      if (width % 2)
+      {
+        x = (width-1)*3;
+        cb[half_width] = (rgb0[x] - rgb0[x+1] + rgb1[x] - rgb1[x+1]) >> 1;
+        cr[half_width] = (rgb0[x+2] - rgb0[x+1] + rgb1[x+2] - rgb1[x+1]) >> 1;
+      }
+
+    }
+
+  }
+  else
+  {
+
+    const bool difference = (image->colour_space == RGBDifference);
+
+    for (j = 0; j < image->height; ++j)
+    {
+      rgb0 = &pixels[(size_t)j*stride];
+      for (x = 0; x < width; ++x)
+      {
+        *c0++ = rgb0[0];
+        *c1++ = difference ? rgb0[1] - rgb0[0] : rgb0[1];
+        *c2++ = difference ? rgb0[2] - rgb0[0] : rgb0[2];
+        rgb0 += 3;
+      }
+    }
+
+  }
+
+}
+
+static inline void p_StorePixel(uint8_t *pixel, const int32_t R, const int32_t G, const int32_t B, const PixelFormat format)
+{
+
+  pixel[(format == PixelBGR8) ? 2 : 0] = CLIP(R);
+  pixel[1] = CLIP(G);
+  pixel[(format == PixelBGR8) ? 0 : 2] = CLIP(B);
+
+  if (format == PixelRGBA8) pixel[3] = BYTE_MAX;
+
+}
+
+void ImageRowToPixels(const ColourSpace cs, const sample *c0, const sample *c1, const sample *c2, const int x,
+                      const int width, uint8_t *pixels, const PixelFormat format)
+{
+
+  const int pixel_size = PIXEL_SIZE(format);
+
+  int32_t Y, R, G, B;
+
+  int i, n = 0;
+
+  if (cs == YCbCr411)
+  {
+
+    /* The kernel starts at a pixel pair, of which the chroma is one sample */
+    if (x % 2 == 0) n = kernels.ycbcr_to_pixels_row(&c0[x], &c1[x>>1], &c2[x>>1], width >> 1, pixels, format) << 1;
+
+    for (; n < width; ++n)
+    {
+      i = x+n;
+      Y = c0[i];
+      G = Y - ((c1[i>>1] + c2[i>>1]) >> 2) + 128;
+      p_StorePixel(&pixels[n*pixel_size], c1[i>>1] + G, G, c2[i>>1] + G, format);
+    }
+
+  }
+  else
+  {
+
+    const bool difference = (cs == RGBDifference);
+
+    for (; n < width; ++n)
+    {
+      i = x+n;
+      R = c0[i];
+      G = difference ? c1[i] + R : c1[i];
+      B = difference ? c2[i] + R : c2[i];
+      p_StorePixel(&pixels[n*pixel_size], R, G, B, format);
+    }
+
+  }
+
+}
+
+void ImageWritePixels(const Image *image, const int x, const int y, const int width, const int height, uint8_t *pixels,
+                      const int stride, const PixelFormat format)
+{
+
+  const bool subsampled = (image->colour_space == YCbCr411);
+  const int chroma_width = subsampled ? (image->width+1) >> 1 : image->width;
+
+  int j, chroma_row;
+  for (j = 0; j < height; ++j)
+  {
+
+    chroma_row = subsampled ? (y+j) >> 1 : y+j;
+
+    ImageRowToPixels(image->colour_space, &image->channels[0]->data[(y+j)*image->width],
+                     &image->channels[1]->data[chroma_row*chroma_width], &image->channels[2]->data[chroma_row*chroma_width],
+                     x, width, &pixels[(int64_t)j*stride], format);
+
+  }
+
 }
@@ -22,13 +22,14 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <FreeImage.h>
-
 #include "types.h"
+#include "heap.h"
 
 #include "signal.h"
 
-enum tColourSpace { Grayscale = 0, RGB, YCbCr411 };
+/* RGBDifference is R, G-R and B-R, the planes of lossless images. The
+ * chroma planes of YCbCr411 have half the width and height (rounded up). */
+enum tColourSpace { Grayscale = 0, RGB, YCbCr411, RGBDifference };
 typedef enum tColourSpace ColourSpace;
 
 struct tImage
@@ -41,12 +42,29 @@ struct tImage
 };
 typedef struct tImage Image;
 
+/* NULL if out of memory */
 Image* ImageCreate(const int width, const int height, const ColourSpace cs);
 void ImageDestroy(Image *image);
 
-Image* ImageLoadFromBMPFileAndCreate(const char *filename);
-void ImageSaveAsBMPFile(Image *image, const char *filename);
+/* False if out of memory, the image is then left as it was */
+bool ImageTransformColourSpace(Image *image, const ColourSpace new_cs);
+
+/* Reads interleaved RGB8 pixels, rows stride bytes apart, into the planes of
+ * image, which are of the size its colour space (RGB, YCbCr411 or
+ * RGBDifference) gives them. The colour transform and the chroma means are
+ * done on the way, in one pass. */
+void ImageReadRGB8(Image *image, const uint8_t *pixels, const int stride);
+
+/* Writes width pixels from x of a row of the planes of colour space cs as
+ * clipped, interleaved pixels of format, converted on the way. For YCbCr411
+ * c1 and c2 are the chroma row under the row of c0. */
+void ImageRowToPixels(const ColourSpace cs, const sample *c0, const sample *c1, const sample *c2, const int x,
+                      const int width, uint8_t *pixels, const PixelFormat format);
 
-void ImageTransformColourSpace(Image *image, const ColourSpace new_cs);
+/* ImageRowToPixels for the width x height pixels from x, y of image, the
+ * rows of pixels are stride bytes apart. A negative stride writes them
+ * bottom-up. */
+void ImageWritePixels(const Image *image, const int x, const int y, const int width, const int height, uint8_t *pixels,
+                      const int stride, const PixelFormat format);
 
 #endif
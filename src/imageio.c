@@ -0,0 +1,1021 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "imageio.h"
+
+static StatsFormat p_stats_format = StatsNone;
+
+void ImageIOInit(void)
+{
+
+  FreeImage_Initialise(FALSE);
+
+}
+
+void ImageIODestroy(void)
+{
+
+  FreeImage_DeInitialise();
+
+}
+
+static const char *p_stats_format_names[StatsFormatCount] = { "none", "json", "csv" };
+
+bool StatsFormatParse(const char *name, StatsFormat *format)
+{
+
+  int i;
+  for (i = 0; i < StatsFormatCount; ++i)
+  {
+    if (strcmp(name, p_stats_format_names[i]) == 0)
+    {
+      *format = i;
+      return true;
+    }
+  }
+
+  return false;
+
+}
+
+void ImageIOSetStatsFormat(const StatsFormat format)
+{
+
+  p_stats_format = format;
+
+  if (format == StatsCSV)
+    fprintf(stderr, "file,stage,wall,cpu,bytes_in,bytes_out,allocations,peak_rss\n");
+
+}
+
+/* Quotes a file name for JSON or CSV */
+static void p_PrintQuoted(const char *text)
+{
+
+  fputc('"', stderr);
+
+  for (; *text; ++text)
+  {
+    if (p_stats_format == StatsCSV)
+    {
+      if (*text == '"') fputc('"', stderr);
+      fputc(*text, stderr);
+    }
+    else if ((*text == '"') || (*text == '\\'))
+    {
+      fprintf(stderr, "\\%c", *text);
+    }
+    else if ((unsigned char)*text < 0x20)
+    {
+      fprintf(stderr, "\\u%04x", *text);
+    }
+    else
+    {
+      fputc(*text, stderr);
+    }
+  }
+
+  fputc('"', stderr);
+
+}
+
+static void p_PrintStage(const char *filename, const char *name, const Stage *stage)
+{
+
+  if (p_stats_format == StatsJSON)
+  {
+    fprintf(stderr, "{\"file\":");
+    p_PrintQuoted(filename);
+    fprintf(stderr, ",\"stage\":\"%s\",\"wall\":%.6f,\"cpu\":%.6f,\"bytes_in\":%zu,\"bytes_out\":%zu,"
+                    "\"allocations\":%lld,\"peak_rss\":%zu}\n",
+            name, stage->wall, stage->cpu, stage->bytes_in, stage->bytes_out, (long long)stage->allocations, stage->peak_rss);
+  }
+  else
+  {
+    p_PrintQuoted(filename);
+    fprintf(stderr, ",%s,%.6f,%.6f,%zu,%zu,%lld,%zu\n", name, stage->wall, stage->cpu, stage->bytes_in, stage->bytes_out,
+            (long long)stage->allocations, stage->peak_rss);
+  }
+
+}
+
+void FileStatsPrint(const char *filename, const FileStats *stats, const bool compress)
+{
+
+  if (p_stats_format == StatsNone) return;
+
+  p_PrintStage(filename, "read", &stats->read);
+
+  if (compress)
+  {
+    p_PrintStage(filename, "colour", &stats->stages.colour);
+    p_PrintStage(filename, "transform", &stats->stages.transform);
+    p_PrintStage(filename, "coding", &stats->stages.coding);
+  }
+  else
+  {
+    p_PrintStage(filename, "coding", &stats->stages.coding);
+    p_PrintStage(filename, "transform", &stats->stages.transform);
+    p_PrintStage(filename, "colour", &stats->stages.colour);
+  }
+
+  p_PrintStage(filename, "write", &stats->write);
+
+}
+
+/* Size of the file, 0 if unknown */
+static size_t p_FileSize(const char *filename)
+{
+
+  struct stat st;
+
+  return (stat(filename, &st) == 0) ? (size_t)st.st_size : 0;
+
+}
+
+Image* ImageLoadFromBMPFileAndCreate(const char *filename, FileStats *stats) {
+
+  StageClock start;
+  StageStart(&start);
+
+  FIBITMAP *bmp = FreeImage_Load(FIF_BMP, filename, BMP_DEFAULT);
+
+  if (!bmp)
+  {
+
+    printf("Cannot read %s.\n", filename);
+
+    return NULL;
+
+  }
+
+  /*const int bpp = FreeImage_GetBPP(bmp);*/
+  const int w = FreeImage_GetWidth(bmp);
+  const int h = FreeImage_GetHeight(bmp);
+
+  Image *result = ImageCreate(w, h, RGB);
+
+  if (!result)
+  {
+
+    printf("%s\n", BILDStatusMessage(BILDErrorMemory));
+
+    FreeImage_Unload(bmp);
+    return NULL;
+
+  }
+
+  int x, y; byte *data;
+  for (y = 0; y < h; ++y)
+  {
+    data = FreeImage_GetScanLine(bmp, h-y-1);
+    for (x = 0; x < w; ++x) {
+      result->channels[0]->data[result->channels[0]->data_pos++] = data[FI_RGBA_RED];
+      result->channels[1]->data[result->channels[1]->data_pos++] = data[FI_RGBA_GREEN];
+      result->channels[2]->data[result->channels[2]->data_pos++] = data[FI_RGBA_BLUE];
+      data += 3;
+    }
+  }
+
+  result->channels[0]->data_pos = 0;
+  result->channels[1]->data_pos = 0;
+  result->channels[2]->data_pos = 0;
+
+  FreeImage_Unload(bmp);
+
+  if (stats) StageStop(&start, p_FileSize(filename), (size_t)w*h*3*sizeof(sample), &stats->read);
+
+  return result;
+
+}
+
+void ImageSaveAsBMPFile(Image *image, const char *filename) {
+
+  if (image->colour_space != RGB) return;
+
+  const int bpp = 24;
+  const int w = image->width;
+  const int h = image->height;
+
+  FIBITMAP *bmp = FreeImage_Allocate(w, h, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+
+  image->channels[0]->data_pos = 0;
+  image->channels[1]->data_pos = 0;
+  image->channels[2]->data_pos = 0;
+
+  int x, y; byte *data;
+  for (y = 0; y < h; ++y)
+  {
+    data = FreeImage_GetScanLine(bmp, h-y-1);
+    for (x = 0; x < w; ++x)
+    {
+      data[FI_RGBA_RED] = CLIP(image->channels[0]->data[image->channels[0]->data_pos]);
+      data[FI_RGBA_GREEN] = CLIP(image->channels[1]->data[image->channels[1]->data_pos]);
+      data[FI_RGBA_BLUE] = CLIP(image->channels[2]->data[image->channels[2]->data_pos]);
+      ++image->channels[0]->data_pos;
+      ++image->channels[1]->data_pos;
+      ++image->channels[2]->data_pos;
+      data += 3;
+    }
+  }
+
+  FreeImage_Save(FIF_BMP, bmp, filename, 0);
+
+  FreeImage_Unload(bmp);
+
+}
+
+/* Writes the coded image to f, opened for filename, and closes it */
+static bool p_WriteCodedFile(FILE *f, const char *filename, const byte *coded_data, const size_t coded_size, FileStats *stats)
+{
+
+  StageClock start;
+  StageStart(&start);
+
+  const bool result = (fwrite(coded_data, sizeof(byte), coded_size, f) == coded_size);
+
+  fclose(f);
+
+  if (!result)
+  {
+    printf("Cannot write %s.\n", filename);
+    return false;
+  }
+
+  if (stats)
+  {
+    StageStop(&start, coded_size, coded_size, &stats->write);
+    stats->coded_size = coded_size;
+  }
+
+  return true;
+
+}
+
+/* Adds the stages of the last image of the codec */
+static void p_AddStages(FileStats *stats, const BILDStages *stages)
+{
+
+  if (!stats) return;
+
+  StageAdd(&stats->stages.colour, &stages->colour);
+  StageAdd(&stats->stages.transform, &stages->transform);
+  StageAdd(&stats->stages.coding, &stages->coding);
+
+}
+
+bool BILDEncoderSaveFile(BILDEncoder *encoder, Image *image, const char *filename, const int quality, const EntropyCoderID coder,
+                         FileStats *stats)
+{
+
+  FILE *f = fopen(filename, "wb");
+
+  if (!f)
+  {
+
+    printf("Cannot open %s.\n", filename);
+
+    return false;
+
+  }
+
+  const byte *coded_data;
+  size_t coded_size;
+
+  BILDStatus status = BILDEncoderEncodeImage(encoder, image, quality, coder, &coded_data, &coded_size);
+
+  if (status != BILDOk)
+  {
+
+    printf("%s\n", BILDStatusMessage(status));
+
+    fclose(f);
+    return false;
+
+  }
+
+  if (stats) stats->pixel_count = (int64_t)image->width*image->height;
+
+  p_AddStages(stats, BILDEncoderStages(encoder));
+
+  return p_WriteCodedFile(f, filename, coded_data, coded_size, stats);
+
+}
+
+/* Scanlines passed to the encoder at a time */
+#define STREAM_ROWS 64
+
+bool BILDEncoderStreamBMPFile(BILDEncoder *encoder, const char *bmp_filename, const char *filename, const int quality,
+                              const EntropyCoderID coder, FileStats *stats)
+{
+
+  FILE *f = fopen(filename, "wb");
+
+  if (!f)
+  {
+
+    printf("Cannot open %s.\n", filename);
+
+    return false;
+
+  }
+
+  StageClock start;
+  StageStart(&start);
+
+  FIBITMAP *bmp = FreeImage_Load(FIF_BMP, bmp_filename, BMP_DEFAULT);
+
+  if (!bmp)
+  {
+
+    printf("Cannot read %s.\n", bmp_filename);
+
+    fclose(f);
+    return false;
+
+  }
+
+  const int w = FreeImage_GetWidth(bmp);
+  const int h = FreeImage_GetHeight(bmp);
+
+  if (stats) StageStop(&start, p_FileSize(bmp_filename), (size_t)h*FreeImage_GetPitch(bmp), &stats->read);
+
+  BILDStatus status = BILDEncoderBegin(encoder, w, h, BILDPixelRGB8, quality, coder);
+
+  byte *rows = malloc((size_t)STREAM_ROWS*w*3);
+
+  if ((status == BILDOk) && (!rows)) status = BILDErrorMemory;
+
+  int x, y, i, n; byte *data, *pixel;
+  for (y = 0; (status == BILDOk) && (y < h); y += n)
+  {
+
+    n = MIN(STREAM_ROWS, h-y);
+
+    for (i = 0; i < n; ++i)
+    {
+      data = FreeImage_GetScanLine(bmp, h-y-i-1);
+      pixel = &rows[(size_t)i*w*3];
+      for (x = 0; x < w; ++x) {
+        pixel[0] = data[FI_RGBA_RED];
+        pixel[1] = data[FI_RGBA_GREEN];
+        pixel[2] = data[FI_RGBA_BLUE];
+        data += 3;
+        pixel += 3;
+      }
+    }
+
+    status = BILDEncoderWriteRows(encoder, rows, n, w*3);
+
+  }
+
+  free(rows);
+
+  FreeImage_Unload(bmp);
+
+  const byte *coded_data;
+  size_t coded_size;
+
+  if (status == BILDOk) status = BILDEncoderEnd(encoder, &coded_data, &coded_size);
+
+  if (status != BILDOk)
+  {
+
+    printf("%s\n", BILDStatusMessage(status));
+
+    fclose(f);
+    return false;
+
+  }
+
+  if (stats) stats->pixel_count = (int64_t)w*h;
+
+  p_AddStages(stats, BILDEncoderStages(encoder));
+
+  return p_WriteCodedFile(f, filename, coded_data, coded_size, stats);
+
+}
+
+bool ImageSaveAsBILDFile(Image *image, const char *filename, const int quality, const EntropyCoderID coder, const int tile_size,
+                         FileStats *stats)
+{
+
+  BILDEncoder *encoder = BILDEncoderCreate();
+
+  if (!encoder)
+  {
+    printf("%s\n", BILDStatusMessage(BILDErrorMemory));
+    return false;
+  }
+
+  BILDEncoderSetTileSize(encoder, tile_size);
+
+  const bool result = BILDEncoderSaveFile(encoder, image, filename, quality, coder, stats);
+
+  BILDEncoderDestroy(encoder);
+
+  return result;
+
+}
+
+static FileAccess p_file_access = FileAccessAuto;
+
+static const char *p_file_access_names[FileAccessCount] = { "auto", "populate", "sequential", "read" };
+
+bool FileAccessParse(const char *name, FileAccess *access)
+{
+
+  int i;
+  for (i = 0; i < FileAccessCount; ++i)
+  {
+    if (strcmp(name, p_file_access_names[i]) == 0)
+    {
+      *access = i;
+      return true;
+    }
+  }
+
+  return false;
+
+}
+
+void ImageIOSetFileAccess(const FileAccess access)
+{
+
+  p_file_access = access;
+
+}
+
+/* Maps the file read-only over an anonymous mapping, the zero bytes behind
+ * the file are its padding */
+static bool p_MapFile(const int fd, const FileAccess access, InputFile *file)
+{
+
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t length = (file->size+BILD_PADDING+page_size-1) & ~(page_size-1);
+
+  byte *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (data == MAP_FAILED) return false;
+
+  if (mmap(data, file->size, PROT_READ, MAP_PRIVATE | MAP_FIXED | ((access == FileAccessPopulate) ? MAP_POPULATE : 0),
+           fd, 0) == MAP_FAILED)
+  {
+    munmap(data, length);
+    return false;
+  }
+
+  if (access == FileAccessSequential) madvise(data, file->size, MADV_SEQUENTIAL);
+
+  file->data = data;
+  file->length = length;
+
+  return true;
+
+}
+
+/* Reads as much of the file as is needed to decode it at scale, the whole
+ * file for scale 0 */
+static bool p_ReadFile(const int fd, const int scale, InputFile *file)
+{
+
+  /* The headers tell how long the prefix is, they are read step by step
+   * until BILDScaledPrefixSize knows. A short file is left to the decoder
+   * to report. */
+  const size_t file_size = file->size;
+  size_t wanted = (scale > 0) ? sizeof(BILDHeader) : file_size;
+  ssize_t count;
+  byte *data = NULL;
+  byte *grown;
+
+  file->size = 0;
+
+  for (;;)
+  {
+
+    wanted = MIN(wanted, file_size);
+
+    grown = realloc(data, wanted+BILD_PADDING);
+
+    if (!grown)
+    {
+      free(data);
+      file->data = NULL;
+      return false;
+    }
+
+    data = grown;
+
+    while ((file->size < wanted) && ((count = read(fd, &data[file->size], wanted-file->size)) > 0))
+      file->size += count;
+
+    if (file->size != wanted) break;
+
+    if ((scale == 0) || (file->size == file_size)) break;
+
+    if (BILDScaledPrefixSize(data, file->size, scale, &wanted) != BILDErrorTruncated) break;
+
+    if (wanted <= file->size) break;
+
+  }
+
+  memset(&data[file->size], 0, BILD_PADDING);
+
+  file->data = data;
+  file->length = 0;
+
+  return (file->size >= MIN(wanted, file_size));
+
+}
+
+bool InputFileOpen(InputFile *file, const char *filename, const int scale, const BILDRect *region, FileAccess access)
+{
+
+  struct stat st;
+  const int fd = open(filename, O_RDONLY);
+
+  if ((fd < 0) || (fstat(fd, &st) != 0))
+  {
+
+    printf("Cannot open %s.\n", filename);
+
+    if (fd >= 0) close(fd);
+    return false;
+
+  }
+
+  if (access == FileAccessAuto)
+    access = ((scale == 0) && !region) ? FileAccessPopulate : FileAccessSequential;
+
+  file->size = st.st_size;
+
+  /* Pipes and empty files cannot be mapped */
+  bool result = (access != FileAccessRead) && S_ISREG(st.st_mode) && (file->size > 0) && p_MapFile(fd, access, file);
+
+  if (!result)
+  {
+
+    result = p_ReadFile(fd, scale, file);
+
+    if (!result)
+    {
+      printf("Cannot read %s.\n", filename);
+      free(file->data);
+    }
+
+  }
+
+  close(fd);
+
+  return result;
+
+}
+
+void InputFileClose(InputFile *file)
+{
+
+  if (file->length > 0)
+    munmap(file->data, file->length);
+  else
+    free(file->data);
+
+}
+
+bool BILDEncoderCodeBMP(BILDEncoder *encoder, const InputFile *file, const int quality, const EntropyCoderID coder,
+                        Buffer *pixels, const byte **coded_data, size_t *coded_size, FileStats *stats)
+{
+
+  StageClock start;
+  StageStart(&start);
+
+  FIMEMORY *memory = FreeImage_OpenMemory(file->data, file->size);
+  FIBITMAP *bmp = FreeImage_LoadFromMemory(FIF_BMP, memory, BMP_DEFAULT);
+
+  FreeImage_CloseMemory(memory);
+
+  if (!bmp)
+  {
+
+    printf("No BMP file.\n");
+
+    return false;
+
+  }
+
+  const int w = FreeImage_GetWidth(bmp);
+  const int h = FreeImage_GetHeight(bmp);
+
+  /* Tiled images may be larger, BILDEncode checks the size */
+  if ((int64_t)w*h > BILD_MAX_TILED_SIZE*(int64_t)BILD_MAX_TILED_SIZE)
+  {
+
+    printf("%s\n", BILDStatusMessage(BILDErrorArgument));
+
+    FreeImage_Unload(bmp);
+    return false;
+
+  }
+
+  pixels->size = 0;
+  byte *rows = BufferReserve(pixels, (size_t)w*h*3);
+
+  if (!rows)
+  {
+
+    printf("%s\n", BILDStatusMessage(BILDErrorMemory));
+
+    FreeImage_Unload(bmp);
+    return false;
+
+  }
+
+  int x, y; byte *data, *pixel = rows;
+  for (y = 0; y < h; ++y)
+  {
+    data = FreeImage_GetScanLine(bmp, h-y-1);
+    for (x = 0; x < w; ++x) {
+      pixel[0] = data[FI_RGBA_RED];
+      pixel[1] = data[FI_RGBA_GREEN];
+      pixel[2] = data[FI_RGBA_BLUE];
+      data += 3;
+      pixel += 3;
+    }
+  }
+
+  FreeImage_Unload(bmp);
+
+  /* The file was counted in when it was read */
+  if (stats) StageStop(&start, 0, (size_t)w*h*3, &stats->read);
+
+  BILDStatus status = BILDEncode(encoder, rows, w, h, w*3, BILDPixelRGB8, quality, (BILDCoder)coder, coded_data, coded_size);
+
+  if (status != BILDOk)
+  {
+
+    printf("%s\n", BILDStatusMessage(status));
+
+    return false;
+
+  }
+
+  if (stats)
+  {
+    stats->pixel_count = (int64_t)w*h;
+    stats->coded_size = *coded_size;
+  }
+
+  p_AddStages(stats, BILDEncoderStages(encoder));
+
+  return true;
+
+}
+
+static void p_PrintStatus(const BILDStatus status, const byte *data, const size_t size)
+{
+
+  BILDInfo info;
+
+  if ((status == BILDErrorVersion) && (BILDReadInfo(data, size, &info) == BILDErrorVersion))
+    printf("Wrong BILD file version: Found %d but expected %d.\n", info.version, VERSION);
+  else
+    printf("%s\n", BILDStatusMessage(status));
+
+}
+
+Image* BILDDecoderLoadFile(BILDDecoder *decoder, const char *filename, const int scale, const BILDRect *region)
+{
+
+  InputFile file;
+
+  if (!InputFileOpen(&file, filename, scale, region, p_file_access)) return NULL;
+
+  Image *result;
+  BILDDecoderSetPadding(decoder, BILD_PADDING);
+  BILDStatus status = BILDDecoderDecodeImage(decoder, file.data, file.size, scale, region, &result);
+  BILDDecoderSetPadding(decoder, 0);
+
+  if (status != BILDOk)
+  {
+
+    p_PrintStatus(status, file.data, file.size);
+
+    InputFileClose(&file);
+    return NULL;
+
+  }
+
+  InputFileClose(&file);
+
+  return result;
+
+}
+
+Image *ImageLoadFromBILDFileAndCreate(const char *filename, const int scale, const BILDRect *region)
+{
+
+  BILDDecoder *decoder = BILDDecoderCreateOnHeap();
+
+  if (!decoder)
+  {
+    printf("%s\n", BILDStatusMessage(BILDErrorMemory));
+    return NULL;
+  }
+
+  Image *result = BILDDecoderLoadFile(decoder, filename, scale, region);
+
+  BILDDecoderDestroy(decoder);
+
+  return result;
+
+}
+
+/* Decodes the BILD file into a new bitmap, NULL on failure */
+static FIBITMAP* p_DecodeBitmap(BILDDecoder *decoder, const InputFile *file, const int scale, const BILDRect *region,
+                                FileStats *stats)
+{
+
+  BILDInfo info;
+  BILDStatus status = BILDReadInfo(file->data, file->size, &info);
+
+  int w = 0, h = 0;
+
+  if (status == BILDOk)
+  {
+    BILDScaledSize(&info, scale, &w, &h);
+    if (region)
+    {
+      w = region->width;
+      h = region->height;
+    }
+  }
+
+  FIBITMAP *bmp = (status == BILDOk) ? FreeImage_Allocate(w, h, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK) : NULL;
+
+  /* The bitmap is bottom-up, its top row is the last scanline. The pixels
+   * go straight into it. */
+  if (bmp)
+  {
+    BILDDecoderSetPadding(decoder, BILD_PADDING);
+    status = BILDDecodeRegion(decoder, file->data, file->size, scale, region, FreeImage_GetScanLine(bmp, h-1),
+                              -(int)FreeImage_GetPitch(bmp), (FI_RGBA_RED == 2) ? BILDPixelBGR8 : BILDPixelRGB8);
+    BILDDecoderSetPadding(decoder, 0);
+  }
+  else if (status == BILDOk)
+  {
+    status = BILDErrorArgument;
+  }
+
+  if (status != BILDOk)
+  {
+
+    p_PrintStatus(status, file->data, file->size);
+
+    if (bmp) FreeImage_Unload(bmp);
+    return NULL;
+
+  }
+
+  if (stats)
+  {
+    stats->pixel_count = (int64_t)w*h;
+    stats->coded_size = file->size;
+  }
+
+  p_AddStages(stats, BILDDecoderStages(decoder));
+
+  return bmp;
+
+}
+
+bool BILDDecoderSaveBMPFile(BILDDecoder *decoder, const char *filename, const char *bmp_filename, const int scale,
+                            const BILDRect *region, FileStats *stats)
+{
+
+  InputFile file;
+
+  StageClock start;
+  StageStart(&start);
+
+  if (!InputFileOpen(&file, filename, scale, region, p_file_access)) return false;
+
+  if (stats) StageStop(&start, file.size, file.size, &stats->read);
+
+  FIBITMAP *bmp = p_DecodeBitmap(decoder, &file, scale, region, stats);
+
+  if (!bmp)
+  {
+    InputFileClose(&file);
+    return false;
+  }
+
+  InputFileClose(&file);
+
+  StageStart(&start);
+
+  const bool result = FreeImage_Save(FIF_BMP, bmp, bmp_filename, 0);
+
+  if (!result) printf("Cannot write %s.\n", bmp_filename);
+
+  if (result && stats)
+    StageStop(&start, (size_t)FreeImage_GetHeight(bmp)*FreeImage_GetPitch(bmp), p_FileSize(bmp_filename), &stats->write);
+
+  FreeImage_Unload(bmp);
+
+  return result;
+
+}
+
+FIMEMORY* BILDDecoderDecodeBMP(BILDDecoder *decoder, const InputFile *file, const int scale, const BILDRect *region,
+                               FileStats *stats)
+{
+
+  FIBITMAP *bmp = p_DecodeBitmap(decoder, file, scale, region, stats);
+
+  if (!bmp) return NULL;
+
+  StageClock start;
+  StageStart(&start);
+
+  FIMEMORY *memory = FreeImage_OpenMemory(NULL, 0);
+
+  if (!FreeImage_SaveToMemory(FIF_BMP, bmp, memory, 0))
+  {
+
+    printf("Cannot write BMP file.\n");
+
+    FreeImage_CloseMemory(memory);
+    memory = NULL;
+
+  }
+  else if (stats)
+  {
+    /* The file is counted out when it is written */
+    StageStop(&start, (size_t)FreeImage_GetHeight(bmp)*FreeImage_GetPitch(bmp), 0, &stats->write);
+  }
+
+  FreeImage_Unload(bmp);
+
+  return memory;
+
+}
+
+/* Empirical entropy of the symbols counted in histogram in bits per symbol */
+static double p_Entropy(const uint32_t *histogram, const int64_t count)
+{
+
+  double entropy = 0;
+
+  int i;
+  for (i = 0; i < BYTE_MAX+1; ++i)
+    if (histogram[i] > 0) entropy -= histogram[i]*log2((double)histogram[i]/count);
+
+  return (count > 0) ? entropy/count : 0;
+
+}
+
+/* Prints a row per subband of the image in filename. The code lengths are
+ * those a standalone Huffman code for the subband would have, over the
+ * symbols the entropy coder of the image sees (run length coded from
+ * quality 3 on), given as <code length>:<number of symbols>. They are not
+ * read from the file, which codes whole segments with its own coder. */
+static void p_PrintSubbandStats(const char *filename, const BILDInfo *info)
+{
+
+  static const char *channel_names[2][3] = { { "R", "G-R", "B-R" }, { "Y", "Cb", "Cr" } };
+  static const char *band_names[BILDBandCount] = { "LH", "HL", "HH" };
+
+  InputFile file;
+
+  if (!InputFileOpen(&file, filename, 0, NULL, FileAccessAuto)) return;
+
+  BILDSubbandStats (*stats)[BILD_MAX_LEVELS][BILDBandCount] = malloc(3*sizeof(*stats));
+  int level_count;
+
+  BILDDecoder *decoder = BILDDecoderCreate();
+  BILDStatus status = BILDErrorMemory;
+
+  if (stats && decoder)
+  {
+    BILDDecoderSetPadding(decoder, BILD_PADDING);
+    status = BILDDecoderSubbandStats(decoder, file.data, file.size, stats, &level_count);
+  }
+
+  BILDDecoderDestroy(decoder);
+
+  if (status != BILDOk)
+  {
+    p_PrintStatus(status, file.data, file.size);
+    free(stats);
+    InputFileClose(&file);
+    return;
+  }
+
+  const bool rle_compression = (info->quality > 2);
+  const BILDSubbandStats *band;
+  byte code_lengths[BYTE_MAX+1];
+  int length_count[HUFFMAN_MAX_CODE_LENGTH+1];
+
+  printf("\nChannel Level Band Coefficients  Zeros  Entropy  Escapes  RLE gain  Standalone Huffman code lengths\n");
+
+  int c, i, b, j;
+  for (c = 0; c < 3; ++c)
+  {
+    for (i = 0; i < level_count; ++i)
+    {
+      for (b = 0; b < BILDBandCount; ++b)
+      {
+
+        band = &stats[c][i][b];
+
+        if (band->count == 0) continue;
+
+        huffman_code_lengths(rle_compression ? band->rle_histogram : band->histogram, code_lengths);
+
+        memset(length_count, 0, sizeof(length_count));
+        for (j = 0; j < BYTE_MAX+1; ++j) ++length_count[code_lengths[j]];
+
+        printf("%-7s %5d %-4s %12lld %5.1f%% %8.3f %8lld %8.2fx ", channel_names[info->quality > 0][c], i, band_names[b],
+               (long long)band->count, 100.0*band->zero_count/band->count, p_Entropy(band->histogram, band->count),
+               (long long)band->escape_count, (band->rle_size > 0) ? (double)band->count/band->rle_size : 0.0);
+
+        for (j = 1; j <= HUFFMAN_MAX_CODE_LENGTH; ++j)
+          if (length_count[j] > 0) printf(" %d:%d", j, length_count[j]);
+
+        printf("\n");
+
+      }
+    }
+  }
+
+  printf("\nZeros and entropy (bits per coefficient) are of the packed coefficients, escapes\n"
+         "are coded as 32 bit overflow values. The RLE gain is coefficients per byte\n"
+         "of run length coding, which the image %s. The code lengths are those a\n"
+         "Huffman code for the subband alone would have, the image codes whole\n"
+         "segments with its %s coder.\n",
+         rle_compression ? "uses" : "does not use", EntropyCoderName(info->coder));
+
+  free(stats);
+
+  InputFileClose(&file);
+
+}
+
+void BILDPrintInformation(const char *filename, const bool verbose)
+{
+
+  FILE *f = fopen(filename, "rb");
+
+  if (!f)
+  {
+
+    printf("Cannot open %s.\n", filename);
+
+    return;
+
+  }
+
+  byte data[sizeof(BILDHeader)];
+  const size_t size = fread(data, sizeof(byte), sizeof(BILDHeader), f);
+
+  fclose(f);
+
+  BILDInfo info;
+  BILDStatus status = BILDReadInfo(data, size, &info);
+
+  if ((status == BILDErrorFormat) || (status == BILDErrorTruncated))
+  {
+
+    printf("No BILD file.\n");
+
+  }
+  else
+  {
+
+    printf("BILD version............... %d\n", info.version);
+    printf("Image size (bytes)........ %" PRId64 "\n", (int64_t)info.width*info.height*3);
+    printf("Image dimension (pixels).. %d x %d (width x height)\n", info.width, info.height);
+    printf("Quality................... %d\n", info.quality);
+    printf("Entropy coder............. %s\n", EntropyCoderName(info.coder));
+
+    if (info.tile_size > 0)
+      printf("Tile size (pixels)........ %d x %d\n", info.tile_size, info.tile_size);
+
+    if (verbose) p_PrintSubbandStats(filename, &info);
+
+  }
+
+}
@@ -0,0 +1,141 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <FreeImage.h>
+
+#include "types.h"
+#include "image.h"
+#include "bild.h"
+
+/* File I/O of the command line tools, not part of libbild. Failures are
+ * printed to stdout, stage statistics to stderr if asked for. */
+
+/* FreeImage is set up once per process, before any file is coded */
+void ImageIOInit(void);
+void ImageIODestroy(void);
+
+/* Of the image a file function coded. The functions add the stages they
+ * run to the stages of stats, so it starts zeroed and may collect the
+ * stages of several functions. */
+struct tFileStats
+{
+  int64_t pixel_count;      /* Of the image decoded or encoded */
+  size_t coded_size;        /* Of the BILD file */
+  Stage read;               /* Reading and parsing the input file */
+  BILDStages stages;        /* Of the codec */
+  Stage write;              /* Formatting and writing the output file */
+};
+typedef struct tFileStats FileStats;
+
+/* Stage statistics of the files coded, none (default), one JSON object per
+ * line or CSV with a header */
+enum tStatsFormat { StatsNone = 0, StatsJSON, StatsCSV, StatsFormatCount };
+typedef enum tStatsFormat StatsFormat;
+
+bool StatsFormatParse(const char *name, StatsFormat *format);
+
+void ImageIOSetStatsFormat(const StatsFormat format);
+
+/* Prints a record per stage of stats to stderr, in the order the stages
+ * ran, unless the format is StatsNone. filename is the input file. */
+void FileStatsPrint(const char *filename, const FileStats *stats, const bool compress);
+
+/* stats may be NULL */
+Image* ImageLoadFromBMPFileAndCreate(const char *filename, FileStats *stats);
+void ImageSaveAsBMPFile(Image *image, const char *filename);
+
+/* The channels of image are used as scratch space. stats may be NULL. */
+bool BILDEncoderSaveFile(BILDEncoder *encoder, Image *image, const char *filename, const int quality, const EntropyCoderID coder,
+                         FileStats *stats);
+
+/* Codes the BMP file bmp_filename row by row, see BILDEncoderBegin. Only
+ * the bitmap and the coded image are held in memory. stats may be NULL. */
+bool BILDEncoderStreamBMPFile(BILDEncoder *encoder, const char *bmp_filename, const char *filename, const int quality,
+                              const EntropyCoderID coder, FileStats *stats);
+
+/* How BILD files are read for decoding: mapped into memory with all pages
+ * populated up front (populate) or read ahead as the decoder gets to them
+ * (sequential), or read into a buffer (read). Mapped files are decoded in
+ * place. auto, the default, populates files decoded whole. */
+enum tFileAccess { FileAccessAuto = 0, FileAccessPopulate, FileAccessSequential, FileAccessRead, FileAccessCount };
+typedef enum tFileAccess FileAccess;
+
+bool FileAccessParse(const char *name, FileAccess *access);
+
+/* Access of the files the functions below open */
+void ImageIOSetFileAccess(const FileAccess access);
+
+/* A file in memory, followed by BILD_PADDING readable bytes */
+struct tInputFile
+{
+  byte *data;
+  size_t size;
+  size_t length;            /* Of the mapping, 0 if data is on the heap */
+};
+typedef struct tInputFile InputFile;
+
+/* Opens filename as much as is needed to decode region (NULL for all) of
+ * it at 1/2^scale of the size, or all of it for scale 0. auto populates
+ * the pages of files decoded whole and reads the others ahead. */
+bool InputFileOpen(InputFile *file, const char *filename, const int scale, const BILDRect *region, FileAccess access);
+void InputFileClose(InputFile *file);
+
+/* Codes the BMP file in file with BILDEncode, from pixels, which is kept
+ * for the next file. The coded image belongs to the encoder and is valid
+ * until its next use. Parsing the BMP file counts as reading it, stats
+ * may be NULL. */
+bool BILDEncoderCodeBMP(BILDEncoder *encoder, const InputFile *file, const int quality, const EntropyCoderID coder,
+                        Buffer *pixels, const byte **coded_data, size_t *coded_size, FileStats *stats);
+
+/* The image belongs to the decoder and is valid until its next use, it is
+ * region (NULL for all) of the image at 1/2^scale of the original size */
+Image* BILDDecoderLoadFile(BILDDecoder *decoder, const char *filename, const int scale, const BILDRect *region);
+
+Image *ImageLoadFromBILDFileAndCreate(const char *filename, const int scale, const BILDRect *region);
+
+/* Decodes region (NULL for all) of the image at 1/2^scale of the original
+ * size straight into the bitmap of the BMP file bmp_filename. stats may be
+ * NULL. */
+bool BILDDecoderSaveBMPFile(BILDDecoder *decoder, const char *filename, const char *bmp_filename, const int scale,
+                            const BILDRect *region, FileStats *stats);
+
+/* Same for the BILD file in file, the BMP file is returned in memory and
+ * formatting it counts as writing it. NULL on failure. */
+FIMEMORY* BILDDecoderDecodeBMP(BILDDecoder *decoder, const InputFile *file, const int scale, const BILDRect *region,
+                               FileStats *stats);
+
+/* tile_size 0 codes the image in one piece, stats may be NULL */
+bool ImageSaveAsBILDFile(Image *image, const char *filename, const int quality, const EntropyCoderID coder, const int tile_size,
+                         FileStats *stats);
+
+/* verbose adds the statistics of every subband, see BILDDecoderSubbandStats */
+void BILDPrintInformation(const char *filename, const bool verbose);
+
+#endif
@@ -0,0 +1,183 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Public interface of libbild. Images are coded from and to memory, the
+ * library does no file I/O and prints nothing, failures are reported by
+ * the returned BILDStatus. */
+
+#ifndef LIBBILD_H
+#define LIBBILD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define BILD_API __attribute__((visibility("default")))
+#else
+#define BILD_API
+#endif
+
+enum tBILDStatus
+{
+  BILDOk = 0,
+  BILDErrorArgument,        /* Invalid parameter */
+  BILDErrorFormat,          /* Not a BILD image or damaged */
+  BILDErrorVersion,         /* BILD image of another version */
+  BILDErrorCoder,           /* Unknown entropy coder */
+  BILDErrorTruncated,       /* More of the BILD image is needed */
+  BILDErrorMemory           /* Out of memory */
+};
+typedef enum tBILDStatus BILDStatus;
+
+/* Same values as stored in the file */
+enum tBILDCoder { BILDCoderHuffman = 0, BILDCoderANS };
+typedef enum tBILDCoder BILDCoder;
+
+/* Interleaved 8 bit pixels, rows are stride bytes apart. The encoder takes
+ * RGB8, the decoder writes any of them, RGBA8 with opaque alpha. */
+enum tBILDPixelFormat { BILDPixelRGB8 = 0, BILDPixelRGBA8, BILDPixelBGR8 };
+typedef enum tBILDPixelFormat BILDPixelFormat;
+
+struct tBILDInfo
+{
+  int version;
+  int width;
+  int height;
+  int quality;
+  BILDCoder coder;
+  int tile_size;            /* 0 if the image is not tiled */
+};
+typedef struct tBILDInfo BILDInfo;
+
+/* Rectangle of an image in pixels */
+struct tBILDRect
+{
+  int x;
+  int y;
+  int width;
+  int height;
+};
+typedef struct tBILDRect BILDRect;
+
+typedef struct tBILDEncoder BILDEncoder;
+typedef struct tBILDDecoder BILDDecoder;
+
+BILD_API const char* BILDStatusMessage(const BILDStatus status);
+
+/* Threads shared by all encoders and decoders of the process, 1 (the
+ * default) runs everything on the calling thread. Must not be called while
+ * images are coded. */
+BILD_API void BILDSetThreadCount(const int thread_count);
+
+/* Encoders and decoders keep their memory across images, once they have
+ * handled the largest image they do no further heap allocations. One
+ * context must not be used by two threads at the same time. The functions
+ * return NULL, or BILDErrorMemory, if they run out of memory; the context
+ * can still be used and destroyed. */
+BILD_API BILDEncoder* BILDEncoderCreate(void);
+BILD_API void BILDEncoderDestroy(BILDEncoder *encoder);
+
+/* Quality 0 (lossless) .. 7. A plane is coded at one less than its number
+ * of wavelet levels (log2 of its larger side) at most, which limits small
+ * images and tiles: the chroma of 16, 32 and 64 pixel tiles goes up to
+ * quality 2, 3 and 4. The coded image belongs to the encoder and is valid
+ * until its next use. */
+BILD_API BILDStatus BILDEncode(BILDEncoder *encoder, const uint8_t *pixels, const int width, const int height, const int stride,
+                               const BILDPixelFormat format, const int quality, const BILDCoder coder,
+                               const uint8_t **coded_data, size_t *coded_size);
+
+/* Codes an image handed over row by row, top to bottom, in bounded memory:
+ * the wavelet transform holds a few rows per level instead of the image,
+ * and the large levels are entropy coded block by block as their rows come
+ * in. BILDEncoderBegin starts an image, BILDEncoderWriteRows passes the
+ * next row_count rows and BILDEncoderEnd returns the coded image once all
+ * rows are written. The coded image is the same as that of BILDEncode.
+ * Encoders with a tile size cannot code images this way. An image is
+ * dropped once one of the functions returns BILDErrorMemory. */
+BILD_API BILDStatus BILDEncoderBegin(BILDEncoder *encoder, const int width, const int height, const BILDPixelFormat format,
+                                     const int quality, const BILDCoder coder);
+BILD_API BILDStatus BILDEncoderWriteRows(BILDEncoder *encoder, const uint8_t *pixels, const int row_count, const int stride);
+BILD_API BILDStatus BILDEncoderEnd(BILDEncoder *encoder, const uint8_t **coded_data, size_t *coded_size);
+
+#define BILD_MIN_TILE_SIZE 16
+#define BILD_MAX_TILE_SIZE 65536
+
+/* Codes the following images in tiles of tile_size x tile_size pixels, a
+ * power of two from BILD_MIN_TILE_SIZE to BILD_MAX_TILE_SIZE, or in one
+ * piece for 0 (the default). Tiles are coded independently and in
+ * parallel, BILDDecodeRegion only decodes the tiles it needs. Untiled
+ * images are limited to 2^28 pixels, tiled ones to tiles of 2^28 pixels,
+ * 2^20 pixels a side and 2^24 tiles. */
+BILD_API BILDStatus BILDEncoderSetTileSize(BILDEncoder *encoder, const int tile_size);
+
+BILD_API BILDDecoder* BILDDecoderCreate(void);
+BILD_API void BILDDecoderDestroy(BILDDecoder *decoder);
+
+#define BILD_PADDING 8
+
+/* The decoder reads up to BILD_PADDING bytes past the coded data. Unless
+ * as many bytes behind coded_size are readable, it decodes from a copy of
+ * the part of the image it needs. Telling it that padding bytes behind the
+ * following images are readable, e.g. because they are in a file mapped
+ * into memory, lets it decode them in place. */
+BILD_API void BILDDecoderSetPadding(BILDDecoder *decoder, const size_t padding);
+
+/* Reads the header only, e.g. to size the pixel buffer of BILDDecode */
+BILD_API BILDStatus BILDReadInfo(const uint8_t *coded_data, const size_t coded_size, BILDInfo *info);
+
+/* pixels has to hold height rows of stride bytes. A negative stride writes
+ * the rows bottom-up, pixels then points to the top row. Whole images are
+ * written by the last wavelet level as its rows come out, without planes of
+ * the size of the image. */
+BILD_API BILDStatus BILDDecode(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size,
+                               uint8_t *pixels, const int stride, const BILDPixelFormat format);
+
+#define BILD_MAX_SCALE 30
+
+/* Decodes the image at 1/2^scale of its size, straight from the wavelet
+ * pyramid, the finer levels are neither decoded nor reconstructed and
+ * coded_data only needs to hold BILDScaledPrefixSize bytes. Scale 0 is
+ * BILDDecode. */
+BILD_API BILDStatus BILDDecodeScaled(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size, const int scale,
+                                     uint8_t *pixels, const int stride, const BILDPixelFormat format);
+
+/* Decodes region of the image decoded at scale, NULL for all of it, into
+ * pixels of region->height rows. Only the blocks of coefficients under the
+ * region are decoded. Of a tiled image only the tiles the region touches
+ * are decoded, in parallel, and scale is limited to the tiles: 2^scale must
+ * not exceed the tile size. */
+BILD_API BILDStatus BILDDecodeRegion(BILDDecoder *decoder, const uint8_t *coded_data, const size_t coded_size, const int scale,
+                                     const BILDRect *region, uint8_t *pixels, const int stride, const BILDPixelFormat format);
+
+/* Size of the image decoded at scale, both rounded up */
+BILD_API void BILDScaledSize(const BILDInfo *info, const int scale, int *width, int *height);
+
+/* Number of leading bytes of a BILD image needed to decode it at scale, the
+ * rest can be left unread. If coded_size is too short to tell, the result is
+ * BILDErrorTruncated and prefix_size the size to try next. Tiled images are
+ * needed up to the end of their last tile. */
+BILD_API BILDStatus BILDScaledPrefixSize(const uint8_t *coded_data, const size_t coded_size, const int scale, size_t *prefix_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
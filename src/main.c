@@ -22,10 +22,27 @@
 #include "globals.h"
 #include "image.h"
 #include "bild.h"
+#include "imageio.h"
+#include "batch.h"
+#include "cpu.h"
+#include "threadpool.h"
 
 #include "types.h"
 
 #define DEFAULT_QUALITY 4
+#define DEFAULT_MEMORY_BUDGET 512
+
+/* Running out of memory is not recovered from, the library reports it as
+ * BILDErrorMemory */
+void* check_memory(void *data)
+{
+  if (!data)
+  {
+    fprintf(stderr, "%s\n", BILDStatusMessage(BILDErrorMemory));
+    abort();
+  }
+  return data;
+}
 
 /* Remove file extension */
 char* remove_ext(const char *filename)
@@ -39,6 +56,42 @@ char* remove_ext(const char *filename)
   return result;
 }
 
+/* Parses 1/2^k into k */
+bool parse_scale(const char *text, int *scale)
+{
+
+  if (strcmp(text, "1") == 0)
+  {
+    *scale = 0;
+    return true;
+  }
+
+  if (strncmp(text, "1/", 2) != 0) return false;
+
+  char *end;
+  const long denominator = strtol(text+2, &end, 10);
+
+  if ((*end != '\0') || (denominator < 1) || (denominator & (denominator-1))) return false;
+
+  *scale = 0;
+  while ((1L << *scale) < denominator) ++(*scale);
+
+  return (*scale <= BILD_MAX_SCALE);
+
+}
+
+/* Parses <x>,<y>,<width>,<height> */
+bool parse_roi(const char *text, BILDRect *region)
+{
+
+  int length = 0;
+
+  if (sscanf(text, "%d,%d,%d,%d%n", &region->x, &region->y, &region->width, &region->height, &length) != 4) return false;
+
+  return (text[length] == '\0') && (region->x >= 0) && (region->y >= 0) && (region->width > 0) && (region->height > 0);
+
+}
+
 void help(const char *bin)
 {
 
@@ -46,12 +99,15 @@ void help(const char *bin)
   fprintf(stdout, "Usage: %s <command> [options] <input file> <output file>\n\n", bin);
 
   fprintf(stdout, "Example: %s -c -t %u image.bmp # Compress image.bmp to image.bild with quality parameter %u\n", bin, DEFAULT_QUALITY, DEFAULT_QUALITY);
-  fprintf(stdout, "Example: %s -d image.bild reconstruction.bmp # Decompress image.bild to picture.bmp\n\n", bin);
+  fprintf(stdout, "Example: %s -d image.bild reconstruction.bmp # Decompress image.bild to picture.bmp\n", bin);
+  fprintf(stdout, "Example: ls *.bmp | %s -c -j 8 --batch # Compress every BMP file of the directory\n\n", bin);
 
   fprintf(stdout, "Commands:\n");
   fprintf(stdout, "  -c              Compress image.\n");
   fprintf(stdout, "  -d              Decompress BILD image.\n");
-  fprintf(stdout, "  -i              Show BILD image information.\n");
+  fprintf(stdout, "  -i              Show BILD image information, with --verbose the zeros,\n");
+  fprintf(stdout, "                  entropy, escapes, RLE gain and Huffman code lengths of\n");
+  fprintf(stdout, "                  every subband.\n");
   fprintf(stdout, "  -h              Show this help.\n");
   fprintf(stdout, "  -v              Print version.\n\n");
 
@@ -59,6 +115,38 @@ void help(const char *bin)
   fprintf(stdout, "  -q <N>          Quality parameter. N is an integer (0..7).\n");
   fprintf(stdout, "                  0: lossless compression.\n");
   fprintf(stdout, "                  %u: standard value.\n", DEFAULT_QUALITY);
+  fprintf(stdout, "  --coder=<CODER> Entropy coder: huffman (default) or ans.\n");
+  fprintf(stdout, "                  ans gives smaller files, huffman decodes faster.\n");
+  fprintf(stdout, "  -T <N>          Code the image in independent tiles of N x N pixels,\n");
+  fprintf(stdout, "                  N is a power of two (%d..%d).\n", BILD_MIN_TILE_SIZE, BILD_MAX_TILE_SIZE);
+  fprintf(stdout, "  --stream        Code the image row by row, the transform holds a few rows\n");
+  fprintf(stdout, "                  per level instead of the whole image. Not with -T.\n\n");
+
+  fprintf(stdout, "Decompression options:\n");
+  fprintf(stdout, "  --scale=1/<N>   Decompress at 1/N of the size, N is a power of two.\n");
+  fprintf(stdout, "                  Only the levels of the pyramid up to that size are used.\n");
+  fprintf(stdout, "  --roi=<X>,<Y>,<W>,<H>\n");
+  fprintf(stdout, "                  Decompress only this rectangle of the (scaled) image.\n");
+  fprintf(stdout, "                  Of tiled images only the tiles it touches are decoded.\n");
+  fprintf(stdout, "  --io=<MODE>     How the BILD file is read: populate (map it into memory\n");
+  fprintf(stdout, "                  and load all pages at once), sequential (map it and read\n");
+  fprintf(stdout, "                  ahead), read (copy it into a buffer) or auto (default:\n");
+  fprintf(stdout, "                  populate for whole images, else sequential).\n\n");
+
+  fprintf(stdout, "General options:\n");
+  fprintf(stdout, "  --batch         The input file lists the files to (de)compress, one per\n");
+  fprintf(stdout, "                  line, optionally followed by a tab and the output file.\n");
+  fprintf(stdout, "                  Without input file or with - the list is read from stdin.\n");
+  fprintf(stdout, "                  The files are coded in parallel, one per thread, while\n");
+  fprintf(stdout, "                  others are read and written.\n");
+  fprintf(stdout, "  --memory=<MB>   Files held in memory by --batch, with an estimate of the\n");
+  fprintf(stdout, "                  images coded from them (default: %d MB).\n", DEFAULT_MEMORY_BUDGET);
+  fprintf(stdout, "  --stats=<FMT>   Print the wall and CPU time, bytes in and out, heap\n");
+  fprintf(stdout, "                  allocations and peak RSS of every stage of every file to\n");
+  fprintf(stdout, "                  stderr: json (a line per stage) or csv.\n");
+  fprintf(stdout, "  -j <N>          Number of threads (default: 1).\n");
+  fprintf(stdout, "  --cpu=<LEVEL>   Kernel set: scalar, sse4.1, avx2 or avx512.\n");
+  fprintf(stdout, "                  Default: best level supported by the CPU (%s).\n", CPULevelName(CPUDetectLevel()));
 
 }
 
@@ -70,16 +158,31 @@ int main(int argc, const char **argv)
   char *input_filename_noext = NULL;
 
   unsigned int quality = DEFAULT_QUALITY;
+  int thread_count = 1;
+  EntropyCoderID coder = EntropyHuffman;
+  int scale = 0;
+  int tile_size = 0;
+  bool stream = false;
+  bool batch = false;
+  bool verbose = false;
+  int memory_budget = DEFAULT_MEMORY_BUDGET;
+  BILDRect region;
+  BILDRect *roi = NULL;
+  FileAccess file_access = FileAccessAuto;
+  StatsFormat stats_format = StatsNone;
+  FileStats stats;
 
   int arg = 1;
   bool bWrongArgs = (argc < 2);
   enum Command {Compress, Decompress, Information, Help, Version} command = Help;
   bool flag = true;
 
+  CPULevel cpu_level = CPUDetectLevel();
+
   while ((!bWrongArgs) && (arg < argc))
   {
 
-    if (argv[arg][0] == '-')
+    if ((argv[arg][0] == '-') && (argv[arg][1] != '\0'))
     {
 
       switch (argv[arg][1])
@@ -104,6 +207,64 @@ int main(int argc, const char **argv)
           }
           break;
 
+        case 'j':
+          arg++;
+          if (arg == argc)
+          {
+            bWrongArgs = true;
+          }
+          else
+          {
+            thread_count = atoi(argv[arg]); arg++;
+            bWrongArgs = (thread_count < 1);
+          }
+          break;
+
+        case 'T':
+          arg++;
+          if (arg == argc)
+          {
+            bWrongArgs = true;
+          }
+          else
+          {
+            tile_size = atoi(argv[arg]); arg++;
+            bWrongArgs = ((tile_size < BILD_MIN_TILE_SIZE) || (tile_size > BILD_MAX_TILE_SIZE) || (tile_size & (tile_size-1)));
+          }
+          break;
+
+        case '-':
+          if (strncmp(argv[arg], "--cpu=", 6) == 0)
+            bWrongArgs = !CPUParseLevel(argv[arg]+6, &cpu_level);
+          else if (strncmp(argv[arg], "--coder=", 8) == 0)
+            bWrongArgs = !EntropyParseCoder(argv[arg]+8, &coder);
+          else if (strncmp(argv[arg], "--scale=", 8) == 0)
+            bWrongArgs = !parse_scale(argv[arg]+8, &scale);
+          else if (strncmp(argv[arg], "--io=", 5) == 0)
+            bWrongArgs = !FileAccessParse(argv[arg]+5, &file_access);
+          else if (strncmp(argv[arg], "--stats=", 8) == 0)
+            bWrongArgs = !StatsFormatParse(argv[arg]+8, &stats_format);
+          else if (strcmp(argv[arg], "--stream") == 0)
+            stream = true;
+          else if (strcmp(argv[arg], "--batch") == 0)
+            batch = true;
+          else if (strcmp(argv[arg], "--verbose") == 0)
+            verbose = true;
+          else if (strncmp(argv[arg], "--memory=", 9) == 0)
+          {
+            memory_budget = atoi(argv[arg]+9);
+            bWrongArgs = (memory_budget < 1);
+          }
+          else if (strncmp(argv[arg], "--roi=", 6) == 0)
+          {
+            roi = &region;
+            bWrongArgs = !parse_roi(argv[arg]+6, roi);
+          }
+          else
+            bWrongArgs = true;
+          arg++;
+          break;
+
         default: arg++; bWrongArgs = true; break;
 
       }
@@ -127,12 +288,21 @@ int main(int argc, const char **argv)
 
   }
 
+  if (stream && (tile_size > 0)) bWrongArgs = true;
+  if (batch && (stream || ((command != Compress) && (command != Decompress)))) bWrongArgs = true;
+
   if (bWrongArgs || (command == Help))
   {
     help(argv[0]);
     return 0;
   }
 
+  if (!CPUSetLevel(cpu_level))
+  {
+    printf("CPU does not support the %s kernels.\n", CPULevelName(cpu_level));
+    return 1;
+  }
+
   if (command == Version)
   {
     fprintf(stdout, "%d\n", VERSION);
@@ -141,14 +311,53 @@ int main(int argc, const char **argv)
 
   if (command == Information)
   {
-    BILDPrintInformation(input_filename);
+    BILDPrintInformation(input_filename, verbose);
     return 0;
   }
 
+  ThreadPoolInit(thread_count);
+
+  ImageIOInit();
+  ImageIOSetStatsFormat(stats_format);
+
+  if (batch)
+  {
+
+    FILE *list = (!input_filename || (strcmp(input_filename, "-") == 0)) ? stdin : fopen(input_filename, "r");
+
+    if (!list)
+    {
+      printf("Cannot open %s.\n", input_filename);
+      return 1;
+    }
+
+    BatchOptions options;
+    options.compress = (command == Compress);
+    options.quality = quality;
+    options.coder = coder;
+    options.tile_size = tile_size;
+    options.scale = scale;
+    options.region = roi;
+    options.access = file_access;
+    options.memory_budget = (size_t)memory_budget << 20;
+
+    const bool failed = BatchRun(list, &options);
+
+    if (list != stdin) fclose(list);
+
+    ImageIODestroy();
+    ThreadPoolDestroy();
+
+    return failed ? 1 : 0;
+
+  }
+
   input_filename_noext = remove_ext(input_filename);
 
   char output_filename_buffer[256];
 
+  memset(&stats, 0, sizeof(FileStats));
+
   if (command == Compress)
   {
 
@@ -160,16 +369,43 @@ int main(int argc, const char **argv)
     fprintf(stdout, "Compressing %s to %s ...\n", input_filename, output_filename_buffer);
     fflush(stdout);
 
-    Image *image = ImageLoadFromBMPFileAndCreate(input_filename);
+    if (stream)
+    {
+
+      BILDEncoder *encoder = check_memory(BILDEncoderCreate());
+      const bool result = BILDEncoderStreamBMPFile(encoder, input_filename, output_filename_buffer, quality, coder, &stats);
+      BILDEncoderDestroy(encoder);
+
+      if (!result)
+      {
+        printf("Failed.\n");
+        return 1;
+      }
 
-    if (!image)
+    }
+    else
     {
-      printf("Failed.\n");
-      return 1;
+
+      Image *image = ImageLoadFromBMPFileAndCreate(input_filename, &stats);
+
+      if (!image)
+      {
+        printf("Failed.\n");
+        return 1;
+      }
+
+      const bool result = ImageSaveAsBILDFile(image, output_filename_buffer, quality, coder, tile_size, &stats);
+      ImageDestroy(image);
+
+      if (!result)
+      {
+        printf("Failed.\n");
+        return 1;
+      }
+
     }
 
-    ImageSaveAsBILDFile(image, output_filename_buffer, quality);
-    ImageDestroy(image);
+    FileStatsPrint(input_filename, &stats, true);
 
     printf("Done.\n");
 
@@ -185,21 +421,28 @@ int main(int argc, const char **argv)
     fprintf(stdout, "Decompressing %s to %s ...\n", input_filename, output_filename_buffer);
     fflush(stdout);
 
-    Image *image = ImageLoadFromBILDFileAndCreate(input_filename);
+    ImageIOSetFileAccess(file_access);
 
-    if (!image)
+    BILDDecoder *decoder = check_memory(BILDDecoderCreate());
+    const bool result = BILDDecoderSaveBMPFile(decoder, input_filename, output_filename_buffer, scale, roi, &stats);
+    BILDDecoderDestroy(decoder);
+
+    if (!result)
     {
       printf("Failed.\n");
       return 1;
     }
 
-    ImageSaveAsBMPFile(image, output_filename_buffer);
-    ImageDestroy(image);
+    FileStatsPrint(input_filename, &stats, false);
 
     printf("Done.\n");
 
   }
 
+  ImageIODestroy();
+
+  ThreadPoolDestroy();
+
   return 0;
 
 }
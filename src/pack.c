@@ -16,6 +16,7 @@
  */
 
 #include "pack.h"
+#include "cpu.h"
 
 const int8_t pack32_8(const int32_t i32, int32_t *overflow_buf, int *overflow_buf_pos)
 {
@@ -38,3 +39,13 @@ const int32_t unpack8_32(const int8_t i8, int32_t *overflow_buf, int *overflow_b
   return (int32_t)i8;
 
 }
+
+void pack8_array(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  int i = kernels.pack8(src, count, dst, overflow_buf, overflow_buf_pos);
+
+  for (; i < count; ++i)
+    dst[i] = pack32_8(src[i], overflow_buf, overflow_buf_pos);
+
+}
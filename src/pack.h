@@ -26,4 +26,7 @@
 const int8_t pack32_8(const int32_t i32, int32_t *overflow_buf, int *overflow_buf_pos);
 const int32_t unpack8_32(const int8_t b, int32_t *overflow_buf, int *overflow_buf_pos);
 
+/* pack32_8() over count samples, vectorized where available */
+void pack8_array(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos);
+
 #endif
@@ -60,12 +60,18 @@ void rleEncode8(void *data, const int size, void *coded_data, int *coded_size, v
 
 }
 
-void rleDecode8(void *coded_data, const int coded_size, void *data, int *size)
+bool rleDecode8(void *coded_data, const int coded_size, void *data, const int capacity, int *size)
 {
 
   byte *cd = coded_data;
   byte *d = data;
 
+  *size = 0;
+
+  if (coded_size == 0) return true;
+
+  if (capacity < 1) return false;
+
   byte b0 = cd[0];
   byte b1;
 
@@ -80,14 +86,20 @@ void rleDecode8(void *coded_data, const int coded_size, void *data, int *size)
 
     b1 = cd[i++];
 
+    if (data_pos >= capacity) return false;
     d[data_pos++] = b1;
 
     if (b1 == b0)
     {
 
+      /* A pair is always followed by the run length and the next byte */
+      if (i+sizeof(uint16_t) >= coded_size) return false;
+
       memcpy(&l, &cd[i], sizeof(uint16_t));
       i += sizeof(uint16_t);
 
+      if (data_pos+l >= capacity) return false;
+
       while (l > 0) { d[data_pos++] = b1; --l; }
 
       b1 = cd[i++];
@@ -101,4 +113,128 @@ void rleDecode8(void *coded_data, const int coded_size, void *data, int *size)
 
   *size = data_pos;
 
+  return true;
+
+}
+
+enum { RLEStreamEmpty = 0, RLEStreamLiteral, RLEStreamRun };
+
+void rleStreamInit(RLEStream *stream, Buffer *coded, uint32_t *histogram)
+{
+
+  stream->coded = coded;
+  stream->histogram = histogram;
+  stream->state = RLEStreamEmpty;
+  stream->b0 = 0;
+  stream->run_length = 0;
+
+}
+
+static inline void p_RLEStreamPut(RLEStream *stream, byte **cd, const byte b)
+{
+
+  *(*cd)++ = b;
+  if (stream->histogram) ++stream->histogram[b];
+
+}
+
+static inline void p_RLEStreamPutRun(RLEStream *stream, byte **cd, const int run_length, const byte b)
+{
+
+  const uint16_t l = run_length;
+  byte l_bytes[sizeof(uint16_t)];
+  memcpy(l_bytes, &l, sizeof(uint16_t));
+
+  p_RLEStreamPut(stream, cd, l_bytes[0]);
+  p_RLEStreamPut(stream, cd, l_bytes[1]);
+  p_RLEStreamPut(stream, cd, b);
+
+}
+
+bool rleStreamEncode8(RLEStream *stream, const byte *data, const int size)
+{
+
+  /* At most 3 coded bytes per byte */
+  byte *cd = BufferReserve(stream->coded, 3*(size_t)size);
+  byte *start = cd;
+
+  if (!cd) return false;
+
+  byte b0 = stream->b0;
+  byte b1;
+  int state = stream->state;
+  int run_length = stream->run_length;
+
+  int i;
+  for (i = 0; i < size; ++i)
+  {
+
+    b1 = data[i];
+
+    switch (state)
+    {
+
+      case RLEStreamRun:
+        if ((b1 == b0) && (run_length < UINT16_MAX))
+        {
+          ++run_length;
+        }
+        else
+        {
+          p_RLEStreamPutRun(stream, &cd, run_length, b1);
+          state = RLEStreamLiteral;
+        }
+        break;
+
+      case RLEStreamLiteral:
+        p_RLEStreamPut(stream, &cd, b1);
+        if (b1 == b0)
+        {
+          run_length = 0;
+          state = RLEStreamRun;
+        }
+        break;
+
+      default:
+        p_RLEStreamPut(stream, &cd, b1);
+        state = RLEStreamLiteral;
+        break;
+
+    }
+
+    b0 = b1;
+
+  }
+
+  stream->coded->size += cd-start;
+  stream->b0 = b0;
+  stream->state = state;
+  stream->run_length = run_length;
+
+  return true;
+
+}
+
+bool rleStreamFinish(RLEStream *stream)
+{
+
+  if (stream->state != RLEStreamRun) return true;
+
+  byte *cd = BufferReserve(stream->coded, 3);
+  byte *start = cd;
+
+  if (!cd) return false;
+
+  /* The last repetition ends the run, a bare pair needs a filler byte which
+   * decodes to one extra byte */
+  if (stream->run_length > 0)
+    p_RLEStreamPutRun(stream, &cd, stream->run_length-1, stream->b0);
+  else
+    p_RLEStreamPutRun(stream, &cd, 0, 0);
+
+  stream->coded->size += cd-start;
+  stream->state = RLEStreamLiteral;
+
+  return true;
+
 }
@@ -24,8 +24,30 @@
 #include <limits.h>
 
 #include "types.h"
+#include "buffer.h"
 
+/* A byte equal to its predecessor is followed by the number of further
+ * repetitions (uint16_t) and the next byte */
 void rleEncode8(void *data, const int size, void *coded_data, int *coded_size, void *parameters);
-void rleDecode8(void *coded_data, const int coded_size, void *data, int *size);
+
+/* Decodes at most capacity bytes, false if the coded data is damaged or
+ * decodes to more */
+bool rleDecode8(void *coded_data, const int coded_size, void *data, const int capacity, int *size);
+
+/* Incremental rleEncode8 for input arriving in pieces */
+struct tRLEStream
+{
+  Buffer *coded;            /* Receives the coded bytes */
+  uint32_t *histogram;      /* Counts the coded bytes, may be NULL */
+  int state;
+  byte b0;                  /* Last byte */
+  int run_length;           /* Repetitions after a pair */
+};
+typedef struct tRLEStream RLEStream;
+
+/* The encoding functions return false if coded runs out of memory */
+void rleStreamInit(RLEStream *stream, Buffer *coded, uint32_t *histogram);
+bool rleStreamEncode8(RLEStream *stream, const byte *data, const int size);
+bool rleStreamFinish(RLEStream *stream);
 
 #endif
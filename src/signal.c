@@ -20,11 +20,20 @@
 Signal1D* Signal1DCreate(const int size)
 {
 
-  Signal1D *signal = malloc(sizeof(Signal1D));
+  Signal1D *signal = HeapAlloc(sizeof(Signal1D));
+
+  if (!signal) return NULL;
+
   signal->size = size;
   signal->data_pos = 0;
 
-  signal->data = malloc(signal->size*sizeof(int32_t));
+  signal->data = HeapAlloc(signal->size*sizeof(sample));
+
+  if (!signal->data)
+  {
+    free(signal);
+    return NULL;
+  }
 
   return signal;
 
@@ -33,6 +42,8 @@ Signal1D* Signal1DCreate(const int size)
 void Signal1DDestroy(Signal1D *signal)
 {
 
+  if (!signal) return;
+
   free(signal->data);
 
   free(signal);
@@ -63,12 +74,29 @@ void Signal1DSub(Signal1D *signal, Signal1D *signal_sum)
 Signal2D* Signal2DCreate(const int width, const int height)
 {
 
-  Signal2D *signal = malloc(sizeof(Signal2D));
+  return Signal2DCreateInArena(NULL, width, height);
+
+}
+
+Signal2D* Signal2DCreateInArena(Arena *arena, const int width, const int height)
+{
+
+  Signal2D *signal = ArenaAlloc(arena, sizeof(Signal2D));
+
+  if (!signal) return NULL;
+
   signal->width = width;
   signal->height = height;
   signal->data_pos = 0;
+  signal->arena = arena;
+
+  signal->data = ArenaAlloc(arena, (size_t)signal->width*signal->height*sizeof(sample));
 
-  signal->data = malloc(signal->width*signal->height*sizeof(int32_t));
+  if (!signal->data)
+  {
+    ArenaFree(arena, signal);
+    return NULL;
+  }
 
   return signal;
 
@@ -77,118 +105,112 @@ Signal2D* Signal2DCreate(const int width, const int height)
 void Signal2DDestroy(Signal2D *signal)
 {
 
-  free(signal->data);
+  if (!signal) return;
 
-  free(signal);
+  ArenaFree(signal->arena, signal->data);
+
+  ArenaFree(signal->arena, signal);
 
 }
 
-void Signal2DDownsample2(Signal2D *signal)
+void Signal2DDownsampleRowPair(const sample *row0, const sample *row1, const int width, sample *row)
 {
 
-  const int width = signal->width >> 1; /* /2 */
-  const int height = signal->height >> 1; /* /2 */
-
-  const bool odd_width = signal->width % 2;
-  const bool odd_height = signal->height % 2;
+  const int half_width = width >> 1; /* /2 */
 
-  int32_t *row0 = signal->data;
-  int32_t *row1 = signal->data+signal->width;
+  int i = kernels.downsample2_row_pair(row0, row1, half_width, row);
 
-  int32_t *row = signal->data;
+  for (; i < half_width; ++i)
+    row[i] = (row0[i<<1] + row0[(i<<1)+1] + row1[i<<1] + row1[(i<<1)+1]) >> 2;
 
-  int i, j;
-  for (j = 0; j < height; ++j)
-  {
+  if (width % 2)
+    row[half_width] = (row0[width-1] + row1[width-1]) >> 1;
 
-    for (i = 0; i < width; ++i)
-    {
-      *row = (row0[0] + row0[1] + row1[0] + row1[1]) >> 2;
-      ++row; row0 += 2; row1 += 2;
-    }
+}
 
-    if (odd_width)
-    {
-      *row = (row0[0] + row1[0]) >> 1;
-      ++row; ++row0; ++row1;
-    }
+void Signal2DDownsample2(Signal2D *signal)
+{
 
-    row0 += signal->width;
-    row1 += signal->width;
+  const int width = (signal->width+1) >> 1;
+  const int height = (signal->height+1) >> 1;
 
-  }
+  sample *row0;
 
-  if (odd_height)
+  /* The single last row of an odd height is its own pair */
+  int j;
+  for (j = 0; j < height; ++j)
   {
-    for (i = 0; i < width; ++i)
-    {
-      *row = (row0[0] + row0[1]) >> 1;
-      ++row; row0 += 2;
-    }
-    if (odd_width) *row = row0[0];
+    row0 = signal->data+(j<<1)*signal->width;
+    Signal2DDownsampleRowPair(row0, ((j<<1)+1 < signal->height) ? row0+signal->width : row0, signal->width,
+                              signal->data+j*width);
   }
 
-  signal->width = (signal->width+1) >> 1;
-  signal->height = (signal->height+1) >> 1;
-  signal->data = (int32_t*)realloc(signal->data, signal->width * signal->height * sizeof(int32_t));
+  Signal2DShrink(signal, width, height);
 
 }
 
-void Signal2DUpsample2(Signal2D *signal, const int target_width, const int target_height)
+void Signal2DShrink(Signal2D *signal, const int width, const int height)
 {
 
-  const bool odd_width = target_width % 2;
-  const bool odd_height = target_height % 2;
+  signal->width = width;
+  signal->height = height;
 
-  Signal2D *result = Signal2DCreate(target_width, target_height);
+  /* Without memory to move it the data keeps its size */
+  sample *data = NULL;
+  if (!signal->arena) data = (sample*)HeapRealloc(signal->data, signal->width * signal->height * sizeof(sample));
+  if (data) signal->data = data;
 
-  int32_t *row0 = result->data;
-  int32_t *row1 = result->data+result->width;
+}
 
-  int32_t *row = signal->data;
+void Signal2DUpsampleRowPair(const sample *row, const int width, sample *row0, sample *row1)
+{
 
-  int i, j;
-  for (j = 0; j < result->height>>1; ++j)
-  {
+  const int half_width = width >> 1; /* /2 */
 
-    for (i = 0; i < result->width>>1; ++i)
-    {
-      row0[i<<1] = *row;
-      row1[i<<1] = *row;
-      row0[(i<<1)+1] = *row;
-      row1[(i<<1)+1] = *row;
-      ++row;
-    }
-
-    if (odd_width)
-    {
-      row0[i<<1] = *row;
-      row1[i<<1] = *row;
-      ++row;
-    }
-
-    row0 += result->width << 1;
-    row1 += result->width << 1;
+  int i = kernels.upsample2_row(row, half_width, row0, row1);
 
+  for (; i < half_width; ++i)
+  {
+    row0[i<<1] = row[i];
+    row1[i<<1] = row[i];
+    row0[(i<<1)+1] = row[i];
+    row1[(i<<1)+1] = row[i];
   }
 
-  if (odd_height)
+  if (width % 2)
   {
-    for (i = 0; i < (result->width>>1); ++i)
-    {
-      row0[i<<1] = *row;
-      row0[(i<<1)+1] = *row;
-      ++row;
-    }
-    if (odd_width) row0[i<<1] = *row;
+    row0[width-1] = row[half_width];
+    row1[width-1] = row[half_width];
   }
 
-  free(signal->data);
+}
+
+bool Signal2DUpsample2(Signal2D *signal, const int target_width, const int target_height)
+{
+
+  Signal2D *result = Signal2DCreateInArena(signal->arena, target_width, target_height);
+
+  if (!result) return false;
+
+  sample *row0;
+
+  /* The single last row of an odd height is its own pair */
+  int j;
+  for (j = 0; j < (target_height+1)>>1; ++j)
+  {
+    row0 = result->data+(j<<1)*target_width;
+    Signal2DUpsampleRowPair(signal->data+j*signal->width, target_width, row0,
+                            ((j<<1)+1 < target_height) ? row0+target_width : row0);
+  }
+
+  ArenaFree(signal->arena, signal->data);
   signal->width = result->width;
   signal->height = result->height;
   signal->data = result->data;
 
-  free(result);
+  ArenaFree(signal->arena, result);
+
+  return true;
 
 }
 
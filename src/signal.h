@@ -23,15 +23,19 @@
 #include <string.h>
 
 #include "types.h"
+#include "heap.h"
+#include "cpu.h"
+#include "arena.h"
 
 struct tSignal1D
 {
   int size;
-  int32_t *data;
+  sample *data;
   int data_pos;
 };
 typedef struct tSignal1D Signal1D;
 
+/* NULL if out of memory */
 Signal1D* Signal1DCreate(const int size);
 void Signal1DDestroy(Signal1D *signal);
 
@@ -45,12 +49,15 @@ struct tSignal2D
 {
   int width;
   int height;
-  int32_t *data;
+  sample *data;
   int data_pos;
+  Arena *arena;             /* Owner of the memory, NULL for the heap */
 };
 typedef struct tSignal2D Signal2D;
 
+/* NULL if out of memory */
 Signal2D* Signal2DCreate(const int width, const int height);
+Signal2D* Signal2DCreateInArena(Arena *arena, const int width, const int height);
 void Signal2DDestroy(Signal2D *signal);
 
 /* Downsampling: Each sample_factor x sample_factor elements will be replaced by
@@ -64,7 +71,20 @@ void Signal2DDestroy(Signal2D *signal);
  * 11 13
  */
 void Signal2DDownsample2(Signal2D *signal);
-void Signal2DUpsample2(Signal2D *signal, const int target_width, const int target_height);
+
+/* Means of the 2 x 2 blocks of a row pair of width elements, row0 for both
+ * rows gives the last row of an odd height. row may be row0. */
+void Signal2DDownsampleRowPair(const sample *row0, const sample *row1, const int width, sample *row);
+
+/* False if out of memory, the signal is then left as it was */
+bool Signal2DUpsample2(Signal2D *signal, const int target_width, const int target_height);
+
+/* Each of the elements of row twice in row0 and row1 of width elements,
+ * row0 for both rows gives the last row of an odd height */
+void Signal2DUpsampleRowPair(const sample *row, const int width, sample *row0, sample *row1);
+
+/* Keeps the leading width x height elements, e.g. of an in place downsampling */
+void Signal2DShrink(Signal2D *signal, const int width, const int height);
 
 void Signal2DAdd(Signal2D *signal, Signal2D *signal_sum);
 void Signal2DSub(Signal2D *signal, Signal2D *signal_sum);
@@ -0,0 +1,82 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+/* Vectorized kernels, one translation unit per instruction set. Each kernel
+ * processes as many elements as fit its vector width and returns the number
+ * done, the callers finish the remainder with their scalar code. All results
+ * are bit-exact with the scalar code, as long as the sums of the colour
+ * transforms fit a sample, which they do for 8 bit images. The kernels work
+ * on samples of the width the library is built with, 16 bits (AVX-512 then
+ * needs BW) or 32 bits with BILD_WIDE_SAMPLES. */
+
+/* 2x2 Haar butterfly on column pairs of row0/row1, see DecomposeLevel2D() */
+int DecomposeRowPairSSE41(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param);
+int DecomposeRowPairAVX2(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param);
+int DecomposeRowPairAVX512(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param);
+
+int ReconstructRowPairSSE41(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param);
+int ReconstructRowPairAVX2(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param);
+int ReconstructRowPairAVX512(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param);
+
+/* In place colour transform of three planes, see ImageTransformColourSpace() */
+int RGBToYCbCrSSE41(sample *c0, sample *c1, sample *c2, const int count);
+int RGBToYCbCrAVX2(sample *c0, sample *c1, sample *c2, const int count);
+int RGBToYCbCrAVX512(sample *c0, sample *c1, sample *c2, const int count);
+
+int YCbCrToRGBSSE41(sample *c0, sample *c1, sample *c2, const int count);
+int YCbCrToRGBAVX2(sample *c0, sample *c1, sample *c2, const int count);
+int YCbCrToRGBAVX512(sample *c0, sample *c1, sample *c2, const int count);
+
+/* Colour transform of a pair of RGB8 rows of pair_count pixel pairs into two
+ * Y rows and a row of the 2 x 2 means of Cb and Cr, see ImageReadRGB8() */
+int RGB8ToYCbCrRowPairSSE41(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr);
+int RGB8ToYCbCrRowPairAVX2(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr);
+int RGB8ToYCbCrRowPairAVX512(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr);
+
+/* Inverse of a Y row and the chroma row under it, upsampled, to clipped
+ * pixels of format, see ImageRowToPixels() */
+int YCbCrToPixelsRowSSE41(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format);
+int YCbCrToPixelsRowAVX2(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format);
+int YCbCrToPixelsRowAVX512(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format);
+
+/* One output row of Signal2DDownsample2(), count = output elements */
+int Downsample2RowPairSSE41(const sample *row0, const sample *row1, const int count, sample *row);
+int Downsample2RowPairAVX2(const sample *row0, const sample *row1, const int count, sample *row);
+int Downsample2RowPairAVX512(const sample *row0, const sample *row1, const int count, sample *row);
+
+/* Two output rows of Signal2DUpsample2(), count = input elements */
+int Upsample2RowSSE41(const sample *src, const int count, sample *row0, sample *row1);
+int Upsample2RowAVX2(const sample *src, const int count, sample *row0, sample *row1);
+int Upsample2RowAVX512(const sample *src, const int count, sample *row0, sample *row1);
+
+/* pack32_8() over an array of samples */
+int Pack8SSE41(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos);
+int Pack8AVX2(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos);
+int Pack8AVX512(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos);
+
+/* Byte histogram, handles the whole array */
+void HistogramSSE41(const byte *data, const int size, uint32_t *histogram);
+
+#endif
@@ -0,0 +1,652 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <immintrin.h>
+
+#include "simd.h"
+#include "pack.h"
+#include "simd_rgb8.h"
+
+#ifdef BILD_WIDE_SAMPLES
+
+/* 8 samples per vector, compiled with -mavx2 */
+
+static inline __m256i p_Even(const __m256i a, const __m256i b)
+{
+  const __m256 e = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+  return _mm256_permute4x64_epi64(_mm256_castps_si256(e), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline __m256i p_Odd(const __m256i a, const __m256i b)
+{
+  const __m256 o = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+  return _mm256_permute4x64_epi64(_mm256_castps_si256(o), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m256i p_Quantize(const __m256i x, const __m128i q)
+{
+  return _mm256_sign_epi32(_mm256_srl_epi32(_mm256_abs_epi32(x), q), x);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m256i a0 = _mm256_loadu_si256((__m256i*)row0);
+  const __m256i a1 = _mm256_loadu_si256((__m256i*)(row0+8));
+  const __m256i b0 = _mm256_loadu_si256((__m256i*)row1);
+  const __m256i b1 = _mm256_loadu_si256((__m256i*)(row1+8));
+
+  /* Horizontal */
+  const __m256i e0 = p_Even(a0, a1);
+  const __m256i e1 = p_Even(b0, b1);
+  const __m256i d0 = _mm256_sub_epi32(p_Odd(a0, a1), e0);
+  const __m256i d1 = _mm256_sub_epi32(p_Odd(b0, b1), e1);
+  const __m256i s0 = _mm256_add_epi32(e0, _mm256_srai_epi32(d0, 1));
+  const __m256i s1 = _mm256_add_epi32(e1, _mm256_srai_epi32(d1, 1));
+
+  /* Vertical */
+  __m256i vhl = _mm256_sub_epi32(s1, s0);
+  __m256i vhh = _mm256_sub_epi32(d1, d0);
+  const __m256i vll = _mm256_add_epi32(s0, _mm256_srai_epi32(vhl, 1));
+  __m256i vlh = _mm256_add_epi32(d0, _mm256_srai_epi32(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm256_storeu_si256((__m256i*)ll, vll);
+  _mm256_storeu_si256((__m256i*)hl, vhl);
+  _mm256_storeu_si256((__m256i*)lh, vlh);
+  _mm256_storeu_si256((__m256i*)hh, vhh);
+
+}
+
+int DecomposeRowPairAVX2(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    p_DecomposeGroup(row0+(j<<1)+16, row1+(j<<1)+16, ll+j+8, lh+j+8, hl+j+8, hh+j+8, quant_param, q);
+  }
+
+  if (j+8 <= pair_count)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    j += 8;
+  }
+
+  return j;
+
+}
+
+static inline void p_Interleave(sample *row, const __m256i e, const __m256i o)
+{
+  const __m256i lo = _mm256_unpacklo_epi32(e, o);
+  const __m256i hi = _mm256_unpackhi_epi32(e, o);
+  _mm256_storeu_si256((__m256i*)row, _mm256_permute2x128_si256(lo, hi, 0x20));
+  _mm256_storeu_si256((__m256i*)(row+8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m256i vll = _mm256_loadu_si256((__m256i*)ll);
+  const __m256i vhl = _mm256_sll_epi32(_mm256_loadu_si256((__m256i*)hl), q);
+  const __m256i vlh = _mm256_sll_epi32(_mm256_loadu_si256((__m256i*)lh), q);
+  const __m256i vhh = _mm256_sll_epi32(_mm256_loadu_si256((__m256i*)hh), q);
+
+  /* Vertical */
+  const __m256i s0 = _mm256_sub_epi32(vll, _mm256_srai_epi32(vhl, 1));
+  const __m256i s1 = _mm256_add_epi32(vhl, s0);
+  const __m256i d0 = _mm256_sub_epi32(vlh, _mm256_srai_epi32(vhh, 1));
+  const __m256i d1 = _mm256_add_epi32(vhh, d0);
+
+  /* Horizontal */
+  const __m256i e0 = _mm256_sub_epi32(s0, _mm256_srai_epi32(d0, 1));
+  const __m256i e1 = _mm256_sub_epi32(s1, _mm256_srai_epi32(d1, 1));
+
+  p_Interleave(row0, e0, _mm256_add_epi32(d0, e0));
+  p_Interleave(row1, e1, _mm256_add_epi32(d1, e1));
+
+}
+
+int ReconstructRowPairAVX2(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    p_ReconstructGroup(row0+(j<<1)+16, row1+(j<<1)+16, ll+j+8, lh+j+8, hl+j+8, hh+j+8, q);
+  }
+
+  if (j+8 <= pair_count)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    j += 8;
+  }
+
+  return j;
+
+}
+
+int RGBToYCbCrAVX2(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m256i offset = _mm256_set1_epi32(128);
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m256i r = _mm256_loadu_si256((__m256i*)(c0+i));
+    const __m256i g = _mm256_loadu_si256((__m256i*)(c1+i));
+    const __m256i b = _mm256_loadu_si256((__m256i*)(c2+i));
+
+    const __m256i y = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(r, _mm256_slli_epi32(g, 1)), b), 2);
+
+    _mm256_storeu_si256((__m256i*)(c0+i), _mm256_sub_epi32(y, offset));
+    _mm256_storeu_si256((__m256i*)(c1+i), _mm256_sub_epi32(r, g));
+    _mm256_storeu_si256((__m256i*)(c2+i), _mm256_sub_epi32(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBAVX2(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m256i offset = _mm256_set1_epi32(128);
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m256i y = _mm256_loadu_si256((__m256i*)(c0+i));
+    const __m256i cb = _mm256_loadu_si256((__m256i*)(c1+i));
+    const __m256i cr = _mm256_loadu_si256((__m256i*)(c2+i));
+
+    const __m256i g = _mm256_add_epi32(_mm256_sub_epi32(y, _mm256_srai_epi32(_mm256_add_epi32(cb, cr), 2)), offset);
+
+    _mm256_storeu_si256((__m256i*)(c0+i), _mm256_add_epi32(cb, g));
+    _mm256_storeu_si256((__m256i*)(c1+i), g);
+    _mm256_storeu_si256((__m256i*)(c2+i), _mm256_add_epi32(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairAVX2(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m256i a = _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(row0+(i<<1))), _mm256_loadu_si256((__m256i*)(row1+(i<<1))));
+    const __m256i b = _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(row0+(i<<1)+8)), _mm256_loadu_si256((__m256i*)(row1+(i<<1)+8)));
+    const __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm256_storeu_si256((__m256i*)(row+i), _mm256_srai_epi32(sum, 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowAVX2(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+    const __m256i v = _mm256_loadu_si256((__m256i*)(src+i));
+    p_Interleave(row0+(i<<1), v, v);
+    p_Interleave(row1+(i<<1), v, v);
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8AVX2(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m256i max = _mm256_set1_epi32(127);
+  const __m256i min = _mm256_set1_epi32(-127);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  int i = 0, j;
+  for (; i+32 <= count; i += 32)
+  {
+
+    const __m256i v0 = _mm256_loadu_si256((__m256i*)(src+i));
+    const __m256i v1 = _mm256_loadu_si256((__m256i*)(src+i+8));
+    const __m256i v2 = _mm256_loadu_si256((__m256i*)(src+i+16));
+    const __m256i v3 = _mm256_loadu_si256((__m256i*)(src+i+24));
+
+    const __m256i escapes = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(v0, max), _mm256_cmpgt_epi32(min, v0)),
+                                                            _mm256_or_si256(_mm256_cmpgt_epi32(v1, max), _mm256_cmpgt_epi32(min, v1))),
+                                            _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(v2, max), _mm256_cmpgt_epi32(min, v2)),
+                                                            _mm256_or_si256(_mm256_cmpgt_epi32(v3, max), _mm256_cmpgt_epi32(min, v3))));
+
+    if (_mm256_testz_si256(escapes, escapes))
+    {
+      const __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v0, v1), _mm256_packs_epi32(v2, v3));
+      _mm256_storeu_si256((__m256i*)(dst+i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    else
+    {
+      for (j = i; j < i+32; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+/* The RGB8 kernels are only vectorized for 16 bit samples */
+int RGB8ToYCbCrRowPairAVX2(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr) { return 0; }
+int YCbCrToPixelsRowAVX2(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format) { return 0; }
+
+#else
+
+/* 16 samples per vector, compiled with -mavx2 */
+
+/* Even and odd samples of a and b, sign extended to 32 bits and packed
+ * back, which is exact. The packs work per 128 bit lane. */
+static inline __m256i p_Even(const __m256i a, const __m256i b)
+{
+  const __m256i e = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+  return _mm256_permute4x64_epi64(e, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline __m256i p_Odd(const __m256i a, const __m256i b)
+{
+  const __m256i o = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+  return _mm256_permute4x64_epi64(o, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m256i p_Quantize(const __m256i x, const __m128i q)
+{
+  return _mm256_sign_epi16(_mm256_srl_epi16(_mm256_abs_epi16(x), q), x);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m256i a0 = _mm256_loadu_si256((__m256i*)row0);
+  const __m256i a1 = _mm256_loadu_si256((__m256i*)(row0+16));
+  const __m256i b0 = _mm256_loadu_si256((__m256i*)row1);
+  const __m256i b1 = _mm256_loadu_si256((__m256i*)(row1+16));
+
+  /* Horizontal */
+  const __m256i e0 = p_Even(a0, a1);
+  const __m256i e1 = p_Even(b0, b1);
+  const __m256i d0 = _mm256_sub_epi16(p_Odd(a0, a1), e0);
+  const __m256i d1 = _mm256_sub_epi16(p_Odd(b0, b1), e1);
+  const __m256i s0 = _mm256_add_epi16(e0, _mm256_srai_epi16(d0, 1));
+  const __m256i s1 = _mm256_add_epi16(e1, _mm256_srai_epi16(d1, 1));
+
+  /* Vertical */
+  __m256i vhl = _mm256_sub_epi16(s1, s0);
+  __m256i vhh = _mm256_sub_epi16(d1, d0);
+  const __m256i vll = _mm256_add_epi16(s0, _mm256_srai_epi16(vhl, 1));
+  __m256i vlh = _mm256_add_epi16(d0, _mm256_srai_epi16(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm256_storeu_si256((__m256i*)ll, vll);
+  _mm256_storeu_si256((__m256i*)hl, vhl);
+  _mm256_storeu_si256((__m256i*)lh, vlh);
+  _mm256_storeu_si256((__m256i*)hh, vhh);
+
+}
+
+int DecomposeRowPairAVX2(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+32 <= pair_count; j += 32)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    p_DecomposeGroup(row0+(j<<1)+32, row1+(j<<1)+32, ll+j+16, lh+j+16, hl+j+16, hh+j+16, quant_param, q);
+  }
+
+  if (j+16 <= pair_count)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    j += 16;
+  }
+
+  return j;
+
+}
+
+static inline void p_Interleave(sample *row, const __m256i e, const __m256i o)
+{
+  const __m256i lo = _mm256_unpacklo_epi16(e, o);
+  const __m256i hi = _mm256_unpackhi_epi16(e, o);
+  _mm256_storeu_si256((__m256i*)row, _mm256_permute2x128_si256(lo, hi, 0x20));
+  _mm256_storeu_si256((__m256i*)(row+16), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m256i vll = _mm256_loadu_si256((__m256i*)ll);
+  const __m256i vhl = _mm256_sll_epi16(_mm256_loadu_si256((__m256i*)hl), q);
+  const __m256i vlh = _mm256_sll_epi16(_mm256_loadu_si256((__m256i*)lh), q);
+  const __m256i vhh = _mm256_sll_epi16(_mm256_loadu_si256((__m256i*)hh), q);
+
+  /* Vertical */
+  const __m256i s0 = _mm256_sub_epi16(vll, _mm256_srai_epi16(vhl, 1));
+  const __m256i s1 = _mm256_add_epi16(vhl, s0);
+  const __m256i d0 = _mm256_sub_epi16(vlh, _mm256_srai_epi16(vhh, 1));
+  const __m256i d1 = _mm256_add_epi16(vhh, d0);
+
+  /* Horizontal */
+  const __m256i e0 = _mm256_sub_epi16(s0, _mm256_srai_epi16(d0, 1));
+  const __m256i e1 = _mm256_sub_epi16(s1, _mm256_srai_epi16(d1, 1));
+
+  p_Interleave(row0, e0, _mm256_add_epi16(d0, e0));
+  p_Interleave(row1, e1, _mm256_add_epi16(d1, e1));
+
+}
+
+int ReconstructRowPairAVX2(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+32 <= pair_count; j += 32)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    p_ReconstructGroup(row0+(j<<1)+32, row1+(j<<1)+32, ll+j+16, lh+j+16, hl+j+16, hh+j+16, q);
+  }
+
+  if (j+16 <= pair_count)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    j += 16;
+  }
+
+  return j;
+
+}
+
+int RGBToYCbCrAVX2(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m256i offset = _mm256_set1_epi16(128);
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m256i r = _mm256_loadu_si256((__m256i*)(c0+i));
+    const __m256i g = _mm256_loadu_si256((__m256i*)(c1+i));
+    const __m256i b = _mm256_loadu_si256((__m256i*)(c2+i));
+
+    const __m256i y = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(r, _mm256_slli_epi16(g, 1)), b), 2);
+
+    _mm256_storeu_si256((__m256i*)(c0+i), _mm256_sub_epi16(y, offset));
+    _mm256_storeu_si256((__m256i*)(c1+i), _mm256_sub_epi16(r, g));
+    _mm256_storeu_si256((__m256i*)(c2+i), _mm256_sub_epi16(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBAVX2(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m256i offset = _mm256_set1_epi16(128);
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m256i y = _mm256_loadu_si256((__m256i*)(c0+i));
+    const __m256i cb = _mm256_loadu_si256((__m256i*)(c1+i));
+    const __m256i cr = _mm256_loadu_si256((__m256i*)(c2+i));
+
+    const __m256i g = _mm256_add_epi16(_mm256_sub_epi16(y, _mm256_srai_epi16(_mm256_add_epi16(cb, cr), 2)), offset);
+
+    _mm256_storeu_si256((__m256i*)(c0+i), _mm256_add_epi16(cb, g));
+    _mm256_storeu_si256((__m256i*)(c1+i), g);
+    _mm256_storeu_si256((__m256i*)(c2+i), _mm256_add_epi16(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairAVX2(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m256i a = _mm256_add_epi16(_mm256_loadu_si256((__m256i*)(row0+(i<<1))), _mm256_loadu_si256((__m256i*)(row1+(i<<1))));
+    const __m256i b = _mm256_add_epi16(_mm256_loadu_si256((__m256i*)(row0+(i<<1)+16)), _mm256_loadu_si256((__m256i*)(row1+(i<<1)+16)));
+    const __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm256_storeu_si256((__m256i*)(row+i), _mm256_srai_epi16(sum, 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowAVX2(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+    const __m256i v = _mm256_loadu_si256((__m256i*)(src+i));
+    p_Interleave(row0+(i<<1), v, v);
+    p_Interleave(row1+(i<<1), v, v);
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8AVX2(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m256i max = _mm256_set1_epi16(127);
+  const __m256i min = _mm256_set1_epi16(-127);
+
+  int i = 0, j;
+  for (; i+64 <= count; i += 64)
+  {
+
+    const __m256i v0 = _mm256_loadu_si256((__m256i*)(src+i));
+    const __m256i v1 = _mm256_loadu_si256((__m256i*)(src+i+16));
+    const __m256i v2 = _mm256_loadu_si256((__m256i*)(src+i+32));
+    const __m256i v3 = _mm256_loadu_si256((__m256i*)(src+i+48));
+
+    const __m256i escapes = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi16(v0, max), _mm256_cmpgt_epi16(min, v0)),
+                                                            _mm256_or_si256(_mm256_cmpgt_epi16(v1, max), _mm256_cmpgt_epi16(min, v1))),
+                                            _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi16(v2, max), _mm256_cmpgt_epi16(min, v2)),
+                                                            _mm256_or_si256(_mm256_cmpgt_epi16(v3, max), _mm256_cmpgt_epi16(min, v3))));
+
+    if (_mm256_testz_si256(escapes, escapes))
+    {
+      _mm256_storeu_si256((__m256i*)(dst+i), _mm256_permute4x64_epi64(_mm256_packs_epi16(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+      _mm256_storeu_si256((__m256i*)(dst+i+32), _mm256_permute4x64_epi64(_mm256_packs_epi16(v2, v3), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    else
+    {
+      for (j = i; j < i+64; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+/* Luma of the 32 pixels at rgb to y, their chroma R-G and B-G to cb and cr */
+static inline void p_RGB8ToYCbCr(const uint8_t *rgb, sample *y, __m256i *cb, __m256i *cr)
+{
+
+  const __m256i offset = _mm256_set1_epi16(128);
+
+  __m128i r8, g8, b8;
+  __m256i r, g, b;
+
+  int k;
+  for (k = 0; k < 2; ++k)
+  {
+
+    LoadRGB8x16(rgb+k*48, &r8, &g8, &b8);
+
+    r = _mm256_cvtepu8_epi16(r8);
+    g = _mm256_cvtepu8_epi16(g8);
+    b = _mm256_cvtepu8_epi16(b8);
+
+    _mm256_storeu_si256((__m256i*)(y+(k<<4)),
+                        _mm256_sub_epi16(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(r, _mm256_slli_epi16(g, 1)), b), 2), offset));
+    cb[k] = _mm256_sub_epi16(r, g);
+    cr[k] = _mm256_sub_epi16(b, g);
+
+  }
+
+}
+
+/* Sums of the pairs of a and b, in order */
+static inline __m256i p_PairSums(const __m256i a, const __m256i b)
+{
+  return _mm256_permute4x64_epi64(_mm256_hadd_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+int RGB8ToYCbCrRowPairAVX2(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr)
+{
+
+  __m256i cb0[2], cr0[2], cb1[2], cr1[2];
+
+  int i = 0;
+  for (; i+16 <= pair_count; i += 16)
+  {
+
+    p_RGB8ToYCbCr(rgb0+i*6, y0+(i<<1), cb0, cr0);
+    p_RGB8ToYCbCr(rgb1+i*6, y1+(i<<1), cb1, cr1);
+
+    _mm256_storeu_si256((__m256i*)(cb+i),
+                        _mm256_srai_epi16(p_PairSums(_mm256_add_epi16(cb0[0], cb1[0]), _mm256_add_epi16(cb0[1], cb1[1])), 2));
+    _mm256_storeu_si256((__m256i*)(cr+i),
+                        _mm256_srai_epi16(p_PairSums(_mm256_add_epi16(cr0[0], cr1[0]), _mm256_add_epi16(cr0[1], cr1[1])), 2));
+
+  }
+
+  return i;
+
+}
+
+/* Every element of v twice, the first and the second half */
+static inline void p_Double(const __m256i v, __m256i *d)
+{
+  const __m256i lo = _mm256_unpacklo_epi16(v, v);
+  const __m256i hi = _mm256_unpackhi_epi16(v, v);
+  d[0] = _mm256_permute2x128_si256(lo, hi, 0x20);
+  d[1] = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+/* Clipped bytes of a and b, in order */
+static inline __m256i p_PackBytes(const __m256i a, const __m256i b)
+{
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+int YCbCrToPixelsRowAVX2(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format)
+{
+
+  const int pixel_size = PIXEL_SIZE(format);
+  const __m256i offset = _mm256_set1_epi16(128);
+
+  __m256i vt[2], vcb[2], vcr[2], g[2];
+
+  int i = 0, k;
+  for (; i+16 <= pair_count; i += 16)
+  {
+
+    const __m256i u = _mm256_loadu_si256((__m256i*)(cb+i));
+    const __m256i v = _mm256_loadu_si256((__m256i*)(cr+i));
+
+    /* Every chroma sample covers two pixels */
+    p_Double(_mm256_srai_epi16(_mm256_add_epi16(u, v), 2), vt);
+    p_Double(u, vcb);
+    p_Double(v, vcr);
+
+    for (k = 0; k < 2; ++k)
+      g[k] = _mm256_add_epi16(_mm256_sub_epi16(_mm256_loadu_si256((__m256i*)(y+(i<<1)+(k<<4))), vt[k]), offset);
+
+    /* Packing with unsigned saturation is CLIP() */
+    const __m256i r8 = p_PackBytes(_mm256_add_epi16(vcb[0], g[0]), _mm256_add_epi16(vcb[1], g[1]));
+    const __m256i g8 = p_PackBytes(g[0], g[1]);
+    const __m256i b8 = p_PackBytes(_mm256_add_epi16(vcr[0], g[0]), _mm256_add_epi16(vcr[1], g[1]));
+
+    StorePixels8x16(pixels+(i<<1)*pixel_size, _mm256_castsi256_si128(r8), _mm256_castsi256_si128(g8), _mm256_castsi256_si128(b8), format);
+    StorePixels8x16(pixels+((i<<1)+16)*pixel_size, _mm256_extracti128_si256(r8, 1), _mm256_extracti128_si256(g8, 1), _mm256_extracti128_si256(b8, 1), format);
+
+  }
+
+  return i;
+
+}
+
+#endif
@@ -0,0 +1,606 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <immintrin.h>
+
+#include "simd.h"
+#include "pack.h"
+#include "simd_rgb8.h"
+
+#ifdef BILD_WIDE_SAMPLES
+
+/* 16 samples per vector, compiled with -mavx512f */
+
+static inline __m512i p_Even(const __m512i a, const __m512i b)
+{
+  const __m512i index = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+  return _mm512_permutex2var_epi32(a, index, b);
+}
+
+static inline __m512i p_Odd(const __m512i a, const __m512i b)
+{
+  const __m512i index = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+  return _mm512_permutex2var_epi32(a, index, b);
+}
+
+static inline void p_Interleave(sample *row, const __m512i e, const __m512i o)
+{
+  const __m512i index_lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+  const __m512i index_hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+  _mm512_storeu_si512(row, _mm512_permutex2var_epi32(e, index_lo, o));
+  _mm512_storeu_si512(row+16, _mm512_permutex2var_epi32(e, index_hi, o));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m512i p_Quantize(const __m512i x, const __m128i q)
+{
+  const __m512i a = _mm512_srl_epi32(_mm512_abs_epi32(x), q);
+  return _mm512_mask_sub_epi32(a, _mm512_cmplt_epi32_mask(x, _mm512_setzero_si512()), _mm512_setzero_si512(), a);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m512i a0 = _mm512_loadu_si512(row0);
+  const __m512i a1 = _mm512_loadu_si512(row0+16);
+  const __m512i b0 = _mm512_loadu_si512(row1);
+  const __m512i b1 = _mm512_loadu_si512(row1+16);
+
+  /* Horizontal */
+  const __m512i e0 = p_Even(a0, a1);
+  const __m512i e1 = p_Even(b0, b1);
+  const __m512i d0 = _mm512_sub_epi32(p_Odd(a0, a1), e0);
+  const __m512i d1 = _mm512_sub_epi32(p_Odd(b0, b1), e1);
+  const __m512i s0 = _mm512_add_epi32(e0, _mm512_srai_epi32(d0, 1));
+  const __m512i s1 = _mm512_add_epi32(e1, _mm512_srai_epi32(d1, 1));
+
+  /* Vertical */
+  __m512i vhl = _mm512_sub_epi32(s1, s0);
+  __m512i vhh = _mm512_sub_epi32(d1, d0);
+  const __m512i vll = _mm512_add_epi32(s0, _mm512_srai_epi32(vhl, 1));
+  __m512i vlh = _mm512_add_epi32(d0, _mm512_srai_epi32(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm512_storeu_si512(ll, vll);
+  _mm512_storeu_si512(hl, vhl);
+  _mm512_storeu_si512(lh, vlh);
+  _mm512_storeu_si512(hh, vhh);
+
+}
+
+int DecomposeRowPairAVX512(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+
+  return j;
+
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m512i vll = _mm512_loadu_si512(ll);
+  const __m512i vhl = _mm512_sll_epi32(_mm512_loadu_si512(hl), q);
+  const __m512i vlh = _mm512_sll_epi32(_mm512_loadu_si512(lh), q);
+  const __m512i vhh = _mm512_sll_epi32(_mm512_loadu_si512(hh), q);
+
+  /* Vertical */
+  const __m512i s0 = _mm512_sub_epi32(vll, _mm512_srai_epi32(vhl, 1));
+  const __m512i s1 = _mm512_add_epi32(vhl, s0);
+  const __m512i d0 = _mm512_sub_epi32(vlh, _mm512_srai_epi32(vhh, 1));
+  const __m512i d1 = _mm512_add_epi32(vhh, d0);
+
+  /* Horizontal */
+  const __m512i e0 = _mm512_sub_epi32(s0, _mm512_srai_epi32(d0, 1));
+  const __m512i e1 = _mm512_sub_epi32(s1, _mm512_srai_epi32(d1, 1));
+
+  p_Interleave(row0, e0, _mm512_add_epi32(d0, e0));
+  p_Interleave(row1, e1, _mm512_add_epi32(d1, e1));
+
+}
+
+int ReconstructRowPairAVX512(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+
+  return j;
+
+}
+
+int RGBToYCbCrAVX512(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m512i offset = _mm512_set1_epi32(128);
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m512i r = _mm512_loadu_si512(c0+i);
+    const __m512i g = _mm512_loadu_si512(c1+i);
+    const __m512i b = _mm512_loadu_si512(c2+i);
+
+    const __m512i y = _mm512_srai_epi32(_mm512_add_epi32(_mm512_add_epi32(r, _mm512_slli_epi32(g, 1)), b), 2);
+
+    _mm512_storeu_si512(c0+i, _mm512_sub_epi32(y, offset));
+    _mm512_storeu_si512(c1+i, _mm512_sub_epi32(r, g));
+    _mm512_storeu_si512(c2+i, _mm512_sub_epi32(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBAVX512(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m512i offset = _mm512_set1_epi32(128);
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m512i y = _mm512_loadu_si512(c0+i);
+    const __m512i cb = _mm512_loadu_si512(c1+i);
+    const __m512i cr = _mm512_loadu_si512(c2+i);
+
+    const __m512i g = _mm512_add_epi32(_mm512_sub_epi32(y, _mm512_srai_epi32(_mm512_add_epi32(cb, cr), 2)), offset);
+
+    _mm512_storeu_si512(c0+i, _mm512_add_epi32(cb, g));
+    _mm512_storeu_si512(c1+i, g);
+    _mm512_storeu_si512(c2+i, _mm512_add_epi32(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairAVX512(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m512i a = _mm512_add_epi32(_mm512_loadu_si512(row0+(i<<1)), _mm512_loadu_si512(row1+(i<<1)));
+    const __m512i b = _mm512_add_epi32(_mm512_loadu_si512(row0+(i<<1)+16), _mm512_loadu_si512(row1+(i<<1)+16));
+
+    _mm512_storeu_si512(row+i, _mm512_srai_epi32(_mm512_add_epi32(p_Even(a, b), p_Odd(a, b)), 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowAVX512(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+16 <= count; i += 16)
+  {
+    const __m512i v = _mm512_loadu_si512(src+i);
+    p_Interleave(row0+(i<<1), v, v);
+    p_Interleave(row1+(i<<1), v, v);
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8AVX512(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m512i max = _mm512_set1_epi32(127);
+  const __m512i min = _mm512_set1_epi32(-127);
+
+  int i = 0, j;
+  for (; i+64 <= count; i += 64)
+  {
+
+    const __m512i v0 = _mm512_loadu_si512(src+i);
+    const __m512i v1 = _mm512_loadu_si512(src+i+16);
+    const __m512i v2 = _mm512_loadu_si512(src+i+32);
+    const __m512i v3 = _mm512_loadu_si512(src+i+48);
+
+    const __mmask16 escapes = _mm512_cmpgt_epi32_mask(v0, max) | _mm512_cmplt_epi32_mask(v0, min) |
+                              _mm512_cmpgt_epi32_mask(v1, max) | _mm512_cmplt_epi32_mask(v1, min) |
+                              _mm512_cmpgt_epi32_mask(v2, max) | _mm512_cmplt_epi32_mask(v2, min) |
+                              _mm512_cmpgt_epi32_mask(v3, max) | _mm512_cmplt_epi32_mask(v3, min);
+
+    if (!escapes)
+    {
+      _mm_storeu_si128((__m128i*)(dst+i), _mm512_cvtsepi32_epi8(v0));
+      _mm_storeu_si128((__m128i*)(dst+i+16), _mm512_cvtsepi32_epi8(v1));
+      _mm_storeu_si128((__m128i*)(dst+i+32), _mm512_cvtsepi32_epi8(v2));
+      _mm_storeu_si128((__m128i*)(dst+i+48), _mm512_cvtsepi32_epi8(v3));
+    }
+    else
+    {
+      for (j = i; j < i+64; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+/* The RGB8 kernels are only vectorized for 16 bit samples */
+int RGB8ToYCbCrRowPairAVX512(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr) { return 0; }
+int YCbCrToPixelsRowAVX512(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format) { return 0; }
+
+#else
+
+/* 32 samples per vector, compiled with -mavx512bw */
+
+static const int16_t p_even_index[32] =
+{
+  0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+  32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62
+};
+
+static const int16_t p_interleave_index[64] =
+{
+  0, 32, 1, 33, 2, 34, 3, 35, 4, 36, 5, 37, 6, 38, 7, 39,
+  8, 40, 9, 41, 10, 42, 11, 43, 12, 44, 13, 45, 14, 46, 15, 47,
+  16, 48, 17, 49, 18, 50, 19, 51, 20, 52, 21, 53, 22, 54, 23, 55,
+  24, 56, 25, 57, 26, 58, 27, 59, 28, 60, 29, 61, 30, 62, 31, 63
+};
+
+static inline __m512i p_Even(const __m512i a, const __m512i b)
+{
+  return _mm512_permutex2var_epi16(a, _mm512_loadu_si512(p_even_index), b);
+}
+
+static inline __m512i p_Odd(const __m512i a, const __m512i b)
+{
+  const __m512i index = _mm512_add_epi16(_mm512_loadu_si512(p_even_index), _mm512_set1_epi16(1));
+  return _mm512_permutex2var_epi16(a, index, b);
+}
+
+static inline void p_Interleave(sample *row, const __m512i e, const __m512i o)
+{
+  _mm512_storeu_si512(row, _mm512_permutex2var_epi16(e, _mm512_loadu_si512(p_interleave_index), o));
+  _mm512_storeu_si512(row+32, _mm512_permutex2var_epi16(e, _mm512_loadu_si512(p_interleave_index+32), o));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m512i p_Quantize(const __m512i x, const __m128i q)
+{
+  const __m512i a = _mm512_srl_epi16(_mm512_abs_epi16(x), q);
+  return _mm512_mask_sub_epi16(a, _mm512_cmplt_epi16_mask(x, _mm512_setzero_si512()), _mm512_setzero_si512(), a);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m512i a0 = _mm512_loadu_si512(row0);
+  const __m512i a1 = _mm512_loadu_si512(row0+32);
+  const __m512i b0 = _mm512_loadu_si512(row1);
+  const __m512i b1 = _mm512_loadu_si512(row1+32);
+
+  /* Horizontal */
+  const __m512i e0 = p_Even(a0, a1);
+  const __m512i e1 = p_Even(b0, b1);
+  const __m512i d0 = _mm512_sub_epi16(p_Odd(a0, a1), e0);
+  const __m512i d1 = _mm512_sub_epi16(p_Odd(b0, b1), e1);
+  const __m512i s0 = _mm512_add_epi16(e0, _mm512_srai_epi16(d0, 1));
+  const __m512i s1 = _mm512_add_epi16(e1, _mm512_srai_epi16(d1, 1));
+
+  /* Vertical */
+  __m512i vhl = _mm512_sub_epi16(s1, s0);
+  __m512i vhh = _mm512_sub_epi16(d1, d0);
+  const __m512i vll = _mm512_add_epi16(s0, _mm512_srai_epi16(vhl, 1));
+  __m512i vlh = _mm512_add_epi16(d0, _mm512_srai_epi16(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm512_storeu_si512(ll, vll);
+  _mm512_storeu_si512(hl, vhl);
+  _mm512_storeu_si512(lh, vlh);
+  _mm512_storeu_si512(hh, vhh);
+
+}
+
+int DecomposeRowPairAVX512(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+32 <= pair_count; j += 32)
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+
+  return j;
+
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m512i vll = _mm512_loadu_si512(ll);
+  const __m512i vhl = _mm512_sll_epi16(_mm512_loadu_si512(hl), q);
+  const __m512i vlh = _mm512_sll_epi16(_mm512_loadu_si512(lh), q);
+  const __m512i vhh = _mm512_sll_epi16(_mm512_loadu_si512(hh), q);
+
+  /* Vertical */
+  const __m512i s0 = _mm512_sub_epi16(vll, _mm512_srai_epi16(vhl, 1));
+  const __m512i s1 = _mm512_add_epi16(vhl, s0);
+  const __m512i d0 = _mm512_sub_epi16(vlh, _mm512_srai_epi16(vhh, 1));
+  const __m512i d1 = _mm512_add_epi16(vhh, d0);
+
+  /* Horizontal */
+  const __m512i e0 = _mm512_sub_epi16(s0, _mm512_srai_epi16(d0, 1));
+  const __m512i e1 = _mm512_sub_epi16(s1, _mm512_srai_epi16(d1, 1));
+
+  p_Interleave(row0, e0, _mm512_add_epi16(d0, e0));
+  p_Interleave(row1, e1, _mm512_add_epi16(d1, e1));
+
+}
+
+int ReconstructRowPairAVX512(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+32 <= pair_count; j += 32)
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+
+  return j;
+
+}
+
+int RGBToYCbCrAVX512(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m512i offset = _mm512_set1_epi16(128);
+
+  int i = 0;
+  for (; i+32 <= count; i += 32)
+  {
+
+    const __m512i r = _mm512_loadu_si512(c0+i);
+    const __m512i g = _mm512_loadu_si512(c1+i);
+    const __m512i b = _mm512_loadu_si512(c2+i);
+
+    const __m512i y = _mm512_srai_epi16(_mm512_add_epi16(_mm512_add_epi16(r, _mm512_slli_epi16(g, 1)), b), 2);
+
+    _mm512_storeu_si512(c0+i, _mm512_sub_epi16(y, offset));
+    _mm512_storeu_si512(c1+i, _mm512_sub_epi16(r, g));
+    _mm512_storeu_si512(c2+i, _mm512_sub_epi16(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBAVX512(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m512i offset = _mm512_set1_epi16(128);
+
+  int i = 0;
+  for (; i+32 <= count; i += 32)
+  {
+
+    const __m512i y = _mm512_loadu_si512(c0+i);
+    const __m512i cb = _mm512_loadu_si512(c1+i);
+    const __m512i cr = _mm512_loadu_si512(c2+i);
+
+    const __m512i g = _mm512_add_epi16(_mm512_sub_epi16(y, _mm512_srai_epi16(_mm512_add_epi16(cb, cr), 2)), offset);
+
+    _mm512_storeu_si512(c0+i, _mm512_add_epi16(cb, g));
+    _mm512_storeu_si512(c1+i, g);
+    _mm512_storeu_si512(c2+i, _mm512_add_epi16(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairAVX512(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+32 <= count; i += 32)
+  {
+
+    const __m512i a = _mm512_add_epi16(_mm512_loadu_si512(row0+(i<<1)), _mm512_loadu_si512(row1+(i<<1)));
+    const __m512i b = _mm512_add_epi16(_mm512_loadu_si512(row0+(i<<1)+32), _mm512_loadu_si512(row1+(i<<1)+32));
+
+    _mm512_storeu_si512(row+i, _mm512_srai_epi16(_mm512_add_epi16(p_Even(a, b), p_Odd(a, b)), 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowAVX512(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+32 <= count; i += 32)
+  {
+    const __m512i v = _mm512_loadu_si512(src+i);
+    p_Interleave(row0+(i<<1), v, v);
+    p_Interleave(row1+(i<<1), v, v);
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8AVX512(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m512i max = _mm512_set1_epi16(127);
+  const __m512i min = _mm512_set1_epi16(-127);
+
+  int i = 0, j;
+  for (; i+64 <= count; i += 64)
+  {
+
+    const __m512i v0 = _mm512_loadu_si512(src+i);
+    const __m512i v1 = _mm512_loadu_si512(src+i+32);
+
+    const __mmask32 escapes = _mm512_cmpgt_epi16_mask(v0, max) | _mm512_cmplt_epi16_mask(v0, min) |
+                              _mm512_cmpgt_epi16_mask(v1, max) | _mm512_cmplt_epi16_mask(v1, min);
+
+    if (!escapes)
+    {
+      _mm256_storeu_si256((__m256i*)(dst+i), _mm512_cvtsepi16_epi8(v0));
+      _mm256_storeu_si256((__m256i*)(dst+i+32), _mm512_cvtsepi16_epi8(v1));
+    }
+    else
+    {
+      for (j = i; j < i+64; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+static const int16_t p_double_index[32] =
+{
+  0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+  8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15
+};
+
+/* Luma of the 32 pixels at rgb to y, their chroma R-G and B-G to cb and cr */
+static inline void p_RGB8ToYCbCr(const uint8_t *rgb, sample *y, __m512i *cb, __m512i *cr)
+{
+
+  const __m512i offset = _mm512_set1_epi16(128);
+
+  __m128i r8[2], g8[2], b8[2];
+  LoadRGB8x16(rgb, &r8[0], &g8[0], &b8[0]);
+  LoadRGB8x16(rgb+48, &r8[1], &g8[1], &b8[1]);
+
+  const __m512i r = _mm512_cvtepu8_epi16(_mm256_set_m128i(r8[1], r8[0]));
+  const __m512i g = _mm512_cvtepu8_epi16(_mm256_set_m128i(g8[1], g8[0]));
+  const __m512i b = _mm512_cvtepu8_epi16(_mm256_set_m128i(b8[1], b8[0]));
+
+  _mm512_storeu_si512(y, _mm512_sub_epi16(_mm512_srai_epi16(_mm512_add_epi16(_mm512_add_epi16(r, _mm512_slli_epi16(g, 1)), b), 2), offset));
+  *cb = _mm512_sub_epi16(r, g);
+  *cr = _mm512_sub_epi16(b, g);
+
+}
+
+/* Means of the pairs of the sums of two rows */
+static inline __m256i p_PairMeans(const __m512i s)
+{
+  return _mm512_cvtepi32_epi16(_mm512_srai_epi32(_mm512_madd_epi16(s, _mm512_set1_epi16(1)), 2));
+}
+
+int RGB8ToYCbCrRowPairAVX512(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr)
+{
+
+  __m512i cb0, cr0, cb1, cr1;
+
+  int i = 0;
+  for (; i+16 <= pair_count; i += 16)
+  {
+
+    p_RGB8ToYCbCr(rgb0+i*6, y0+(i<<1), &cb0, &cr0);
+    p_RGB8ToYCbCr(rgb1+i*6, y1+(i<<1), &cb1, &cr1);
+
+    _mm256_storeu_si256((__m256i*)(cb+i), p_PairMeans(_mm512_add_epi16(cb0, cb1)));
+    _mm256_storeu_si256((__m256i*)(cr+i), p_PairMeans(_mm512_add_epi16(cr0, cr1)));
+
+  }
+
+  return i;
+
+}
+
+/* Clipped bytes of x */
+static inline __m256i p_PackBytes(const __m512i x)
+{
+  return _mm512_cvtepi16_epi8(_mm512_min_epi16(_mm512_max_epi16(x, _mm512_setzero_si512()), _mm512_set1_epi16(255)));
+}
+
+int YCbCrToPixelsRowAVX512(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format)
+{
+
+  const int pixel_size = PIXEL_SIZE(format);
+  const __m512i offset = _mm512_set1_epi16(128);
+  const __m512i index = _mm512_loadu_si512(p_double_index);
+
+  int i = 0;
+  for (; i+16 <= pair_count; i += 16)
+  {
+
+    const __m256i u = _mm256_loadu_si256((__m256i*)(cb+i));
+    const __m256i v = _mm256_loadu_si256((__m256i*)(cr+i));
+
+    /* Every chroma sample covers two pixels */
+    const __m512i vt = _mm512_permutexvar_epi16(index, _mm512_castsi256_si512(_mm256_srai_epi16(_mm256_add_epi16(u, v), 2)));
+    const __m512i vcb = _mm512_permutexvar_epi16(index, _mm512_castsi256_si512(u));
+    const __m512i vcr = _mm512_permutexvar_epi16(index, _mm512_castsi256_si512(v));
+
+    const __m512i g = _mm512_add_epi16(_mm512_sub_epi16(_mm512_loadu_si512(y+(i<<1)), vt), offset);
+
+    const __m256i r8 = p_PackBytes(_mm512_add_epi16(vcb, g));
+    const __m256i g8 = p_PackBytes(g);
+    const __m256i b8 = p_PackBytes(_mm512_add_epi16(vcr, g));
+
+    StorePixels8x16(pixels+(i<<1)*pixel_size, _mm256_castsi256_si128(r8), _mm256_castsi256_si128(g8), _mm256_castsi256_si128(b8), format);
+    StorePixels8x16(pixels+((i<<1)+16)*pixel_size, _mm256_extracti128_si256(r8, 1), _mm256_extracti128_si256(g8, 1), _mm256_extracti128_si256(b8, 1), format);
+
+  }
+
+  return i;
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Interleaved RGB8 pixels to and from planes of bytes, 16 pixels at a time
+ * with SSSE3 byte shuffles. For the kernel translation units only. */
+
+#ifndef SIMD_RGB8_H
+#define SIMD_RGB8_H
+
+#include <immintrin.h>
+
+#include "types.h"
+
+/* Splits the 48 bytes of 16 pixels at rgb into their channels */
+static inline void LoadRGB8x16(const uint8_t *rgb, __m128i *r, __m128i *g, __m128i *b)
+{
+
+  const __m128i v0 = _mm_loadu_si128((__m128i*)rgb);
+  const __m128i v1 = _mm_loadu_si128((__m128i*)(rgb+16));
+  const __m128i v2 = _mm_loadu_si128((__m128i*)(rgb+32));
+
+  *r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                 _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+                    _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+  *g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                 _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+                    _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+  *b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                                 _mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+                    _mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+
+}
+
+/* Interleaves 16 pixels of the channels into 48 bytes at rgb */
+static inline void StoreRGB8x16(uint8_t *rgb, const __m128i r, const __m128i g, const __m128i b)
+{
+
+  _mm_storeu_si128((__m128i*)rgb,
+                   _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+                                             _mm_shuffle_epi8(g, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+                                _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1))));
+  _mm_storeu_si128((__m128i*)(rgb+16),
+                   _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+                                             _mm_shuffle_epi8(g, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+                                _mm_shuffle_epi8(b, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1))));
+  _mm_storeu_si128((__m128i*)(rgb+32),
+                   _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+                                             _mm_shuffle_epi8(g, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+                                _mm_shuffle_epi8(b, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15))));
+
+}
+
+/* Stores 16 pixels of the channels in the byte order of format, RGBA8 with
+ * opaque alpha */
+static inline void StorePixels8x16(uint8_t *pixels, const __m128i r, const __m128i g, const __m128i b, const PixelFormat format)
+{
+
+  const __m128i opaque = _mm_set1_epi8(-1);
+
+  switch (format)
+  {
+
+    case PixelRGB8 : StoreRGB8x16(pixels, r, g, b); break;
+    case PixelBGR8 : StoreRGB8x16(pixels, b, g, r); break;
+
+    case PixelRGBA8 :
+    {
+
+      const __m128i rg0 = _mm_unpacklo_epi8(r, g);
+      const __m128i rg1 = _mm_unpackhi_epi8(r, g);
+      const __m128i ba0 = _mm_unpacklo_epi8(b, opaque);
+      const __m128i ba1 = _mm_unpackhi_epi8(b, opaque);
+
+      _mm_storeu_si128((__m128i*)pixels, _mm_unpacklo_epi16(rg0, ba0));
+      _mm_storeu_si128((__m128i*)(pixels+16), _mm_unpackhi_epi16(rg0, ba0));
+      _mm_storeu_si128((__m128i*)(pixels+32), _mm_unpacklo_epi16(rg1, ba1));
+      _mm_storeu_si128((__m128i*)(pixels+48), _mm_unpackhi_epi16(rg1, ba1));
+
+      break;
+
+    }
+
+  }
+
+}
+
+#endif
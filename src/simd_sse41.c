@@ -0,0 +1,658 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <smmintrin.h>
+
+#include "simd.h"
+#include "pack.h"
+#include "simd_rgb8.h"
+
+#ifdef BILD_WIDE_SAMPLES
+
+/* 4 samples per vector, compiled with -msse4.1 */
+
+static inline __m128i p_Even(const __m128i a, const __m128i b)
+{
+  return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static inline __m128i p_Odd(const __m128i a, const __m128i b)
+{
+  return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m128i p_Quantize(const __m128i x, const __m128i q)
+{
+  return _mm_sign_epi32(_mm_srl_epi32(_mm_abs_epi32(x), q), x);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m128i a0 = _mm_loadu_si128((__m128i*)row0);
+  const __m128i a1 = _mm_loadu_si128((__m128i*)(row0+4));
+  const __m128i b0 = _mm_loadu_si128((__m128i*)row1);
+  const __m128i b1 = _mm_loadu_si128((__m128i*)(row1+4));
+
+  /* Horizontal */
+  const __m128i e0 = p_Even(a0, a1);
+  const __m128i e1 = p_Even(b0, b1);
+  const __m128i d0 = _mm_sub_epi32(p_Odd(a0, a1), e0);
+  const __m128i d1 = _mm_sub_epi32(p_Odd(b0, b1), e1);
+  const __m128i s0 = _mm_add_epi32(e0, _mm_srai_epi32(d0, 1));
+  const __m128i s1 = _mm_add_epi32(e1, _mm_srai_epi32(d1, 1));
+
+  /* Vertical */
+  __m128i vhl = _mm_sub_epi32(s1, s0);
+  __m128i vhh = _mm_sub_epi32(d1, d0);
+  const __m128i vll = _mm_add_epi32(s0, _mm_srai_epi32(vhl, 1));
+  __m128i vlh = _mm_add_epi32(d0, _mm_srai_epi32(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm_storeu_si128((__m128i*)ll, vll);
+  _mm_storeu_si128((__m128i*)hl, vhl);
+  _mm_storeu_si128((__m128i*)lh, vlh);
+  _mm_storeu_si128((__m128i*)hh, vhh);
+
+}
+
+int DecomposeRowPairSSE41(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+8 <= pair_count; j += 8)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    p_DecomposeGroup(row0+(j<<1)+8, row1+(j<<1)+8, ll+j+4, lh+j+4, hl+j+4, hh+j+4, quant_param, q);
+  }
+
+  if (j+4 <= pair_count)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    j += 4;
+  }
+
+  return j;
+
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m128i vll = _mm_loadu_si128((__m128i*)ll);
+  const __m128i vhl = _mm_sll_epi32(_mm_loadu_si128((__m128i*)hl), q);
+  const __m128i vlh = _mm_sll_epi32(_mm_loadu_si128((__m128i*)lh), q);
+  const __m128i vhh = _mm_sll_epi32(_mm_loadu_si128((__m128i*)hh), q);
+
+  /* Vertical */
+  const __m128i s0 = _mm_sub_epi32(vll, _mm_srai_epi32(vhl, 1));
+  const __m128i s1 = _mm_add_epi32(vhl, s0);
+  const __m128i d0 = _mm_sub_epi32(vlh, _mm_srai_epi32(vhh, 1));
+  const __m128i d1 = _mm_add_epi32(vhh, d0);
+
+  /* Horizontal */
+  const __m128i e0 = _mm_sub_epi32(s0, _mm_srai_epi32(d0, 1));
+  const __m128i o0 = _mm_add_epi32(d0, e0);
+  const __m128i e1 = _mm_sub_epi32(s1, _mm_srai_epi32(d1, 1));
+  const __m128i o1 = _mm_add_epi32(d1, e1);
+
+  _mm_storeu_si128((__m128i*)row0, _mm_unpacklo_epi32(e0, o0));
+  _mm_storeu_si128((__m128i*)(row0+4), _mm_unpackhi_epi32(e0, o0));
+  _mm_storeu_si128((__m128i*)row1, _mm_unpacklo_epi32(e1, o1));
+  _mm_storeu_si128((__m128i*)(row1+4), _mm_unpackhi_epi32(e1, o1));
+
+}
+
+int ReconstructRowPairSSE41(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+8 <= pair_count; j += 8)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    p_ReconstructGroup(row0+(j<<1)+8, row1+(j<<1)+8, ll+j+4, lh+j+4, hl+j+4, hh+j+4, q);
+  }
+
+  if (j+4 <= pair_count)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    j += 4;
+  }
+
+  return j;
+
+}
+
+int RGBToYCbCrSSE41(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m128i offset = _mm_set1_epi32(128);
+
+  int i = 0;
+  for (; i+4 <= count; i += 4)
+  {
+
+    const __m128i r = _mm_loadu_si128((__m128i*)(c0+i));
+    const __m128i g = _mm_loadu_si128((__m128i*)(c1+i));
+    const __m128i b = _mm_loadu_si128((__m128i*)(c2+i));
+
+    const __m128i y = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(r, _mm_slli_epi32(g, 1)), b), 2);
+
+    _mm_storeu_si128((__m128i*)(c0+i), _mm_sub_epi32(y, offset));
+    _mm_storeu_si128((__m128i*)(c1+i), _mm_sub_epi32(r, g));
+    _mm_storeu_si128((__m128i*)(c2+i), _mm_sub_epi32(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBSSE41(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m128i offset = _mm_set1_epi32(128);
+
+  int i = 0;
+  for (; i+4 <= count; i += 4)
+  {
+
+    const __m128i y = _mm_loadu_si128((__m128i*)(c0+i));
+    const __m128i cb = _mm_loadu_si128((__m128i*)(c1+i));
+    const __m128i cr = _mm_loadu_si128((__m128i*)(c2+i));
+
+    const __m128i g = _mm_add_epi32(_mm_sub_epi32(y, _mm_srai_epi32(_mm_add_epi32(cb, cr), 2)), offset);
+
+    _mm_storeu_si128((__m128i*)(c0+i), _mm_add_epi32(cb, g));
+    _mm_storeu_si128((__m128i*)(c1+i), g);
+    _mm_storeu_si128((__m128i*)(c2+i), _mm_add_epi32(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairSSE41(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+4 <= count; i += 4)
+  {
+
+    const __m128i a = _mm_add_epi32(_mm_loadu_si128((__m128i*)(row0+(i<<1))), _mm_loadu_si128((__m128i*)(row1+(i<<1))));
+    const __m128i b = _mm_add_epi32(_mm_loadu_si128((__m128i*)(row0+(i<<1)+4)), _mm_loadu_si128((__m128i*)(row1+(i<<1)+4)));
+
+    _mm_storeu_si128((__m128i*)(row+i), _mm_srai_epi32(_mm_hadd_epi32(a, b), 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowSSE41(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+4 <= count; i += 4)
+  {
+
+    const __m128i v = _mm_loadu_si128((__m128i*)(src+i));
+    const __m128i lo = _mm_unpacklo_epi32(v, v);
+    const __m128i hi = _mm_unpackhi_epi32(v, v);
+
+    _mm_storeu_si128((__m128i*)(row0+(i<<1)), lo);
+    _mm_storeu_si128((__m128i*)(row0+(i<<1)+4), hi);
+    _mm_storeu_si128((__m128i*)(row1+(i<<1)), lo);
+    _mm_storeu_si128((__m128i*)(row1+(i<<1)+4), hi);
+
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8SSE41(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m128i max = _mm_set1_epi32(127);
+  const __m128i min = _mm_set1_epi32(-127);
+
+  int i = 0, j;
+  for (; i+16 <= count; i += 16)
+  {
+
+    const __m128i v0 = _mm_loadu_si128((__m128i*)(src+i));
+    const __m128i v1 = _mm_loadu_si128((__m128i*)(src+i+4));
+    const __m128i v2 = _mm_loadu_si128((__m128i*)(src+i+8));
+    const __m128i v3 = _mm_loadu_si128((__m128i*)(src+i+12));
+
+    const __m128i escapes = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(v0, max), _mm_cmplt_epi32(v0, min)),
+                                                      _mm_or_si128(_mm_cmpgt_epi32(v1, max), _mm_cmplt_epi32(v1, min))),
+                                         _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(v2, max), _mm_cmplt_epi32(v2, min)),
+                                                      _mm_or_si128(_mm_cmpgt_epi32(v3, max), _mm_cmplt_epi32(v3, min))));
+
+    if (_mm_testz_si128(escapes, escapes))
+    {
+      _mm_storeu_si128((__m128i*)(dst+i), _mm_packs_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+    }
+    else
+    {
+      for (j = i; j < i+16; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+/* The RGB8 kernels are only vectorized for 16 bit samples */
+int RGB8ToYCbCrRowPairSSE41(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr) { return 0; }
+int YCbCrToPixelsRowSSE41(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format) { return 0; }
+
+#else
+
+/* 8 samples per vector, compiled with -msse4.1 */
+
+/* Even and odd samples of a and b, sign extended to 32 bits and packed
+ * back, which is exact */
+static inline __m128i p_Even(const __m128i a, const __m128i b)
+{
+  return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+static inline __m128i p_Odd(const __m128i a, const __m128i b)
+{
+  return _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+/* Same as quantize(): shift the magnitude, keep the sign */
+static inline __m128i p_Quantize(const __m128i x, const __m128i q)
+{
+  return _mm_sign_epi16(_mm_srl_epi16(_mm_abs_epi16(x), q), x);
+}
+
+static inline void p_DecomposeGroup(sample *row0, sample *row1, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param, const __m128i q)
+{
+
+  const __m128i a0 = _mm_loadu_si128((__m128i*)row0);
+  const __m128i a1 = _mm_loadu_si128((__m128i*)(row0+8));
+  const __m128i b0 = _mm_loadu_si128((__m128i*)row1);
+  const __m128i b1 = _mm_loadu_si128((__m128i*)(row1+8));
+
+  /* Horizontal */
+  const __m128i e0 = p_Even(a0, a1);
+  const __m128i e1 = p_Even(b0, b1);
+  const __m128i d0 = _mm_sub_epi16(p_Odd(a0, a1), e0);
+  const __m128i d1 = _mm_sub_epi16(p_Odd(b0, b1), e1);
+  const __m128i s0 = _mm_add_epi16(e0, _mm_srai_epi16(d0, 1));
+  const __m128i s1 = _mm_add_epi16(e1, _mm_srai_epi16(d1, 1));
+
+  /* Vertical */
+  __m128i vhl = _mm_sub_epi16(s1, s0);
+  __m128i vhh = _mm_sub_epi16(d1, d0);
+  const __m128i vll = _mm_add_epi16(s0, _mm_srai_epi16(vhl, 1));
+  __m128i vlh = _mm_add_epi16(d0, _mm_srai_epi16(vhh, 1));
+
+  if (quant_param)
+  {
+    vhl = p_Quantize(vhl, q);
+    vlh = p_Quantize(vlh, q);
+    vhh = p_Quantize(vhh, q);
+  }
+
+  _mm_storeu_si128((__m128i*)ll, vll);
+  _mm_storeu_si128((__m128i*)hl, vhl);
+  _mm_storeu_si128((__m128i*)lh, vlh);
+  _mm_storeu_si128((__m128i*)hh, vhh);
+
+}
+
+int DecomposeRowPairSSE41(sample *row0, sample *row1, const int pair_count, sample *ll, sample *lh, sample *hl, sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    p_DecomposeGroup(row0+(j<<1)+16, row1+(j<<1)+16, ll+j+8, lh+j+8, hl+j+8, hh+j+8, quant_param, q);
+  }
+
+  if (j+8 <= pair_count)
+  {
+    p_DecomposeGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, quant_param, q);
+    j += 8;
+  }
+
+  return j;
+
+}
+
+static inline void p_ReconstructGroup(sample *row0, sample *row1, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const __m128i q)
+{
+
+  const __m128i vll = _mm_loadu_si128((__m128i*)ll);
+  const __m128i vhl = _mm_sll_epi16(_mm_loadu_si128((__m128i*)hl), q);
+  const __m128i vlh = _mm_sll_epi16(_mm_loadu_si128((__m128i*)lh), q);
+  const __m128i vhh = _mm_sll_epi16(_mm_loadu_si128((__m128i*)hh), q);
+
+  /* Vertical */
+  const __m128i s0 = _mm_sub_epi16(vll, _mm_srai_epi16(vhl, 1));
+  const __m128i s1 = _mm_add_epi16(vhl, s0);
+  const __m128i d0 = _mm_sub_epi16(vlh, _mm_srai_epi16(vhh, 1));
+  const __m128i d1 = _mm_add_epi16(vhh, d0);
+
+  /* Horizontal */
+  const __m128i e0 = _mm_sub_epi16(s0, _mm_srai_epi16(d0, 1));
+  const __m128i o0 = _mm_add_epi16(d0, e0);
+  const __m128i e1 = _mm_sub_epi16(s1, _mm_srai_epi16(d1, 1));
+  const __m128i o1 = _mm_add_epi16(d1, e1);
+
+  _mm_storeu_si128((__m128i*)row0, _mm_unpacklo_epi16(e0, o0));
+  _mm_storeu_si128((__m128i*)(row0+8), _mm_unpackhi_epi16(e0, o0));
+  _mm_storeu_si128((__m128i*)row1, _mm_unpacklo_epi16(e1, o1));
+  _mm_storeu_si128((__m128i*)(row1+8), _mm_unpackhi_epi16(e1, o1));
+
+}
+
+int ReconstructRowPairSSE41(sample *row0, sample *row1, const int pair_count, const sample *ll, const sample *lh, const sample *hl, const sample *hh, const int quant_param)
+{
+
+  const __m128i q = _mm_cvtsi32_si128(quant_param);
+
+  int j = 0;
+  for (; j+16 <= pair_count; j += 16)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    p_ReconstructGroup(row0+(j<<1)+16, row1+(j<<1)+16, ll+j+8, lh+j+8, hl+j+8, hh+j+8, q);
+  }
+
+  if (j+8 <= pair_count)
+  {
+    p_ReconstructGroup(row0+(j<<1), row1+(j<<1), ll+j, lh+j, hl+j, hh+j, q);
+    j += 8;
+  }
+
+  return j;
+
+}
+
+int RGBToYCbCrSSE41(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m128i offset = _mm_set1_epi16(128);
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m128i r = _mm_loadu_si128((__m128i*)(c0+i));
+    const __m128i g = _mm_loadu_si128((__m128i*)(c1+i));
+    const __m128i b = _mm_loadu_si128((__m128i*)(c2+i));
+
+    const __m128i y = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(r, _mm_slli_epi16(g, 1)), b), 2);
+
+    _mm_storeu_si128((__m128i*)(c0+i), _mm_sub_epi16(y, offset));
+    _mm_storeu_si128((__m128i*)(c1+i), _mm_sub_epi16(r, g));
+    _mm_storeu_si128((__m128i*)(c2+i), _mm_sub_epi16(b, g));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToRGBSSE41(sample *c0, sample *c1, sample *c2, const int count)
+{
+
+  const __m128i offset = _mm_set1_epi16(128);
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m128i y = _mm_loadu_si128((__m128i*)(c0+i));
+    const __m128i cb = _mm_loadu_si128((__m128i*)(c1+i));
+    const __m128i cr = _mm_loadu_si128((__m128i*)(c2+i));
+
+    const __m128i g = _mm_add_epi16(_mm_sub_epi16(y, _mm_srai_epi16(_mm_add_epi16(cb, cr), 2)), offset);
+
+    _mm_storeu_si128((__m128i*)(c0+i), _mm_add_epi16(cb, g));
+    _mm_storeu_si128((__m128i*)(c1+i), g);
+    _mm_storeu_si128((__m128i*)(c2+i), _mm_add_epi16(cr, g));
+
+  }
+
+  return i;
+
+}
+
+int Downsample2RowPairSSE41(const sample *row0, const sample *row1, const int count, sample *row)
+{
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m128i a = _mm_add_epi16(_mm_loadu_si128((__m128i*)(row0+(i<<1))), _mm_loadu_si128((__m128i*)(row1+(i<<1))));
+    const __m128i b = _mm_add_epi16(_mm_loadu_si128((__m128i*)(row0+(i<<1)+8)), _mm_loadu_si128((__m128i*)(row1+(i<<1)+8)));
+
+    _mm_storeu_si128((__m128i*)(row+i), _mm_srai_epi16(_mm_hadd_epi16(a, b), 2));
+
+  }
+
+  return i;
+
+}
+
+int Upsample2RowSSE41(const sample *src, const int count, sample *row0, sample *row1)
+{
+
+  int i = 0;
+  for (; i+8 <= count; i += 8)
+  {
+
+    const __m128i v = _mm_loadu_si128((__m128i*)(src+i));
+    const __m128i lo = _mm_unpacklo_epi16(v, v);
+    const __m128i hi = _mm_unpackhi_epi16(v, v);
+
+    _mm_storeu_si128((__m128i*)(row0+(i<<1)), lo);
+    _mm_storeu_si128((__m128i*)(row0+(i<<1)+8), hi);
+    _mm_storeu_si128((__m128i*)(row1+(i<<1)), lo);
+    _mm_storeu_si128((__m128i*)(row1+(i<<1)+8), hi);
+
+  }
+
+  return i;
+
+}
+
+/* Blocks without escapes are packed with saturation, the rare blocks with
+ * escapes go through pack32_8() to keep the overflow order */
+int Pack8SSE41(const sample *src, const int count, int8_t *dst, int32_t *overflow_buf, int *overflow_buf_pos)
+{
+
+  const __m128i max = _mm_set1_epi16(127);
+  const __m128i min = _mm_set1_epi16(-127);
+
+  int i = 0, j;
+  for (; i+32 <= count; i += 32)
+  {
+
+    const __m128i v0 = _mm_loadu_si128((__m128i*)(src+i));
+    const __m128i v1 = _mm_loadu_si128((__m128i*)(src+i+8));
+    const __m128i v2 = _mm_loadu_si128((__m128i*)(src+i+16));
+    const __m128i v3 = _mm_loadu_si128((__m128i*)(src+i+24));
+
+    const __m128i escapes = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(v0, max), _mm_cmplt_epi16(v0, min)),
+                                                      _mm_or_si128(_mm_cmpgt_epi16(v1, max), _mm_cmplt_epi16(v1, min))),
+                                         _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(v2, max), _mm_cmplt_epi16(v2, min)),
+                                                      _mm_or_si128(_mm_cmpgt_epi16(v3, max), _mm_cmplt_epi16(v3, min))));
+
+    if (_mm_testz_si128(escapes, escapes))
+    {
+      _mm_storeu_si128((__m128i*)(dst+i), _mm_packs_epi16(v0, v1));
+      _mm_storeu_si128((__m128i*)(dst+i+16), _mm_packs_epi16(v2, v3));
+    }
+    else
+    {
+      for (j = i; j < i+32; ++j)
+        dst[j] = pack32_8(src[j], overflow_buf, overflow_buf_pos);
+    }
+
+  }
+
+  return i;
+
+}
+
+/* Luma of the 16 pixels at rgb to y, their chroma R-G and B-G to cb and cr */
+static inline void p_RGB8ToYCbCr(const uint8_t *rgb, sample *y, __m128i *cb, __m128i *cr)
+{
+
+  const __m128i offset = _mm_set1_epi16(128);
+
+  __m128i r8, g8, b8;
+  LoadRGB8x16(rgb, &r8, &g8, &b8);
+
+  const __m128i r[2] = { _mm_cvtepu8_epi16(r8), _mm_cvtepu8_epi16(_mm_srli_si128(r8, 8)) };
+  const __m128i g[2] = { _mm_cvtepu8_epi16(g8), _mm_cvtepu8_epi16(_mm_srli_si128(g8, 8)) };
+  const __m128i b[2] = { _mm_cvtepu8_epi16(b8), _mm_cvtepu8_epi16(_mm_srli_si128(b8, 8)) };
+
+  int k;
+  for (k = 0; k < 2; ++k)
+  {
+    _mm_storeu_si128((__m128i*)(y+(k<<3)),
+                     _mm_sub_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(r[k], _mm_slli_epi16(g[k], 1)), b[k]), 2), offset));
+    cb[k] = _mm_sub_epi16(r[k], g[k]);
+    cr[k] = _mm_sub_epi16(b[k], g[k]);
+  }
+
+}
+
+int RGB8ToYCbCrRowPairSSE41(const uint8_t *rgb0, const uint8_t *rgb1, const int pair_count, sample *y0, sample *y1, sample *cb, sample *cr)
+{
+
+  __m128i cb0[2], cr0[2], cb1[2], cr1[2];
+
+  int i = 0;
+  for (; i+8 <= pair_count; i += 8)
+  {
+
+    p_RGB8ToYCbCr(rgb0+i*6, y0+(i<<1), cb0, cr0);
+    p_RGB8ToYCbCr(rgb1+i*6, y1+(i<<1), cb1, cr1);
+
+    _mm_storeu_si128((__m128i*)(cb+i),
+                     _mm_srai_epi16(_mm_hadd_epi16(_mm_add_epi16(cb0[0], cb1[0]), _mm_add_epi16(cb0[1], cb1[1])), 2));
+    _mm_storeu_si128((__m128i*)(cr+i),
+                     _mm_srai_epi16(_mm_hadd_epi16(_mm_add_epi16(cr0[0], cr1[0]), _mm_add_epi16(cr0[1], cr1[1])), 2));
+
+  }
+
+  return i;
+
+}
+
+int YCbCrToPixelsRowSSE41(const sample *y, const sample *cb, const sample *cr, const int pair_count, uint8_t *pixels, const PixelFormat format)
+{
+
+  const int pixel_size = PIXEL_SIZE(format);
+  const __m128i offset = _mm_set1_epi16(128);
+
+  __m128i vcb[2], vcr[2], g[2];
+
+  int i = 0, k;
+  for (; i+8 <= pair_count; i += 8)
+  {
+
+    const __m128i u = _mm_loadu_si128((__m128i*)(cb+i));
+    const __m128i v = _mm_loadu_si128((__m128i*)(cr+i));
+    const __m128i t = _mm_srai_epi16(_mm_add_epi16(u, v), 2);
+
+    /* Every chroma sample covers two pixels */
+    const __m128i vt[2] = { _mm_unpacklo_epi16(t, t), _mm_unpackhi_epi16(t, t) };
+    vcb[0] = _mm_unpacklo_epi16(u, u);
+    vcb[1] = _mm_unpackhi_epi16(u, u);
+    vcr[0] = _mm_unpacklo_epi16(v, v);
+    vcr[1] = _mm_unpackhi_epi16(v, v);
+
+    for (k = 0; k < 2; ++k)
+      g[k] = _mm_add_epi16(_mm_sub_epi16(_mm_loadu_si128((__m128i*)(y+(i<<1)+(k<<3))), vt[k]), offset);
+
+    /* Packing with unsigned saturation is CLIP() */
+    StorePixels8x16(pixels+(i<<1)*pixel_size, _mm_packus_epi16(_mm_add_epi16(vcb[0], g[0]), _mm_add_epi16(vcb[1], g[1])),
+                    _mm_packus_epi16(g[0], g[1]),
+                    _mm_packus_epi16(_mm_add_epi16(vcr[0], g[0]), _mm_add_epi16(vcr[1], g[1])), format);
+
+  }
+
+  return i;
+
+}
+
+#endif
+
+/* Four sub-histograms so that runs of equal bytes do not serialize on the
+ * same counter */
+void HistogramSSE41(const byte *data, const int size, uint32_t *histogram)
+{
+
+  uint32_t h[4][BYTE_MAX+1];
+  memset(h, 0, sizeof(h));
+
+  int i = 0, k;
+  for (; i+16 <= size; i += 16)
+  {
+
+    const __m128i v = _mm_loadu_si128((__m128i*)(data+i));
+    uint64_t lo = (uint64_t)_mm_cvtsi128_si64(v);
+    uint64_t hi = (uint64_t)_mm_extract_epi64(v, 1);
+
+    for (k = 0; k < 2; ++k)
+    {
+      ++h[0][lo & 0xFF]; ++h[1][(lo >> 8) & 0xFF]; ++h[2][(lo >> 16) & 0xFF]; ++h[3][(lo >> 24) & 0xFF];
+      ++h[0][hi & 0xFF]; ++h[1][(hi >> 8) & 0xFF]; ++h[2][(hi >> 16) & 0xFF]; ++h[3][(hi >> 24) & 0xFF];
+      lo >>= 32;
+      hi >>= 32;
+    }
+
+  }
+
+  for (; i < size; ++i) ++h[0][data[i]];
+
+  for (k = 0; k < BYTE_MAX+1; ++k)
+    histogram[k] = h[0][k] + h[1][k] + h[2][k] + h[3][k];
+
+}
@@ -0,0 +1,67 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/resource.h>
+
+#include "stage.h"
+#include "heap.h"
+
+static double p_Seconds(const clockid_t id)
+{
+
+  struct timespec ts;
+  clock_gettime(id, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+}
+
+void StageStart(StageClock *clock)
+{
+
+  clock->wall = p_Seconds(CLOCK_MONOTONIC);
+  clock->cpu = p_Seconds(CLOCK_PROCESS_CPUTIME_ID);
+  clock->allocations = HeapAllocationCount();
+
+}
+
+void StageStop(const StageClock *clock, const size_t bytes_in, const size_t bytes_out, Stage *stage)
+{
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  stage->wall += p_Seconds(CLOCK_MONOTONIC) - clock->wall;
+  stage->cpu += p_Seconds(CLOCK_PROCESS_CPUTIME_ID) - clock->cpu;
+  stage->bytes_in += bytes_in;
+  stage->bytes_out += bytes_out;
+  stage->allocations += HeapAllocationCount() - clock->allocations;
+  stage->peak_rss = MAX(stage->peak_rss, (size_t)usage.ru_maxrss << 10); /* Kilobytes on Linux */
+
+}
+
+void StageAdd(Stage *stage, const Stage *other)
+{
+
+  stage->wall += other->wall;
+  stage->cpu += other->cpu;
+  stage->bytes_in += other->bytes_in;
+  stage->bytes_out += other->bytes_out;
+  stage->allocations += other->allocations;
+  stage->peak_rss = MAX(stage->peak_rss, other->peak_rss);
+
+}
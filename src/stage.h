@@ -0,0 +1,61 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STAGE_H
+#define STAGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "types.h"
+
+/* Resources a stage of the codec took. Wall time is taken from the
+ * monotonic clock; CPU time, allocations and the peak resident set are
+ * those of the whole process, so stages that run at the same time on
+ * other threads are included. */
+struct tStage
+{
+  double wall;              /* Seconds */
+  double cpu;               /* Seconds */
+  size_t bytes_in;          /* Bytes read by the stage */
+  size_t bytes_out;         /* Bytes written by the stage */
+  int64_t allocations;      /* Heap allocations of the library, see heap.h */
+  size_t peak_rss;          /* Peak resident set in bytes at the end of the stage */
+};
+typedef struct tStage Stage;
+
+/* Start of a stage, see StageStart */
+struct tStageClock
+{
+  double wall;
+  double cpu;
+  int64_t allocations;
+};
+typedef struct tStageClock StageClock;
+
+void StageStart(StageClock *clock);
+
+/* Adds the stage since StageStart to stage, so a stage run in several
+ * pieces is measured by a StageStart and StageStop around each */
+void StageStop(const StageClock *clock, const size_t bytes_in, const size_t bytes_out, Stage *stage);
+
+/* Adds the stage other to stage, the peak resident set is the larger one */
+void StageAdd(Stage *stage, const Stage *other);
+
+#endif
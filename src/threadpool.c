@@ -0,0 +1,186 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "threadpool.h"
+
+typedef struct tThreadPoolJob ThreadPoolJob;
+
+struct tThreadPoolJob
+{
+  ThreadPoolTask task;
+  void *context;
+  int count;
+  int next_index;
+  int done_count;
+  ThreadPoolJob *next;
+};
+
+static pthread_mutex_t p_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t p_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t p_done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t *p_threads = NULL;
+static int p_thread_count = 1;
+static bool p_shutdown = false;
+
+/* Jobs with indices left to hand out */
+static ThreadPoolJob *p_jobs = NULL;
+
+static void p_RemoveJob(ThreadPoolJob *job)
+{
+
+  ThreadPoolJob **p = &p_jobs;
+  while (*p != job) p = &(*p)->next;
+  *p = job->next;
+
+}
+
+/* Takes the next index of a job, the mutex has to be held */
+static int p_TakeIndex(ThreadPoolJob *job)
+{
+
+  const int index = job->next_index++;
+  if (job->next_index == job->count) p_RemoveJob(job);
+  return index;
+
+}
+
+/* Runs one index of a job, the mutex has to be held and is held again on
+ * return */
+static void p_RunIndex(ThreadPoolJob *job, const int index)
+{
+
+  pthread_mutex_unlock(&p_mutex);
+  job->task(job->context, index);
+  pthread_mutex_lock(&p_mutex);
+
+  if (++job->done_count == job->count)
+    pthread_cond_broadcast(&p_done_cond);
+
+}
+
+static void* p_Worker(void *arg)
+{
+
+  ThreadPoolJob *job;
+
+  pthread_mutex_lock(&p_mutex);
+
+  while (true)
+  {
+
+    while ((!p_shutdown) && (!p_jobs))
+      pthread_cond_wait(&p_work_cond, &p_mutex);
+
+    if (p_shutdown) break;
+
+    job = p_jobs;
+    p_RunIndex(job, p_TakeIndex(job));
+
+  }
+
+  pthread_mutex_unlock(&p_mutex);
+
+  return NULL;
+
+}
+
+void ThreadPoolInit(const int thread_count)
+{
+
+  ThreadPoolDestroy();
+
+  p_thread_count = MAX(thread_count, 1);
+  p_shutdown = false;
+
+  if (p_thread_count == 1) return;
+
+  p_threads = HeapAlloc(sizeof(pthread_t)*(p_thread_count-1));
+
+  /* Without memory for the threads everything runs on the calling thread */
+  if (!p_threads)
+  {
+    p_thread_count = 1;
+    return;
+  }
+
+  int i;
+  for (i = 0; i < p_thread_count-1; ++i)
+    pthread_create(&p_threads[i], NULL, p_Worker, NULL);
+
+}
+
+void ThreadPoolDestroy(void)
+{
+
+  if (!p_threads) return;
+
+  pthread_mutex_lock(&p_mutex);
+  p_shutdown = true;
+  pthread_cond_broadcast(&p_work_cond);
+  pthread_mutex_unlock(&p_mutex);
+
+  int i;
+  for (i = 0; i < p_thread_count-1; ++i)
+    pthread_join(p_threads[i], NULL);
+
+  free(p_threads);
+  p_threads = NULL;
+  p_thread_count = 1;
+
+}
+
+int ThreadPoolThreadCount(void)
+{
+
+  return p_thread_count;
+
+}
+
+void ThreadPoolParallelFor(const int count, ThreadPoolTask task, void *context)
+{
+
+  int i;
+
+  if ((p_thread_count == 1) || (count < 2))
+  {
+    for (i = 0; i < count; ++i) task(context, i);
+    return;
+  }
+
+  ThreadPoolJob job;
+  job.task = task;
+  job.context = context;
+  job.count = count;
+  job.next_index = 0;
+  job.done_count = 0;
+
+  pthread_mutex_lock(&p_mutex);
+
+  job.next = p_jobs;
+  p_jobs = &job;
+  pthread_cond_broadcast(&p_work_cond);
+
+  while (job.next_index < job.count)
+    p_RunIndex(&job, p_TakeIndex(&job));
+
+  while (job.done_count < job.count)
+    pthread_cond_wait(&p_done_cond, &p_mutex);
+
+  pthread_mutex_unlock(&p_mutex);
+
+}
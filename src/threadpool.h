@@ -0,0 +1,44 @@
+/* BILD - Wavelet based image compression
+ * All rights reserved (since 2004). Marco Nelles.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "heap.h"
+
+/* Process wide pool of worker threads. ThreadPoolParallelFor() runs
+ * task(context, 0..count-1) on the workers and the calling thread and
+ * returns when all indices are done. Calls may be nested: a task can start
+ * its own parallel loop, the calling thread always works on its own loop
+ * while waiting, so nesting cannot deadlock. */
+
+typedef void (*ThreadPoolTask)(void *context, const int index);
+
+/* thread_count includes the calling thread, 1 runs everything serially */
+void ThreadPoolInit(const int thread_count);
+void ThreadPoolDestroy(void);
+
+int ThreadPoolThreadCount(void);
+
+void ThreadPoolParallelFor(const int count, ThreadPoolTask task, void *context);
+
+#endif
@@ -29,12 +29,29 @@ typedef int bool;
 #define CLIP(X) ((X) > 255 ? 255 : (X) < 0 ? 0 : X)
 #define ABS(X) (X > 0 ? X : -X)
 #define MAX(A, B) (((A) > (B)) ? (A) : (B))
+#define MIN(A, B) (((A) < (B)) ? (A) : (B))
 #define SGN(X) ((X > 0) - (X < 0))
 
 typedef unsigned char byte;
 
+/* Pixels and wavelet coefficients. The colour transforms and the Haar
+ * transform of 8 bit images stay within 16 bits at every level, the few
+ * coefficients that do not fit a byte go to the overflow values, which are
+ * 32 bits. BILD_WIDE_SAMPLES keeps 32 bit planes for deeper input. */
+#ifdef BILD_WIDE_SAMPLES
+typedef int32_t sample;
+#else
+typedef int16_t sample;
+#endif
+
 #define BYTE_MAX 255
 
+/* Byte orders of interleaved 8 bit pixels, same values as BILDPixelFormat */
+enum tPixelFormat { PixelRGB8 = 0, PixelRGBA8, PixelBGR8 };
+typedef enum tPixelFormat PixelFormat;
+
+#define PIXEL_SIZE(FORMAT) ((FORMAT) == PixelRGBA8 ? 4 : 3)
+
 static inline uint32_t get_next_pow(const uint32_t i)
 {
   uint32_t n = i > 0 ? i - 1 : 0;
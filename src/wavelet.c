@@ -18,13 +18,13 @@
 #include "wavelet.h"
 
 /* Haar transform */
-void HaarForwardTransform(const int32_t s1, const int32_t s2, int32_t *s, int32_t *d)
+void HaarForwardTransform(const sample s1, const sample s2, sample *s, sample *d)
 {
   *d = s2 - s1;
   *s = s1 + (*d >> 1);
 }
 
-void HaarInverseTransform(const int32_t s, const int32_t d, int32_t *s1, int32_t *s2)
+void HaarInverseTransform(const sample s, const sample d, sample *s1, sample *s2)
 {
   *s1 = s - (d >> 1);
   *s2 = d + *s1;
@@ -24,7 +24,7 @@
 
 #include "types.h"
 
-void HaarForwardTransform(const int32_t s1, const int32_t s2, int32_t *s, int32_t *d);
-void HaarInverseTransform(const int32_t s, const int32_t d, int32_t *s1, int32_t *s2);
+void HaarForwardTransform(const sample s1, const sample s2, sample *s, sample *d);
+void HaarInverseTransform(const sample s, const sample d, sample *s1, sample *s2);
 
 #endif